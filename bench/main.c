@@ -0,0 +1,18 @@
+#include "raster_bench.h"
+
+int
+main (void)
+{
+  // rasterizer benchmarks
+  bench_triangle_shapes ();
+  bench_dense_mesh ();
+  bench_vertex_cache ();
+  bench_vertex_stage ();
+  bench_msaa ();
+  bench_lines ();
+  bench_points ();
+  bench_fragment_shading ();
+  bench_instancing ();
+
+  return 0;
+}
@@ -0,0 +1,1047 @@
+#include "raster_bench.h"
+#include "graphics/draw.h"
+#include "graphics/vertex.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FB_WIDTH 1280
+#define FB_HEIGHT 720
+#define REPEATS 5
+
+typedef struct
+{
+  float pos[3];
+  float col[4];
+} BenchVertex;
+
+typedef enum
+{
+  SHAPE_SMALL,    /* a few pixels */
+  SHAPE_MEDIUM,   /* a few hundred pixels */
+  SHAPE_LARGE,    /* a good part of the screen */
+  SHAPE_SLIVER,   /* long and one or two pixels wide, any direction */
+  SHAPE_DIAGONAL, /* long thin triangles along a diagonal */
+  SHAPE_COUNT
+} Shape;
+
+static const char *shape_names[SHAPE_COUNT] = {
+  "small", "medium", "large", "sliver", "diagonal",
+};
+
+static const int shape_counts[SHAPE_COUNT] = {
+  200000, 20000, 200, 5000, 5000,
+};
+
+static float
+randf (float min, float max)
+{
+  return min + (max - min) * ((float)rand () / (float)RAND_MAX);
+}
+
+static double
+now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/*
+ * fill count triangles of the given shape in NDC. later triangles are nearer
+ * so every covered pixel passes the depth test and the timings measure the
+ * rasterizer, not the Hi-Z rejection.
+ */
+static void
+make_triangles (BenchVertex *v, int count, Shape shape)
+{
+  float px = 2.0f / FB_WIDTH;
+  float py = 2.0f / FB_HEIGHT;
+
+  for (int i = 0; i < count; ++i)
+    {
+      float cx = randf (-0.9f, 0.9f);
+      float cy = randf (-0.9f, 0.9f);
+      float x[3], y[3];
+
+      switch (shape)
+        {
+        case SHAPE_SMALL:
+        case SHAPE_MEDIUM:
+        case SHAPE_LARGE:
+          {
+            float r = shape == SHAPE_SMALL ? 3.0f
+                      : shape == SHAPE_MEDIUM ? 25.0f
+                                              : 300.0f;
+            for (int k = 0; k < 3; ++k)
+              {
+                x[k] = cx + randf (-r, r) * px;
+                y[k] = cy + randf (-r, r) * py;
+              }
+            break;
+          }
+        case SHAPE_SLIVER:
+          {
+            float len = randf (200.0f, 600.0f);
+            float dx = randf (-1.0f, 1.0f);
+            float dy = randf (-1.0f, 1.0f);
+            x[0] = cx;
+            y[0] = cy;
+            x[1] = cx + dx * len * px;
+            y[1] = cy + dy * len * py;
+            x[2] = cx + 2.0f * px;
+            y[2] = cy + 2.0f * py;
+            break;
+          }
+        case SHAPE_DIAGONAL:
+        default:
+          {
+            float len = randf (300.0f, 700.0f);
+            x[0] = cx - 0.5f * len * px;
+            y[0] = cy - 0.5f * len * py;
+            x[1] = cx + 0.5f * len * px;
+            y[1] = cy + 0.5f * len * py;
+            x[2] = x[0] + 12.0f * px;
+            y[2] = y[0];
+            break;
+          }
+        }
+
+      float z = 0.99f - 1.98f * (float)i / (float)count;
+      for (int k = 0; k < 3; ++k)
+        {
+          BenchVertex *out = &v[i * 3 + k];
+          out->pos[0] = x[k];
+          out->pos[1] = y[k];
+          out->pos[2] = z;
+          out->col[0] = randf (0.0f, 1.0f);
+          out->col[1] = randf (0.0f, 1.0f);
+          out->col[2] = randf (0.0f, 1.0f);
+          out->col[3] = 1.0f;
+        }
+    }
+}
+
+/* best of REPEATS indexed draws, in seconds */
+static double
+time_draw_indexed (Framebuffer *fb, const IndexBuffer *ib,
+                   const VertexBuffer *vb, const DrawState *state)
+{
+  double best = 1e30;
+  for (int r = 0; r < REPEATS; ++r)
+    {
+      fb_clear (fb);
+      double start = now_seconds ();
+      draw_index_buffer (fb, ib, vb, PRIM_TRIANGLES, state);
+      double elapsed = now_seconds () - start;
+      if (elapsed < best)
+        best = elapsed;
+    }
+  return best;
+}
+
+/* best of REPEATS draws of the whole buffer, in seconds */
+static double
+time_draw (Framebuffer *fb, const VertexBuffer *vb, const DrawState *state)
+{
+  double best = 1e30;
+  for (int r = 0; r < REPEATS; ++r)
+    {
+      fb_clear (fb);
+      double start = now_seconds ();
+      draw_vertex_buffer (fb, vb, PRIM_TRIANGLES, state);
+      double elapsed = now_seconds () - start;
+      if (elapsed < best)
+        best = elapsed;
+    }
+  return best;
+}
+
+void
+bench_triangle_shapes (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_triangle_shapes: framebuffer allocation failed\n");
+      return;
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+
+  const RasterPath paths[] = { RASTER_PATH_BLOCKS, RASTER_PATH_SPANS,
+                               RASTER_PATH_AUTO };
+
+  printf ("triangle shapes, %dx%d, ms per draw (best of %d)\n", FB_WIDTH,
+          FB_HEIGHT, REPEATS);
+  printf ("%-10s %8s %10s %10s %10s\n", "shape", "count", "blocks", "spans",
+          "auto");
+
+  srand (1);
+  for (int s = 0; s < SHAPE_COUNT; ++s)
+    {
+      int count = shape_counts[s];
+      BenchVertex *vertices = malloc (sizeof (BenchVertex) * 3 * count);
+      if (!vertices)
+        break;
+      make_triangles (vertices, count, (Shape)s);
+
+      VertexLayout layout
+          = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+      VertexBuffer vb = vertex_buffer_create (vertices, layout, 3 * count);
+
+      double ms[3];
+      for (int p = 0; p < 3; ++p)
+        {
+          DrawState state = draw_state_default ();
+          state.raster_path = paths[p];
+          ms[p] = time_draw (&fb, &vb, &state) * 1000.0;
+        }
+
+      printf ("%-10s %8d %10.2f %10.2f %10.2f\n", shape_names[s], count,
+              ms[0], ms[1], ms[2]);
+
+      vertex_buffer_destroy (&vb);
+      free (vertices);
+    }
+
+  fb_shutdown (&fb);
+}
+
+/*
+ * a rippled height-field grid of about a million triangles over the whole
+ * screen, a few pixels per triangle, drawn indexed.
+ */
+void
+bench_dense_mesh (void)
+{
+  const int cols = 800;
+  const int rows = 640;
+
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_dense_mesh: framebuffer allocation failed\n");
+      return;
+    }
+
+  int vertex_count = (cols + 1) * (rows + 1);
+  int index_count = cols * rows * 6;
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * vertex_count);
+  unsigned int *indices = malloc (sizeof (unsigned int) * index_count);
+  if (!vertices || !indices)
+    {
+      free (vertices);
+      free (indices);
+      fb_shutdown (&fb);
+      return;
+    }
+
+  srand (2);
+  for (int y = 0; y <= rows; ++y)
+    {
+      for (int x = 0; x <= cols; ++x)
+        {
+          BenchVertex *v = &vertices[y * (cols + 1) + x];
+          float u = (float)x / cols;
+          float w = (float)y / rows;
+          v->pos[0] = -1.0f + 2.0f * u + randf (-0.3f, 0.3f) / FB_WIDTH;
+          v->pos[1] = -1.0f + 2.0f * w + randf (-0.3f, 0.3f) / FB_HEIGHT;
+          v->pos[2] = 0.5f * sinf (u * 40.0f) * cosf (w * 30.0f);
+          v->col[0] = u;
+          v->col[1] = w;
+          v->col[2] = 0.5f;
+          v->col[3] = 1.0f;
+        }
+    }
+
+  unsigned int *idx = indices;
+  for (int y = 0; y < rows; ++y)
+    {
+      for (int x = 0; x < cols; ++x)
+        {
+          unsigned int i0 = y * (cols + 1) + x;
+          unsigned int i1 = i0 + 1;
+          unsigned int i2 = i0 + cols + 1;
+          unsigned int i3 = i2 + 1;
+          *idx++ = i0;
+          *idx++ = i1;
+          *idx++ = i3;
+          *idx++ = i0;
+          *idx++ = i3;
+          *idx++ = i2;
+        }
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, vertex_count);
+  IndexBuffer ib = index_buffer_create (indices, index_count);
+
+  int triangles = index_count / 3;
+  printf ("\ndense mesh, %d triangles, %dx%d (best of %d)\n", triangles,
+          FB_WIDTH, FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s %12s\n", "path", "ms", "Mtri/s");
+
+  const RasterPath paths[] = { RASTER_PATH_BLOCKS, RASTER_PATH_AUTO };
+  const char *names[] = { "blocks", "auto" };
+
+  for (int p = 0; p < 2; ++p)
+    {
+      DrawState state = draw_state_default ();
+      state.raster_path = paths[p];
+      double seconds = time_draw_indexed (&fb, &ib, &vb, &state);
+      printf ("%-10s %10.2f %12.2f\n", names[p], seconds * 1000.0,
+              triangles / seconds * 1e-6);
+    }
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&vb);
+  free (indices);
+  free (vertices);
+  fb_shutdown (&fb);
+}
+
+/*
+ * a clip-space grid drawn indexed, through the post-transform vertex cache,
+ * against the same triangles unrolled into a vertex buffer, where every
+ * triangle transforms its three vertices again.
+ */
+void
+bench_vertex_cache (void)
+{
+  const int cols = 400;
+  const int rows = 320;
+
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_vertex_cache: framebuffer allocation failed\n");
+      return;
+    }
+
+  typedef struct
+  {
+    float pos[4];
+    float col[4];
+  } ClipBenchVertex;
+
+  int vertex_count = (cols + 1) * (rows + 1);
+  int index_count = cols * rows * 6;
+  ClipBenchVertex *vertices = malloc (sizeof (ClipBenchVertex) * vertex_count);
+  ClipBenchVertex *unrolled = malloc (sizeof (ClipBenchVertex) * index_count);
+  unsigned int *indices = malloc (sizeof (unsigned int) * index_count);
+  if (!vertices || !unrolled || !indices)
+    {
+      free (vertices);
+      free (unrolled);
+      free (indices);
+      fb_shutdown (&fb);
+      return;
+    }
+
+  /* w grows towards the top, like a floor seen in perspective */
+  for (int y = 0; y <= rows; ++y)
+    {
+      for (int x = 0; x <= cols; ++x)
+        {
+          ClipBenchVertex *v = &vertices[y * (cols + 1) + x];
+          float u = (float)x / cols;
+          float w = 1.0f + (float)y / rows;
+          v->pos[0] = (-1.0f + 2.0f * u) * w;
+          v->pos[1] = (-1.0f + 2.0f * (float)y / rows) * w;
+          v->pos[2] = 0.5f * w;
+          v->pos[3] = w;
+          v->col[0] = u;
+          v->col[1] = (float)y / rows;
+          v->col[2] = 0.5f;
+          v->col[3] = 1.0f;
+        }
+    }
+
+  unsigned int *idx = indices;
+  for (int y = 0; y < rows; ++y)
+    {
+      for (int x = 0; x < cols; ++x)
+        {
+          unsigned int i0 = y * (cols + 1) + x;
+          unsigned int i1 = i0 + 1;
+          unsigned int i2 = i0 + cols + 1;
+          unsigned int i3 = i2 + 1;
+          *idx++ = i0;
+          *idx++ = i1;
+          *idx++ = i3;
+          *idx++ = i0;
+          *idx++ = i3;
+          *idx++ = i2;
+        }
+    }
+  for (int i = 0; i < index_count; ++i)
+    unrolled[i] = vertices[indices[i]];
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (ClipBenchVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (ClipBenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (ClipBenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, vertex_count);
+  layout = vertex_layout_create (attributes, 2, sizeof (ClipBenchVertex));
+  VertexBuffer unrolled_vb = vertex_buffer_create (unrolled, layout, index_count);
+  IndexBuffer ib = index_buffer_create (indices, index_count);
+
+  DrawStats stats = { 0 };
+  DrawState state = draw_state_default ();
+  state.stats = &stats;
+
+  double unrolled_seconds = time_draw (&fb, &unrolled_vb, &state);
+  stats = (DrawStats){ 0 };
+  double indexed_seconds = time_draw_indexed (&fb, &ib, &vb, &state);
+
+  int triangles = index_count / 3;
+  double lookups = (double)(stats.vertex_cache_hits
+                            + stats.vertices_transformed);
+  printf ("\nvertex cache, %d clip-space triangles, %dx%d (best of %d)\n",
+          triangles, FB_WIDTH, FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s %12s\n", "draw", "ms", "Mtri/s");
+  printf ("%-10s %10.2f %12.2f\n", "unrolled", unrolled_seconds * 1000.0,
+          triangles / unrolled_seconds * 1e-6);
+  printf ("%-10s %10.2f %12.2f\n", "indexed", indexed_seconds * 1000.0,
+          triangles / indexed_seconds * 1e-6);
+  printf ("hit rate %.1f%%, speedup %.2fx\n",
+          100.0 * (double)stats.vertex_cache_hits / lookups,
+          unrolled_seconds / indexed_seconds);
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&unrolled_vb);
+  vertex_buffer_destroy (&vb);
+  free (indices);
+  free (unrolled);
+  free (vertices);
+  fb_shutdown (&fb);
+}
+
+/*
+ * the position transform on its own: a million object-space vertices taken
+ * to clip space one at a time, as a caller rewriting its buffer would, and
+ * a batch at a time by the vertex stage, from interleaved and SoA storage.
+ */
+void
+bench_vertex_stage (void)
+{
+  const int count = 1 << 20;
+
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * count);
+  Vec4f_t *out = malloc (sizeof (Vec4f_t) * count);
+  if (!vertices || !out)
+    {
+      free (vertices);
+      free (out);
+      return;
+    }
+
+  srand (5);
+  for (int i = 0; i < count; ++i)
+    {
+      vertices[i].pos[0] = (float)rand () / RAND_MAX * 2.0f - 1.0f;
+      vertices[i].pos[1] = (float)rand () / RAND_MAX * 2.0f - 1.0f;
+      vertices[i].pos[2] = (float)rand () / RAND_MAX * 2.0f - 1.0f;
+      vertices[i].col[0] = vertices[i].col[1] = vertices[i].col[2] = 1.0f;
+      vertices[i].col[3] = 1.0f;
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, count);
+  layout = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  layout.storage = VERTEX_STORAGE_SOA;
+  VertexBuffer soa_vb = vertex_buffer_create (vertices, layout, count);
+
+  Mat4x4f_t model = mat4x4f_identity ();
+  model = mat4x4f_rotation (&model, (Vec3f_t){ 0.3f, 0.5f, 0.7f });
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 3 }, (Vec3f_t){ 0, 0, 0 },
+                                   (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t projection = mat4x4f_perspective (1.0f, 16.0f / 9.0f, 0.1f, 10.0f);
+  Mat4x4f_t mvp = mat4x4f_mul (&view, &model);
+  mvp = mat4x4f_mul (&projection, &mvp);
+
+  double single_seconds = 1e30;
+  double batched_seconds = 1e30;
+  double soa_seconds = 1e30;
+  float sink = 0.0f;
+  for (int r = 0; r < REPEATS; ++r)
+    {
+      double t0 = now_seconds ();
+      for (int i = 0; i < count; ++i)
+        out[i] = vertex_transform_position (&mvp, vertices[i].pos, 3);
+      double t1 = now_seconds ();
+      sink += out[r].w;
+      vertex_transform_positions (&mvp, &vb, out);
+      double t2 = now_seconds ();
+      sink += out[r].w;
+      vertex_transform_positions (&mvp, &soa_vb, out);
+      double t3 = now_seconds ();
+      sink += out[r].w;
+
+      if (t1 - t0 < single_seconds)
+        single_seconds = t1 - t0;
+      if (t2 - t1 < batched_seconds)
+        batched_seconds = t2 - t1;
+      if (t3 - t2 < soa_seconds)
+        soa_seconds = t3 - t2;
+    }
+
+  printf ("\nvertex stage, %d positions (best of %d, checksum %.1f)\n", count,
+          REPEATS, sink);
+  printf ("%-10s %10s %12s\n", "transform", "ms", "Mvert/s");
+  printf ("%-10s %10.2f %12.2f\n", "single", single_seconds * 1000.0,
+          count / single_seconds * 1e-6);
+  printf ("%-10s %10.2f %12.2f\n", "batched", batched_seconds * 1000.0,
+          count / batched_seconds * 1e-6);
+  printf ("%-10s %10.2f %12.2f\n", "soa", soa_seconds * 1000.0,
+          count / soa_seconds * 1e-6);
+  printf ("speedup %.2fx batched, %.2fx soa\n",
+          single_seconds / batched_seconds, single_seconds / soa_seconds);
+
+  vertex_buffer_destroy (&soa_vb);
+  vertex_buffer_destroy (&vb);
+  free (out);
+  free (vertices);
+}
+
+/*
+ * average every 2x2 block of the 32-bit src into a pixel of dst, which is
+ * half its size on each axis, two channels at a time like fb_resolve
+ */
+static void
+downsample_2x (const Framebuffer *src, Framebuffer *dst)
+{
+  for (uint32_t y = 0; y < dst->vinfo.yres; ++y)
+    {
+      const uint32_t *a
+          = (const uint32_t *)(src->back_buffer
+                               + (size_t)2 * y * src->finfo.line_length);
+      const uint32_t *b
+          = (const uint32_t *)((const uint8_t *)a + src->finfo.line_length);
+      uint32_t *out
+          = (uint32_t *)(dst->back_buffer + (size_t)y * dst->finfo.line_length);
+
+      for (uint32_t x = 0; x < dst->vinfo.xres; ++x)
+        {
+          const uint32_t s[4] = { a[2 * x], a[2 * x + 1], b[2 * x],
+                                  b[2 * x + 1] };
+          uint32_t lo = 0x00020002u;
+          uint32_t hi = 0x00020002u;
+          for (int k = 0; k < 4; ++k)
+            {
+              lo += s[k] & 0x00FF00FFu;
+              hi += (s[k] >> 8) & 0x00FF00FFu;
+            }
+          out[x] = ((lo >> 2) & 0x00FF00FFu) | (((hi >> 2) & 0x00FF00FFu) << 8);
+        }
+    }
+}
+
+/*
+ * medium triangles with 1, 2 and 4 samples per pixel, resolve included,
+ * against 4x supersampling: drawing the same scene at twice the resolution
+ * on each axis and downsampling it, which is timed as well.
+ */
+void
+bench_msaa (void)
+{
+  const int count = shape_counts[SHAPE_MEDIUM];
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * 3 * count);
+  if (!vertices)
+    return;
+
+  srand (3);
+  make_triangles (vertices, count, SHAPE_MEDIUM);
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 3 * count);
+
+  printf ("\nmultisampling, %d medium triangles, %dx%d (best of %d)\n",
+          count, FB_WIDTH, FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s\n", "mode", "ms");
+
+  const uint32_t samples[] = { 1, 2, 4 };
+  const char *names[] = { "1x", "msaa 2x", "msaa 4x" };
+
+  for (int m = 0; m < 3; ++m)
+    {
+      Framebuffer fb;
+      if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT)
+          || !fb_set_samples (&fb, samples[m]))
+        {
+          printf ("bench_msaa: framebuffer allocation failed\n");
+          break;
+        }
+
+      double best = 1e30;
+      for (int r = 0; r < REPEATS; ++r)
+        {
+          fb_clear (&fb);
+          double start = now_seconds ();
+          draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, NULL);
+          fb_resolve (&fb);
+          double elapsed = now_seconds () - start;
+          if (elapsed < best)
+            best = elapsed;
+        }
+      printf ("%-10s %10.2f\n", names[m], best * 1000.0);
+
+      fb_shutdown (&fb);
+    }
+
+  Framebuffer ssaa;
+  Framebuffer fb;
+  if (fb_init_memory (&ssaa, 2 * FB_WIDTH, 2 * FB_HEIGHT))
+    {
+      if (fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+        {
+          double best = 1e30;
+          for (int r = 0; r < REPEATS; ++r)
+            {
+              fb_clear (&ssaa);
+              double start = now_seconds ();
+              draw_vertex_buffer (&ssaa, &vb, PRIM_TRIANGLES, NULL);
+              downsample_2x (&ssaa, &fb);
+              double elapsed = now_seconds () - start;
+              if (elapsed < best)
+                best = elapsed;
+            }
+          printf ("%-10s %10.2f\n", "ssaa 4x", best * 1000.0);
+          fb_shutdown (&fb);
+        }
+      fb_shutdown (&ssaa);
+    }
+
+  vertex_buffer_destroy (&vb);
+  free (vertices);
+}
+
+/*
+ * a grid overlay of long lines in the style of the demo's ground grid,
+ * reaching well past the screen on every side so most of each line is
+ * clipped away.
+ */
+void
+bench_lines (void)
+{
+  const int lines_per_axis = 2000;
+  const int count = 2 * lines_per_axis;
+
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_lines: framebuffer allocation failed\n");
+      return;
+    }
+
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * 2 * count);
+  if (!vertices)
+    {
+      fb_shutdown (&fb);
+      return;
+    }
+
+  const float extent = 3.0f;
+  BenchVertex *v = vertices;
+  for (int i = 0; i < lines_per_axis; ++i)
+    {
+      float p = -extent + 2.0f * extent * (float)i / (lines_per_axis - 1);
+      float skew = 0.2f * p;
+
+      *v++ = (BenchVertex){ { -extent, p - skew, 0.5f }, { 1, 1, 1, 1 } };
+      *v++ = (BenchVertex){ { extent, p + skew, 0.5f }, { 1, 1, 1, 1 } };
+      *v++ = (BenchVertex){ { p + skew, -extent, 0.5f }, { 1, 0, 0, 1 } };
+      *v++ = (BenchVertex){ { p - skew, extent, 0.5f }, { 0, 0, 1, 1 } };
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 2 * count);
+
+  printf ("\nline grid, %d lines, %dx%d (best of %d)\n", count, FB_WIDTH,
+          FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s %12s\n", "mode", "ms", "Mlines/s");
+
+  const char *names[] = { "aliased", "smooth", "wide 3" };
+  for (int m = 0; m < 3; ++m)
+    {
+      DrawState state = draw_state_default ();
+      state.line_smooth = m > 0;
+      state.line_width = m == 2 ? 3.0f : 1.0f;
+
+      double best = 1e30;
+      for (int r = 0; r < REPEATS; ++r)
+        {
+          fb_clear (&fb);
+          double start = now_seconds ();
+          draw_vertex_buffer (&fb, &vb, PRIM_LINES, &state);
+          double elapsed = now_seconds () - start;
+          if (elapsed < best)
+            best = elapsed;
+        }
+
+      printf ("%-10s %10.2f %12.2f\n", names[m], best * 1000.0,
+              count / best * 1e-6);
+    }
+
+  vertex_buffer_destroy (&vb);
+  free (vertices);
+  fb_shutdown (&fb);
+}
+
+/* a random point cloud drawn as one pixel points, squares and discs */
+void
+bench_points (void)
+{
+  const int count = 2000000;
+
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_points: framebuffer allocation failed\n");
+      return;
+    }
+
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * count);
+  if (!vertices)
+    {
+      fb_shutdown (&fb);
+      return;
+    }
+
+  srand (4);
+  for (int i = 0; i < count; ++i)
+    {
+      BenchVertex *v = &vertices[i];
+      v->pos[0] = randf (-1.0f, 1.0f);
+      v->pos[1] = randf (-1.0f, 1.0f);
+      v->pos[2] = randf (-0.9f, 0.9f);
+      v->col[0] = randf (0.0f, 1.0f);
+      v->col[1] = randf (0.0f, 1.0f);
+      v->col[2] = randf (0.0f, 1.0f);
+      v->col[3] = 1.0f;
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, count);
+
+  printf ("\npoint cloud, %d points, %dx%d (best of %d)\n", count, FB_WIDTH,
+          FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s %12s\n", "sprite", "ms", "Mpoints/s");
+
+  const char *names[] = { "1 px", "square 4", "round 4" };
+  for (int m = 0; m < 3; ++m)
+    {
+      DrawState state = draw_state_default ();
+      state.point_size = m == 0 ? 1.0f : 4.0f;
+      state.point_round = m == 2;
+
+      double best = 1e30;
+      for (int r = 0; r < REPEATS; ++r)
+        {
+          fb_clear (&fb);
+          double start = now_seconds ();
+          draw_vertex_buffer (&fb, &vb, PRIM_POINTS, &state);
+          double elapsed = now_seconds () - start;
+          if (elapsed < best)
+            best = elapsed;
+        }
+
+      printf ("%-10s %10.2f %12.2f\n", names[m], best * 1000.0,
+              count / best * 1e-6);
+    }
+
+  vertex_buffer_destroy (&vb);
+  free (vertices);
+  fb_shutdown (&fb);
+}
+
+typedef struct
+{
+  float pos[3];
+  float col[4];
+  float uv[2];
+} BenchUvVertex;
+
+/* 16 x 16 checkerboard of the vertex color and white over the texcoords */
+static bool
+fragment_checker (const Fragment *frag, void *user, Color8_t *out)
+{
+  (void)user;
+  int cell = ((int)(frag->varyings[0] * 16.0f)
+              ^ (int)(frag->varyings[1] * 16.0f)) & 1;
+  uint8_t white = (uint8_t)(-cell);
+  out->r |= white;
+  out->g |= white;
+  out->b |= white;
+  return true;
+}
+
+/* fragment_checker for a batch, branch-free over every slot */
+static void
+fragment_batch_checker (FragmentBatch *batch, void *user)
+{
+  (void)user;
+  for (int k = 0; k < FRAGMENT_BATCH; ++k)
+    {
+      int cell = ((int)(batch->varyings[0][k] * 16.0f)
+                  ^ (int)(batch->varyings[1][k] * 16.0f)) & 1;
+      uint8_t white = (uint8_t)(-cell);
+      batch->color[k].r |= white;
+      batch->color[k].g |= white;
+      batch->color[k].b |= white;
+    }
+}
+
+/*
+ * the medium triangles with a procedural texture, shaded one pixel per call
+ * and a block row per call
+ */
+void
+bench_fragment_shading (void)
+{
+  const int count = shape_counts[SHAPE_MEDIUM];
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * 3 * count);
+  BenchUvVertex *textured = malloc (sizeof (BenchUvVertex) * 3 * count);
+  Framebuffer fb;
+  if (!vertices || !textured || !fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_fragment_shading: allocation failed\n");
+      free (vertices);
+      free (textured);
+      return;
+    }
+
+  srand (5);
+  make_triangles (vertices, count, SHAPE_MEDIUM);
+  for (int i = 0; i < 3 * count; ++i)
+    {
+      BenchUvVertex *v = &textured[i];
+      memcpy (v->pos, vertices[i].pos, sizeof (v->pos));
+      memcpy (v->col, vertices[i].col, sizeof (v->col));
+      v->uv[0] = (v->pos[0] + 1.0f) * 8.0f;
+      v->uv[1] = (v->pos[1] + 1.0f) * 8.0f;
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchUvVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchUvVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_TEXCOORD, offsetof (BenchUvVertex, uv), sizeof (float), 2,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 3, sizeof (BenchUvVertex));
+  VertexBuffer vb = vertex_buffer_create (textured, layout, 3 * count);
+
+  static const AttributeSemantic varyings[] = { ATTR_TEXCOORD };
+  DrawState state = draw_state_default ();
+  state.varyings = varyings;
+  state.varying_count = 1;
+
+  printf ("\nfragment shading, %d medium triangles, %dx%d (best of %d)\n",
+          count, FB_WIDTH, FB_HEIGHT, REPEATS);
+  printf ("%-10s %10s\n", "shader", "ms");
+
+  double base = time_draw (&fb, &vb, &state);
+  printf ("%-10s %10.2f\n", "none", base * 1000.0);
+
+  state.fragment_func = fragment_checker;
+  double single = time_draw (&fb, &vb, &state);
+  printf ("%-10s %10.2f\n", "per pixel", single * 1000.0);
+
+  state.fragment_func = NULL;
+  state.fragment_batch = fragment_batch_checker;
+  double batched = time_draw (&fb, &vb, &state);
+  printf ("%-10s %10.2f\n", "batched", batched * 1000.0);
+  printf ("speedup %.2fx\n", single / batched);
+
+  vertex_buffer_destroy (&vb);
+  free (textured);
+  free (vertices);
+  fb_shutdown (&fb);
+}
+
+/*
+ * a forest: a small grid mesh drawn at thousands of places spread wider
+ * than the view, once with a draw_index_buffer call and model-view-
+ * projection product per instance, once with draw_index_buffer_instanced.
+ */
+void
+bench_instancing (void)
+{
+  enum { GRID = 8, INSTANCES = 4000 };
+  const int vertex_count = (GRID + 1) * (GRID + 1);
+  const int index_count = GRID * GRID * 6;
+
+  BenchVertex *vertices = malloc (sizeof (BenchVertex) * vertex_count);
+  unsigned int *indices = malloc (sizeof (unsigned int) * index_count);
+  Mat4x4f_t *models = malloc (sizeof (Mat4x4f_t) * INSTANCES);
+  Color8_t *colors = malloc (sizeof (Color8_t) * INSTANCES);
+  Framebuffer fb;
+  if (!vertices || !indices || !models || !colors
+      || !fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    {
+      printf ("bench_instancing: allocation failed\n");
+      free (vertices);
+      free (indices);
+      free (models);
+      free (colors);
+      return;
+    }
+
+  for (int y = 0; y <= GRID; ++y)
+    for (int x = 0; x <= GRID; ++x)
+      {
+        BenchVertex *v = &vertices[y * (GRID + 1) + x];
+        v->pos[0] = ((float)x / GRID - 0.5f) * 0.2f;
+        v->pos[1] = ((float)y / GRID - 0.5f) * 0.2f;
+        v->pos[2] = 0.02f * sinf (x + y);
+        v->col[0] = (float)x / GRID;
+        v->col[1] = (float)y / GRID;
+        v->col[2] = 0.5f;
+        v->col[3] = 1.0f;
+      }
+  int n = 0;
+  for (int y = 0; y < GRID; ++y)
+    for (int x = 0; x < GRID; ++x)
+      {
+        unsigned int i = y * (GRID + 1) + x;
+        unsigned int quad[6] = { i, i + 1, i + GRID + 2,
+                                 i, i + GRID + 2, i + GRID + 1 };
+        memcpy (&indices[n], quad, sizeof (quad));
+        n += 6;
+      }
+
+  srand (9);
+  for (int i = 0; i < INSTANCES; ++i)
+    {
+      Mat4x4f_t m = mat4x4f_identity ();
+      m = mat4x4f_translate (
+          &m, (Vec3f_t){ randf (-40.0f, 40.0f), randf (-7.0f, 7.0f),
+                         randf (-30.0f, 0.0f) });
+      models[i] = mat4x4f_rotation (&m, (Vec3f_t){ 0.0f, randf (0, 3), 0.0f });
+      colors[i] = (Color8_t){ (uint8_t)rand (), (uint8_t)rand (), 255, 255 };
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (BenchVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (BenchVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (BenchVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, vertex_count);
+  IndexBuffer ib = index_buffer_create (indices, index_count);
+
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 10 },
+                                   (Vec3f_t){ 0, 0, 0 }, (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t projection = mat4x4f_perspective (1.0f, 16.0f / 9.0f, 0.1f, 50.0f);
+  Mat4x4f_t view_projection = mat4x4f_mul (&projection, &view);
+  DrawState state = draw_state_default ();
+  InstanceBuffer instances = { models, NULL, INSTANCES };
+
+  double loop_seconds = 1e30;
+  double instanced_seconds = 1e30;
+  for (int r = 0; r < REPEATS; ++r)
+    {
+      fb_clear (&fb);
+      double t0 = now_seconds ();
+      for (int i = 0; i < INSTANCES; ++i)
+        {
+          Mat4x4f_t mvp = mat4x4f_mul (&view_projection, &models[i]);
+          state.mvp = &mvp;
+          draw_index_buffer (&fb, &ib, &vb, PRIM_TRIANGLES, &state);
+        }
+      double t1 = now_seconds ();
+
+      fb_clear (&fb);
+      state.mvp = &view_projection;
+      double t2 = now_seconds ();
+      draw_index_buffer_instanced (&fb, &ib, &vb, &instances, PRIM_TRIANGLES,
+                                   &state);
+      double t3 = now_seconds ();
+
+      if (t1 - t0 < loop_seconds)
+        loop_seconds = t1 - t0;
+      if (t3 - t2 < instanced_seconds)
+        instanced_seconds = t3 - t2;
+    }
+
+  instances.colors = colors;
+  double tinted_seconds = 1e30;
+  for (int r = 0; r < REPEATS; ++r)
+    {
+      fb_clear (&fb);
+      double start = now_seconds ();
+      draw_index_buffer_instanced (&fb, &ib, &vb, &instances, PRIM_TRIANGLES,
+                                   &state);
+      double elapsed = now_seconds () - start;
+      if (elapsed < tinted_seconds)
+        tinted_seconds = elapsed;
+    }
+
+  printf ("\ninstancing, %d instances of %d triangles (best of %d)\n",
+          INSTANCES, GRID * GRID * 2, REPEATS);
+  printf ("%-10s %10s\n", "draws", "ms");
+  printf ("%-10s %10.2f\n", "per call", loop_seconds * 1000.0);
+  printf ("%-10s %10.2f\n", "instanced", instanced_seconds * 1000.0);
+  printf ("%-10s %10.2f\n", "tinted", tinted_seconds * 1000.0);
+  printf ("speedup %.2fx\n", loop_seconds / instanced_seconds);
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&vb);
+  free (colors);
+  free (models);
+  free (indices);
+  free (vertices);
+  fb_shutdown (&fb);
+}
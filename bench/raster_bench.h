@@ -0,0 +1,14 @@
+#ifndef RASTER_BENCH_H
+#define RASTER_BENCH_H
+
+void bench_triangle_shapes (void);
+void bench_dense_mesh (void);
+void bench_vertex_cache (void);
+void bench_vertex_stage (void);
+void bench_msaa (void);
+void bench_lines (void);
+void bench_points (void);
+void bench_fragment_shading (void);
+void bench_instancing (void);
+
+#endif
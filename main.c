@@ -16,7 +16,7 @@
 #define GRID_VERTEX_COUNT(half) ((((half) * 2) + 1) * 4)
 
 typedef struct {
-  Vec3f_t pos;
+  Vec4f_t pos;
   Vec4f_t col;
 } Vertex;
 
@@ -102,35 +102,6 @@ build_mvp(const MeshTransforms* t, const Camera* cam) {
   return mvp;
 }
 
-static inline void
-update_vertices(VertexBuffer* vb,
-                const Vertex* source,
-                const Mat4x4f_t* mvp)
-{
-  for (size_t i = 0; i < vb->vertex_count; ++i) {
-    Vec3f_t* pos = get_attribute_pointer(vb, i, ATTR_POSITION);
-
-    Vec4f_t v = {
-      source[i].pos.x,
-      source[i].pos.y,
-      source[i].pos.z,
-      1.0f
-    };
-
-    Vec4f_t t = mat4x4f_mul_vec4f(mvp, &v);
-
-    if (t.w != 0.0f) {
-      t.x /= t.w;
-      t.y /= t.w;
-      t.z /= t.w;
-    }
-
-    pos->x = t.x;
-    pos->y = t.y;
-    pos->z = t.z;
-  }
-}
-
 void create_grid(Vertex* vertices, float half, float step)
 {
   Vec4f_t color = { 0.4f, 0.4f, 0.4f, 1.0f };
@@ -138,11 +109,11 @@ void create_grid(Vertex* vertices, float half, float step)
   size_t v_idx = 0;
 
   for (float p = -half; p <= half; p += step) {
-    vertices[v_idx++] = (Vertex){ { -half, 0.0f, p }, color };
-    vertices[v_idx++] = (Vertex){ { +half, 0.0f, p }, color };
+    vertices[v_idx++] = (Vertex){ { -half, 0.0f, p, 1.0f }, color };
+    vertices[v_idx++] = (Vertex){ { +half, 0.0f, p, 1.0f }, color };
 
-    vertices[v_idx++] = (Vertex){ { p, 0.0f, -half }, color };
-    vertices[v_idx++] = (Vertex){ { p, 0.0f, +half }, color };
+    vertices[v_idx++] = (Vertex){ { p, 0.0f, -half, 1.0f }, color };
+    vertices[v_idx++] = (Vertex){ { p, 0.0f, +half, 1.0f }, color };
   }
 }
 
@@ -159,9 +130,9 @@ int main (void)
 
   // define triangle vertices
   const Vertex triangle_vertices[] = {
-    { .pos = {-0.5f, -0.5f, 0.0f }, .col = { 1.0f, 0.0f, 0.0f, 1.0f } },
-    { .pos = { 0.5f, -0.5f, 0.0f }, .col = { 0.0f, 1.0f, 0.0f, 1.0f } },
-    { .pos = { 0.0f,  0.5f, 0.0f }, .col = { 0.0f, 0.0f, 1.0f, 1.0f } }
+    { .pos = {-0.5f, -0.5f, 0.0f, 1.0f }, .col = { 1.0f, 0.0f, 0.0f, 1.0f } },
+    { .pos = { 0.5f, -0.5f, 0.0f, 1.0f }, .col = { 0.0f, 1.0f, 0.0f, 1.0f } },
+    { .pos = { 0.0f,  0.5f, 0.0f, 1.0f }, .col = { 0.0f, 0.0f, 1.0f, 1.0f } }
   };
 
   // define triangle indices
@@ -171,16 +142,16 @@ int main (void)
 
   const Vertex cube_vertices[] = {
     // front face
-    { .pos = { -0.5f, -0.5f,  0.5f }, .col = { 1.0f, 0.0f, 0.0f, 1.0f } }, // 0
-    { .pos = {  0.5f, -0.5f,  0.5f }, .col = { 1.0f, 1.0f, 0.0f, 1.0f } }, // 1
-    { .pos = {  0.5f,  0.5f,  0.5f }, .col = { 0.0f, 1.0f, 0.0f, 1.0f } }, // 2
-    { .pos = { -0.5f,  0.5f,  0.5f }, .col = { 0.0f, 1.0f, 1.0f, 1.0f } }, // 3
+    { .pos = { -0.5f, -0.5f,  0.5f, 1.0f }, .col = { 1.0f, 0.0f, 0.0f, 1.0f } }, // 0
+    { .pos = {  0.5f, -0.5f,  0.5f, 1.0f }, .col = { 1.0f, 1.0f, 0.0f, 1.0f } }, // 1
+    { .pos = {  0.5f,  0.5f,  0.5f, 1.0f }, .col = { 0.0f, 1.0f, 0.0f, 1.0f } }, // 2
+    { .pos = { -0.5f,  0.5f,  0.5f, 1.0f }, .col = { 0.0f, 1.0f, 1.0f, 1.0f } }, // 3
 
     // back face
-    { .pos = { -0.5f, -0.5f, -0.5f }, .col = { 1.0f, 0.0f, 1.0f, 1.0f } }, // 4
-    { .pos = {  0.5f, -0.5f, -0.5f }, .col = { 1.0f, 0.5f, 0.0f, 1.0f } }, // 5
-    { .pos = {  0.5f,  0.5f, -0.5f }, .col = { 0.0f, 0.5f, 1.0f, 1.0f } }, // 6
-    { .pos = { -0.5f,  0.5f, -0.5f }, .col = { 0.5f, 0.0f, 1.0f, 1.0f } }  // 7
+    { .pos = { -0.5f, -0.5f, -0.5f, 1.0f }, .col = { 1.0f, 0.0f, 1.0f, 1.0f } }, // 4
+    { .pos = {  0.5f, -0.5f, -0.5f, 1.0f }, .col = { 1.0f, 0.5f, 0.0f, 1.0f } }, // 5
+    { .pos = {  0.5f,  0.5f, -0.5f, 1.0f }, .col = { 0.0f, 0.5f, 1.0f, 1.0f } }, // 6
+    { .pos = { -0.5f,  0.5f, -0.5f, 1.0f }, .col = { 0.5f, 0.0f, 1.0f, 1.0f } }  // 7
   };
 
   const unsigned int cube_indices[] = {
@@ -211,8 +182,8 @@ int main (void)
 
   // define attributes
   VertexAttribute attributes[] = {
-    { ATTR_POSITION, offsetof(Vertex, pos), sizeof(float), 3 },
-    { ATTR_COLOR,    offsetof(Vertex, col), sizeof(float), 4 }
+    { ATTR_POSITION, offsetof(Vertex, pos), sizeof(float), 4, ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR,    offsetof(Vertex, col), sizeof(float), 4, ATTR_FORMAT_FLOAT32 }
   };
 
   // define triangle
@@ -280,6 +251,13 @@ int main (void)
     .rotate_speed = 0.03f
   };
 
+  // the cube winds counter-clockwise seen from outside, skip its hidden faces
+  DrawState cube_state = draw_state_default();
+  cube_state.cull_mode = CULL_BACK;
+
+  // meshes keep their object-space vertices, the draws transform them
+  DrawState grid_state = draw_state_default();
+
   // control main loop
   bool running = true;
 
@@ -311,25 +289,13 @@ int main (void)
     // create grid mvp
     Mat4x4f_t grid_mvp = build_mvp(&grid.transforms, &camera);
 
-    // update triangle vertices
-    // update_vertices(&triangle.geometry.vertexBuffer,
-    //                 triangle_vertices,
-    //                 &triangle_mvp);
-
-    // update cube vertices
-    update_vertices(&cube.geometry.vertexBuffer,
-                    cube_vertices,
-                    &cube_mvp);
-
-    // update grid vertices
-    update_vertices(&grid.geometry.vertexBuffer,
-                    grid_vertices,
-                    &grid_mvp);
+    cube_state.mvp = &cube_mvp;
+    grid_state.mvp = &grid_mvp;
 
     fb_clear(&fb);
-    // draw_index_buffer(&fb, &triangle.geometry.indexBuffer, &triangle.geometry.vertexBuffer, PRIM_TRIANGLES);
-    draw_vertex_buffer(&fb, &grid.geometry.vertexBuffer, PRIM_LINES);
-    draw_index_buffer(&fb, &cube.geometry.indexBuffer, &cube.geometry.vertexBuffer, PRIM_TRIANGLES);
+    // draw_index_buffer(&fb, &triangle.geometry.indexBuffer, &triangle.geometry.vertexBuffer, PRIM_TRIANGLES, NULL);
+    draw_vertex_buffer(&fb, &grid.geometry.vertexBuffer, PRIM_LINES, &grid_state);
+    draw_index_buffer(&fb, &cube.geometry.indexBuffer, &cube.geometry.vertexBuffer, PRIM_TRIANGLES, &cube_state);
     fb_present(&fb);
 
     // update angle
@@ -2,6 +2,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* the common layout attributes matches, judged by position and color alone */
+static VertexFormat
+vertex_format_match (const VertexLayout *layout)
+{
+  uint32_t position = layout->components[ATTR_POSITION];
+  uint32_t color    = layout->components[ATTR_COLOR];
+
+  if (layout->formats[ATTR_POSITION] != ATTR_FORMAT_FLOAT32
+      || layout->formats[ATTR_COLOR] != ATTR_FORMAT_FLOAT32
+      || layout->type_sizes[ATTR_POSITION] != sizeof (float)
+      || layout->type_sizes[ATTR_COLOR] != sizeof (float))
+    return VERTEX_FORMAT_GENERIC;
+
+  if (color != 4)
+    return VERTEX_FORMAT_GENERIC;
+  if (position == 3)
+    return VERTEX_FORMAT_P3F_C4F;
+  if (position == 4)
+    return VERTEX_FORMAT_P4F_C4F;
+  return VERTEX_FORMAT_GENERIC;
+}
+
 VertexLayout
 vertex_layout_create (const VertexAttribute *attributes,
                       uint32_t attribute_count,
@@ -29,6 +51,23 @@ vertex_layout_create (const VertexAttribute *attributes,
       layout.attributes = NULL;
     }
 
+  /* resolve semantics now, so fetching a vertex never searches */
+  for (uint32_t i = layout.attribute_count; i-- > 0;)
+    {
+      const VertexAttribute *attr = &layout.attributes[i];
+      if ((uint32_t)attr->semantic >= ATTR_SEMANTIC_COUNT)
+        continue;
+      layout.offsets[attr->semantic]    = attr->offset;
+      layout.components[attr->semantic] = attr->component_count;
+      layout.formats[attr->semantic]    = attr->format;
+      /* float32 keeps its given size, the others have theirs fixed */
+      layout.type_sizes[attr->semantic]
+          = attr->format == ATTR_FORMAT_FLOAT32
+                ? attr->type_size
+                : attribute_format_size (attr->format);
+    }
+  layout.format = vertex_format_match (&layout);
+
   return layout;
 }
 
@@ -38,9 +77,69 @@ vertex_layout_destroy (VertexLayout *layout)
   if (layout && layout->attributes)
     {
       free (layout->attributes);
-      layout->attributes      = NULL;
-      layout->attribute_count = 0;
-      layout->vertex_stride   = 0;
+      *layout = (VertexLayout){ 0 };
+    }
+}
+
+/*
+ * place the component arrays of a SoA buffer with room for capacity
+ * vertices, one after the other, and return the bytes they take
+ */
+static size_t
+soa_streams_place (VertexBuffer *buffer, uint32_t capacity)
+{
+  const VertexLayout *layout = &buffer->layout;
+  size_t total = 0;
+
+  for (uint32_t s = 0; s < ATTR_SEMANTIC_COUNT; ++s)
+    {
+      size_t bytes = (size_t)capacity * layout->type_sizes[s];
+      size_t pitch = (bytes + VERTEX_STREAM_ALIGN - 1)
+                     & ~(size_t)(VERTEX_STREAM_ALIGN - 1);
+
+      buffer->streams[s]      = total;
+      buffer->stream_pitch[s] = pitch;
+      total += pitch * attribute_format_elements (layout->formats[s],
+                                                  layout->components[s]);
+    }
+
+  buffer->capacity = capacity;
+  return total;
+}
+
+/* allocate zeroed SoA arrays for capacity vertices, NULL on failure */
+static void *
+soa_alloc (VertexBuffer *buffer, uint32_t capacity, size_t *size)
+{
+  void *data = NULL;
+  *size = soa_streams_place (buffer, capacity);
+  if (posix_memalign (&data, VERTEX_STREAM_ALIGN, *size ? *size : 1))
+    return NULL;
+  memset (data, 0, *size);
+  return data;
+}
+
+/* split count interleaved vertices at data into the arrays of buffer */
+static void
+soa_scatter (VertexBuffer *buffer, const void *data, uint32_t count)
+{
+  const VertexLayout *layout = &buffer->layout;
+  const uint8_t *src = data;
+  uint8_t *dst = buffer->data;
+
+  for (uint32_t s = 0; s < ATTR_SEMANTIC_COUNT; ++s)
+    {
+      uint32_t type_size = layout->type_sizes[s];
+      uint32_t elements  = attribute_format_elements (layout->formats[s],
+                                                      layout->components[s]);
+      for (uint32_t c = 0; c < elements; ++c)
+        {
+          const uint8_t *in = src + layout->offsets[s] + c * type_size;
+          uint8_t *out = dst + buffer->streams[s] + c * buffer->stream_pitch[s];
+          for (uint32_t i = 0; i < count; ++i)
+            memcpy (out + (size_t)i * type_size,
+                    in + (size_t)i * layout->vertex_stride, type_size);
+        }
     }
 }
 
@@ -52,6 +151,22 @@ vertex_buffer_create (const void *data,
   VertexBuffer buffer = { 0 };
   buffer.vertex_count = vertex_count;
   buffer.layout       = layout;
+
+  if (layout.storage == VERTEX_STORAGE_SOA)
+    {
+      buffer.data = soa_alloc (&buffer, vertex_count, &buffer.size);
+      if (!buffer.data)
+        {
+          buffer.size = 0;
+          buffer.vertex_count = 0;
+          buffer.capacity = 0;
+          return buffer;
+        }
+      if (data)
+        soa_scatter (&buffer, data, vertex_count);
+      return buffer;
+    }
+
   buffer.size         = (size_t)vertex_count * layout.vertex_stride;
   buffer.data         = malloc (buffer.size);
 
@@ -83,6 +198,7 @@ vertex_buffer_destroy (VertexBuffer *buffer)
       buffer->data          = NULL;
       buffer->size          = 0;
       buffer->vertex_count  = 0;
+      buffer->capacity      = 0;
       vertex_layout_destroy (&buffer->layout);
     }
 }
@@ -95,6 +211,33 @@ vertex_buffer_update (VertexBuffer *buffer,
   if (size == 0 || !buffer || !data)
     return;
 
+  if (buffer->layout.storage == VERTEX_STORAGE_SOA)
+    {
+      if (buffer->layout.vertex_stride == 0)
+        return;
+
+      uint32_t count = (uint32_t)(size / buffer->layout.vertex_stride);
+      if (count > buffer->capacity)
+        {
+          VertexBuffer grown = *buffer;
+          size_t grown_size;
+          grown.data = soa_alloc (&grown, count, &grown_size);
+          if (!grown.data)
+            return;
+          free (buffer->data);
+          *buffer      = grown;
+          buffer->size = grown_size;
+        }
+      else
+        {
+          memset (buffer->data, 0, buffer->size);
+        }
+
+      soa_scatter (buffer, data, count);
+      buffer->vertex_count = count;
+      return;
+    }
+
   if (size > buffer->size)
     {
       void *new_data  = realloc (buffer->data, size);
@@ -126,17 +269,40 @@ get_attribute_pointer (const VertexBuffer *buffer,
       return NULL;
     }
 
-  for (uint32_t i = 0; i < buffer->layout.attribute_count; ++i)
+  if ((uint32_t)semantic >= ATTR_SEMANTIC_COUNT
+      || !buffer->layout.components[semantic])
     {
-      VertexAttribute *attr = &buffer->layout.attributes[i];
-      if (attr->semantic == semantic)
-        {
-          uint8_t *base = (uint8_t *)buffer->data;
-          return base + (vertex_index * buffer->layout.vertex_stride)
-                 + attr->offset;
-        }
+      return NULL;
+    }
+
+  uint8_t *base = (uint8_t *)buffer->data;
+  if (buffer->layout.storage == VERTEX_STORAGE_SOA)
+    {
+      return base + buffer->streams[semantic]
+             + (size_t)vertex_index * buffer->layout.type_sizes[semantic];
     }
-  return NULL;
+
+  return base + ((size_t)vertex_index * buffer->layout.vertex_stride)
+         + buffer->layout.offsets[semantic];
+}
+
+void *
+vertex_buffer_stream (const VertexBuffer *buffer,
+                      AttributeSemantic semantic,
+                      uint32_t component)
+{
+  if (!buffer || !buffer->data
+      || buffer->layout.storage != VERTEX_STORAGE_SOA
+      || (uint32_t)semantic >= ATTR_SEMANTIC_COUNT
+      || component >= attribute_format_elements (
+             buffer->layout.formats[semantic],
+             buffer->layout.components[semantic]))
+    {
+      return NULL;
+    }
+
+  return (uint8_t *)buffer->data + buffer->streams[semantic]
+         + component * buffer->stream_pitch[semantic];
 }
 
 IndexBuffer
@@ -6,6 +6,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "graphics/format.h"
+
 /**
  * @enum  AttributeSemantic
  * @brief Enum specifying the semantic meaning of a vertex attribute.
@@ -16,8 +18,34 @@ typedef enum
   ATTR_COLOR,     /**< Vertex color attribute */
   ATTR_NORMAL,    /**< Vertex normal vector attribute */
   ATTR_TEXCOORD,  /**< Vertex texture coordinate attribute */
+  ATTR_POINT_SIZE,/**< Point size in pixels, used by PRIM_POINTS */
+  ATTR_SEMANTIC_COUNT /**< Number of semantics, not a semantic itself */
 } AttributeSemantic;
 
+/**
+ * @enum  VertexFormat
+ * @brief Common vertex layouts that get a fetch of their own.
+ */
+typedef enum
+{
+  VERTEX_FORMAT_GENERIC,  /**< Any other layout */
+  VERTEX_FORMAT_P3F_C4F,  /**< 3 float position, 4 float color */
+  VERTEX_FORMAT_P4F_C4F,  /**< 4 float clip-space position, 4 float color */
+} VertexFormat;
+
+/**
+ * @enum  VertexStorage
+ * @brief How a vertex buffer keeps its vertices in memory.
+ */
+typedef enum
+{
+  VERTEX_STORAGE_INTERLEAVED, /**< One struct per vertex, as the layout describes */
+  VERTEX_STORAGE_SOA,         /**< One aligned array per attribute component */
+} VertexStorage;
+
+/** Alignment in bytes of every array of a VERTEX_STORAGE_SOA buffer */
+#define VERTEX_STREAM_ALIGN 32
+
 /**
  * @struct  IndexBuffer
  * @brief   Stores an array of indices used for indexed drawing.
@@ -38,22 +66,40 @@ typedef struct
   uint32_t          offset;                 /**< Byte offset from start of vertex */
   uint32_t          type_size;              /**< Size in bytes of the attribute data type */
   uint32_t          component_count;        /**< Number of components */
+  AttributeFormat   format;                 /**< Encoding of the components, 0 is float32 */
 } VertexAttribute;
 
 /**
  * @struct  VertexLayout
  * @brief   Describes the memory layout of a single vertex, including all attributes.
+ *
+ * vertex_layout_create resolves every semantic to its offset and component
+ * count once, so looking an attribute up is a table read. A semantic with 0
+ * components is not in the layout.
  */
 typedef struct
 {
   VertexAttribute *attributes;      /**< Pointer to array of vertex attributes */
   uint32_t         attribute_count; /**< Number of attributes in the array */
   uint32_t         vertex_stride;   /**< Total size in bytes of one vertex */
+  uint32_t         offsets[ATTR_SEMANTIC_COUNT];    /**< Byte offset of each semantic */
+  uint32_t         components[ATTR_SEMANTIC_COUNT]; /**< Components of each semantic, 0 if absent */
+  uint32_t         type_sizes[ATTR_SEMANTIC_COUNT]; /**< Bytes per stored element of each semantic */
+  AttributeFormat  formats[ATTR_SEMANTIC_COUNT];    /**< Encoding of each semantic */
+  VertexFormat     format;          /**< Common layout this one matches, if any */
+  VertexStorage    storage;         /**< Storage of buffers created with this layout */
 } VertexLayout;
 
 /**
  * @struct  VertexBuffer
  * @brief   Stores vertex data and its layout for rendering or processing.
+ *
+ * With VERTEX_STORAGE_SOA every component of every semantic in the layout
+ * is an array of its own inside data: component c of vertex i of semantic
+ * s is at streams[s] + c * stream_pitch[s] + i * type_sizes[s] bytes.
+ * Packed formats keep their word whole, in a single array. The
+ * arrays start VERTEX_STREAM_ALIGN aligned, so SIMD code can load x, y and
+ * z of consecutive vertices directly.
  */
 typedef struct
 {
@@ -62,6 +108,9 @@ typedef struct
   uint32_t      vertex_count;      /**< Number of vertices stored */
   VertexLayout  layout;            /**< Layout describing the vertex format */
   IndexBuffer  *indices;
+  uint32_t      capacity;          /**< SoA: vertices the arrays have room for */
+  size_t        streams[ATTR_SEMANTIC_COUNT];      /**< SoA: byte offset of each semantic's first array */
+  size_t        stream_pitch[ATTR_SEMANTIC_COUNT]; /**< SoA: bytes from one component's array to the next */
 } VertexBuffer;
 
 /**
@@ -71,6 +120,8 @@ typedef struct
  * @param attribute_count Number of attributes in the array.
  * @param vertex_stride   Total size in bytes of a single vertex.
  *
+ * If a semantic appears more than once, its first attribute is used.
+ *
  * @return A VertexLayout struct with copied attributes and stride set.
  */
 VertexLayout vertex_layout_create (const VertexAttribute *attributes,
@@ -91,6 +142,10 @@ void vertex_layout_destroy (VertexLayout *layout);
  * If data is provided, copies the data into the buffer. If data is NULL,
  * the buffer is zero-initialized.
  *
+ * data is always interleaved as the layout describes. A layout with
+ * VERTEX_STORAGE_SOA storage has it split into one array per component,
+ * keeping the first attribute of each semantic only.
+ *
  * @param data          Pointer to vertex data to copy, or NULL.
  * @param layout        Vertex layout describing the buffer’s vertex format.
  * @param vertex_count  Number of vertices in the buffer.
@@ -117,6 +172,7 @@ void vertex_buffer_destroy (VertexBuffer *buffer);
  * leftover bytes are zeroed out.
  *
  * The vertex count is updated based on the new data size and layout stride.
+ * As with vertex_buffer_create, data is interleaved even for SoA buffers.
  *
  * @param buffer  Pointer to the VertexBuffer to update.
  * @param data    Pointer to source data.
@@ -129,8 +185,9 @@ void vertex_buffer_update (VertexBuffer *buffer,
 /**
  * @brief Get a pointer to a specific attribute of a specific vertex.
  *
- * Searches the buffer’s layout for the attribute semantic and returns
- * a pointer to that attribute’s data for the given vertex index.
+ * Looks the attribute semantic up in the buffer’s layout and returns
+ * a pointer to that attribute’s data for the given vertex index. For SoA
+ * buffers this is the first component only, see vertex_buffer_stream.
  *
  * @param buffer        Pointer to the VertexBuffer.
  * @param vertex_index  Index of the vertex (0-based).
@@ -143,6 +200,22 @@ void *get_attribute_pointer (const VertexBuffer *buffer,
                              uint32_t vertex_index,
                              AttributeSemantic semantic);
 
+/**
+ * @brief Get the array of one attribute component of a SoA buffer.
+ *
+ * @param buffer    Pointer to a VertexBuffer with VERTEX_STORAGE_SOA storage.
+ * @param semantic  The attribute semantic.
+ * @param component The component, 0 for x.
+ *
+ * @return The component's vertex_count values, VERTEX_STREAM_ALIGN aligned,
+ *         or NULL if the buffer is interleaved or lacks the component. The
+ *         values are in the attribute's format, packed formats have only
+ *         component 0, holding the whole words.
+ */
+void *vertex_buffer_stream (const VertexBuffer *buffer,
+                            AttributeSemantic semantic,
+                            uint32_t component);
+
 /**
  * @brief Create an index buffer and initialize its data.
  *
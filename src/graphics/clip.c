@@ -0,0 +1,159 @@
+#include "graphics/clip.h"
+#include <string.h>
+
+/*
+ * signed distance of p to plane i, scaled by w; >= 0 is inside. the side
+ * planes are moved out to band times the frustum's extent.
+ */
+static inline float
+clip_distance (const float *p, uint32_t i, float band)
+{
+  switch (i)
+    {
+    case 0:
+      return band * p[3] + p[0];
+    case 1:
+      return band * p[3] - p[0];
+    case 2:
+      return band * p[3] + p[1];
+    case 3:
+      return band * p[3] - p[1];
+    case 4:
+      return p[3] + p[2];
+    default:
+      return p[3] - p[2];
+    }
+}
+
+/* out = a + (b - a) * t for every interpolated value */
+static inline void
+clip_lerp (const ClipVertex *a, const ClipVertex *b, float t, ClipVertex *out)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+      out->pos[i] = a->pos[i] + (b->pos[i] - a->pos[i]) * t;
+      out->color[i] = a->color[i] + (b->color[i] - a->color[i]) * t;
+    }
+  for (int i = 0; i < CLIP_MAX_VARYINGS; ++i)
+    out->varyings[i] = a->varyings[i] + (b->varyings[i] - a->varyings[i]) * t;
+}
+
+uint32_t
+clip_outcode (const ClipVertex *v, uint32_t planes, float band)
+{
+  uint32_t code = 0;
+  for (uint32_t i = 0; i < 6; ++i)
+    {
+      if ((planes & (1u << i)) && clip_distance (v->pos, i, band) < 0.0f)
+        code |= 1u << i;
+    }
+  return code;
+}
+
+uint32_t
+clip_triangle (const ClipVertex in[3], uint32_t planes, float band,
+               ClipVertex out[CLIP_MAX_VERTICES])
+{
+  uint32_t c0 = clip_outcode (&in[0], planes, band);
+  uint32_t c1 = clip_outcode (&in[1], planes, band);
+  uint32_t c2 = clip_outcode (&in[2], planes, band);
+
+  /* all vertices outside the same plane */
+  if (c0 & c1 & c2)
+    return 0;
+
+  memcpy (out, in, 3 * sizeof (ClipVertex));
+  uint32_t crossed = c0 | c1 | c2;
+  if (!crossed)
+    return 3;
+
+  /* ping-pong between out and tmp, one crossed plane at a time */
+  ClipVertex tmp[CLIP_MAX_VERTICES];
+  ClipVertex *src = out;
+  ClipVertex *dst = tmp;
+  uint32_t count = 3;
+
+  for (uint32_t i = 0; i < 6 && count; ++i)
+    {
+      if (!(crossed & (1u << i)))
+        continue;
+
+      uint32_t n = 0;
+      const ClipVertex *a = &src[count - 1];
+      float da = clip_distance (a->pos, i, band);
+
+      for (uint32_t k = 0; k < count; ++k)
+        {
+          const ClipVertex *b = &src[k];
+          float db = clip_distance (b->pos, i, band);
+
+          if ((da >= 0.0f) != (db >= 0.0f))
+            {
+              /* split from the inside end so shared edges split alike */
+              if (da >= 0.0f)
+                clip_lerp (a, b, da / (da - db), &dst[n++]);
+              else
+                clip_lerp (b, a, db / (db - da), &dst[n++]);
+            }
+          if (db >= 0.0f)
+            dst[n++] = *b;
+
+          a = b;
+          da = db;
+        }
+
+      ClipVertex *swap = src;
+      src = dst;
+      dst = swap;
+      count = n;
+    }
+
+  if (src != out)
+    memcpy (out, src, count * sizeof (ClipVertex));
+
+  /* clipping at a vertex can leave too little for a triangle */
+  return count >= 3 ? count : 0;
+}
+
+bool
+clip_line (ClipVertex *a, ClipVertex *b, uint32_t planes, float band)
+{
+  uint32_t ca = clip_outcode (a, planes, band);
+  uint32_t cb = clip_outcode (b, planes, band);
+
+  if (ca & cb)
+    return false;
+  if (!(ca | cb))
+    return true;
+
+  /* parametric range of the segment left inside every crossed plane */
+  float t0 = 0.0f;
+  float t1 = 1.0f;
+  uint32_t crossed = ca | cb;
+
+  for (uint32_t i = 0; i < 6; ++i)
+    {
+      if (!(crossed & (1u << i)))
+        continue;
+
+      float da = clip_distance (a->pos, i, band);
+      float db = clip_distance (b->pos, i, band);
+      float t = da / (da - db);
+
+      if (da < 0.0f)
+        t0 = t > t0 ? t : t0;
+      else
+        t1 = t < t1 ? t : t1;
+    }
+
+  if (t0 > t1)
+    return false;
+
+  ClipVertex a0 = *a;
+  ClipVertex b0 = *b;
+  if (ca)
+    clip_lerp (&a0, &b0, t0, a);
+  if (cb)
+    clip_lerp (&a0, &b0, t1, b);
+  return true;
+}
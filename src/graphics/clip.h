@@ -0,0 +1,87 @@
+#ifndef CLIP_H
+#define CLIP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* clip-space frustum planes, one outcode bit each */
+#define CLIP_LEFT   (1u << 0) /* x >= -w */
+#define CLIP_RIGHT  (1u << 1) /* x <= w */
+#define CLIP_BOTTOM (1u << 2) /* y >= -w */
+#define CLIP_TOP    (1u << 3) /* y <= w */
+#define CLIP_NEAR   (1u << 4) /* z >= -w */
+#define CLIP_FAR    (1u << 5) /* z <= w */
+
+#define CLIP_NEAR_FAR (CLIP_NEAR | CLIP_FAR)
+#define CLIP_ALL      0x3Fu
+
+/* most vertices a triangle can have after clipping against all six planes */
+#define CLIP_MAX_VERTICES 9
+
+/* most floats of generic attributes a vertex carries through the pipeline */
+#define CLIP_MAX_VARYINGS 8
+
+/*
+ * the band argument below moves the side planes out to x = +-band * w and
+ * y = +-band * w, for clipping against a guard band around the viewport.
+ * a band of 1 is the view frustum itself.
+ */
+
+/**
+ * @struct ClipVertex
+ * @brief A vertex in clip space with the attributes the clipper interpolates.
+ *
+ * Attributes are interpolated linearly in clip space, which is what the
+ * perspective-correct interpolation after the divide expects.
+ */
+typedef struct
+{
+  float pos[4];   /**< Clip-space x, y, z, w */
+  float color[4]; /**< RGBA in [0, 1] */
+  float varyings[CLIP_MAX_VARYINGS]; /**< Generic attributes, unused ones 0 */
+} ClipVertex;
+
+/**
+ * @brief Get the planes a vertex lies outside of.
+ *
+ * @param v      Vertex to classify.
+ * @param planes CLIP_* planes to test.
+ * @param band   Side plane extent, 1 for the view frustum.
+ * @return The subset of planes v is outside of, 0 if inside all of them.
+ */
+uint32_t
+clip_outcode (const ClipVertex *v, uint32_t planes, float band);
+
+/**
+ * @brief Clip a triangle against the frustum (Sutherland-Hodgman).
+ *
+ * Only the planes crossed by the triangle are clipped against, so triangles
+ * inside all of them are copied through as they are. The result is a
+ * convex polygon in the winding of the input, to be drawn as a fan.
+ *
+ * An edge crossing a plane is always split from its inside vertex, so the
+ * triangles on both sides of a shared edge get the same new vertex.
+ *
+ * @param in     Triangle vertices.
+ * @param planes CLIP_* planes to clip against.
+ * @param band   Side plane extent, 1 for the view frustum.
+ * @param out    Receives the clipped polygon.
+ * @return Number of vertices in out, 0 if the triangle is entirely outside.
+ */
+uint32_t
+clip_triangle (const ClipVertex in[3], uint32_t planes, float band,
+               ClipVertex out[CLIP_MAX_VERTICES]);
+
+/**
+ * @brief Clip a line segment against the frustum.
+ *
+ * @param a      First endpoint, moved onto the boundary if outside.
+ * @param b      Second endpoint, moved onto the boundary if outside.
+ * @param planes CLIP_* planes to clip against.
+ * @param band   Side plane extent, 1 for the view frustum.
+ * @return False if the segment is entirely outside.
+ */
+bool
+clip_line (ClipVertex *a, ClipVertex *b, uint32_t planes, float band);
+
+#endif /* CLIP_H */
@@ -1,35 +1,346 @@
 #include "graphics/draw.h"
-#include "algorithm/bresenham.h"
+#include "graphics/vertex.h"
 #include "math/utils.h"
+#include "utils/bit.h"
+#include <float.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-/* 16.16 fixed-point format */
-#define FIXED_SHIFT 8
+/* 16.16 fixed-point format, line colors are stepped in it */
+#define FIXED_SHIFT 16
 #define FIXED_ONE (1 << FIXED_SHIFT)
-#define TO_FIXED(x) ((x) << FIXED_SHIFT)
-#define FIXED_MUL(a, b) (((int64_t)(a) * (b)) >> FIXED_SHIFT)
-#define FIXED_DIV(a, b) (((int64_t)(a) << FIXED_SHIFT) / (b))
+
+/* coverage lines evaluate this many pixels of a row or column at a time */
+#define LINE_BATCH 64
+
+/* line depths are stepped in 32.32 fixed point */
+#define LINE_DEPTH_SHIFT 32
+#define LINE_DEPTH_ONE ((double)((int64_t)1 << LINE_DEPTH_SHIFT))
+
+/* hierarchical triangle traversal, tiles are split into blocks (powers of 2) */
+#define TILE_SIZE 32
+#define BLOCK_SIZE 8
+
+/* blocks double as hierarchical z-buffer tiles */
+#if BLOCK_SIZE != FB_HIZ_TILE_SIZE
+#error "BLOCK_SIZE must match FB_HIZ_TILE_SIZE"
+#endif
+
+/* bounding boxes covering at most this many Hi-Z tiles are tested whole */
+#define HIZ_TRIANGLE_TEST_TILES 16
+
+/* a Hi-Z tile is recomputed after this many depths were stored into it */
+#define HIZ_REFRESH_WRITES (FB_HIZ_TILE_SIZE * FB_HIZ_TILE_SIZE)
+
+/*
+ * RASTER_PATH_AUTO walks spans instead of blocks for slivers: triangles at
+ * most SPAN_MAX_WIDTH pixels across their longest edge whose bounds are at
+ * least SPAN_MIN_ROWS tall. blocks along a sliver are all partly covered,
+ * while anything wider, long diagonal wedges included, walks blocks as fast.
+ */
+#define SPAN_MAX_WIDTH 4
+#define SPAN_MIN_ROWS 16
+
+/*
+ * RASTER_PATH_AUTO sends triangles narrower and shorter than this many
+ * pixels to the small triangle path, which covers at most one
+ * SMALL_TRIANGLE_SIZE square block and so fits a 64-bit coverage mask.
+ */
+#define SMALL_TRIANGLE_SIZE 8
+
+/* a row of the small triangle block is handed to fragment_batch whole */
+#if SMALL_TRIANGLE_SIZE > FRAGMENT_BATCH
+#error "SMALL_TRIANGLE_SIZE must not exceed FRAGMENT_BATCH"
+#endif
+
+/*
+ * largest vertex coordinate in pixels the rasterizer accepts. it keeps 28.4
+ * positions inside 32 bits and the edge function products inside 64 bits.
+ */
+#define RASTER_COORD_LIMIT (1 << 22)
+
+/*
+ * clip-space triangles whose vertices project within this many pixels of
+ * the origin are rasterized unclipped. it is well below RASTER_COORD_LIMIT
+ * so the float to 28.4 conversion of the vertices stays exact.
+ */
+#define GUARD_BAND_LIMIT (1 << 16)
+
+/*
+ * multisample positions in 1/SUBPIXEL_ONE pixel units from the pixel
+ * center, rotated grids so that near-horizontal and near-vertical edges
+ * still see every sample at a different offset
+ */
+static const Vec2i_t sample_offsets_2x[2] = { { 4, 4 }, { -4, -4 } };
+static const Vec2i_t sample_offsets_4x[4] = {
+  { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 }
+};
+
+/* state used when a draw call passes none and by the single-primitive draws */
+static const DrawState default_state = {
+  .depth_func  = DEPTH_LESS,
+  .depth_write = true,
+  .color_write = true,
+  .raster_path = RASTER_PATH_AUTO,
+  .cull_mode   = CULL_NONE,
+  .front_face  = FRONT_FACE_CCW,
+  .conservative = CONSERVATIVE_OFF,
+  .fill_mode   = FILL_SOLID,
+  .wire_color  = { 255, 255, 255, 255 },
+  .wire_width  = 1.0f,
+  .mvp         = NULL,
+  .clip_planes = CLIP_ALL,
+  .stats       = NULL,
+  .line_width  = 1.0f,
+  .line_smooth = false,
+  .point_size  = 1.0f,
+  .point_round = false,
+  .varyings    = NULL,
+  .varying_count = 0,
+  .fragment_func = NULL,
+  .fragment_batch = NULL,
+  .fragment_data = NULL,
+};
+
+/* varyings of the vertices of one primitive, for state->fragment_func */
+typedef struct
+{
+  const float *v[3]; /* per vertex, in the primitive's order */
+  uint32_t     count; /* floats per vertex */
+} PrimVaryings;
+
+/* pixels of state are colored by a fragment function */
+static inline bool
+fragment_stage (const DrawState *state)
+{
+  return state->fragment_func || state->fragment_batch;
+}
+
+static bool write_fragment (Framebuffer *fb, const DrawState *state,
+                            Pixel_t p);
+static void raster_points (Framebuffer *fb, const DrawState *state,
+                           const VertexBuffer *vb, const unsigned int *indices,
+                           size_t count);
+static void raster_line (Framebuffer *fb, const DrawState *state, Pixel_t p0,
+                         Pixel_t p1, const PrimVaryings *var);
+
+/* triangle rasterizer functions of a pipeline variant, see below */
+typedef struct RasterVariant RasterVariant;
+
+static const RasterVariant *raster_variant_select (const Framebuffer *fb,
+                                                   const DrawState *state);
+static void raster_triangle (Framebuffer *fb, const DrawState *state,
+                             Pixel_t v0, Pixel_t v1, Pixel_t v2,
+                             const PrimVaryings *var,
+                             const RasterVariant *raster);
 
 /**
  * Convert normalized device coordinates (NDC) in [-1, 1] range to framebuffer
  * pixel coordinates.
  *
  * NDC's x and y are mapped to framebuffer resolution with origin at top-left.
+ * The result keeps SUBPIXEL_BITS of fraction (28.4 fixed point) and is
+ * rounded to the nearest sub-pixel step, so pixel centers sit at +0.5.
  *
  * @param fb  Pointer to the framebuffer with resolution info.
  * @param pos Pointer to 2D or 3D position in NDC space.
- * @return Coordinates as Vec2i_t corresponding to framebuffer pixels.
+ * @return Fixed-point coordinates corresponding to framebuffer pixels.
  */
 static inline Vec2i_t
 ndc_to_framebuffer_coords (const Framebuffer *fb, const float *pos)
 {
+  float x = (+pos[0] * 0.5f + 0.5f) * fb->vinfo.xres;
+  float y = (-pos[1] * 0.5f + 0.5f) * fb->vinfo.yres;
+
+  /* keep far away vertices in fixed-point range */
+  x = clampf (x, -RASTER_COORD_LIMIT, RASTER_COORD_LIMIT);
+  y = clampf (y, -RASTER_COORD_LIMIT, RASTER_COORD_LIMIT);
+
   return (Vec2i_t){
-    .x = (int)((+pos[0] * 0.5f + 0.5f) * fb->vinfo.xres),
-    .y = (int)((-pos[1] * 0.5f + 0.5f) * fb->vinfo.yres),
+    .x = math_floorf_to_int (x * SUBPIXEL_ONE + 0.5f),
+    .y = math_floorf_to_int (y * SUBPIXEL_ONE + 0.5f),
   };
 }
 
+/*
+ * first byte of attribute semantic of vertex index of vb, which the caller
+ * has bounds checked. for SoA buffers only its first component follows.
+ */
+static inline const uint8_t *
+attribute_address (const VertexBuffer *vb, AttributeSemantic semantic,
+                   uint32_t index)
+{
+  const uint8_t *base = vb->data;
+  if (vb->layout.storage == VERTEX_STORAGE_SOA)
+    return base + vb->streams[semantic]
+           + (size_t)index * vb->layout.type_sizes[semantic];
+  return base + (size_t)index * vb->layout.vertex_stride
+         + vb->layout.offsets[semantic];
+}
+
+/*
+ * vertex fetch: read the position and color of vertex index of vb into
+ * out. positions with fewer than 4 components get a w of 1. returns false
+ * if the layout lacks either.
+ * a draw picks the fetch for its buffer once, see vertex_fetch_select.
+ */
+typedef bool (*VertexFetch) (const VertexBuffer *vb, uint32_t index,
+                             ClipVertex *out);
+
+static bool
+vertex_fetch_p3f_c4f (const VertexBuffer *vb, uint32_t index,
+                      ClipVertex *out)
+{
+  memcpy (out->pos, attribute_address (vb, ATTR_POSITION, index),
+          3 * sizeof (float));
+  out->pos[3] = 1.0f;
+  memcpy (out->color, attribute_address (vb, ATTR_COLOR, index),
+          sizeof (out->color));
+  return true;
+}
+
+static bool
+vertex_fetch_p4f_c4f (const VertexBuffer *vb, uint32_t index,
+                      ClipVertex *out)
+{
+  memcpy (out->pos, attribute_address (vb, ATTR_POSITION, index),
+          sizeof (out->pos));
+  memcpy (out->color, attribute_address (vb, ATTR_COLOR, index),
+          sizeof (out->color));
+  return true;
+}
+
+/* bytes from one stored component of semantic to the next */
+static inline size_t
+attribute_step (const VertexBuffer *vb, AttributeSemantic semantic)
+{
+  if (vb->layout.storage == VERTEX_STORAGE_SOA)
+    return vb->stream_pitch[semantic];
+  return vb->layout.type_sizes[semantic];
+}
+
+/* decode up to 4 components of semantic of vertex index to floats */
+static inline void
+attribute_read (const VertexBuffer *vb, AttributeSemantic semantic,
+                uint32_t index, float *out)
+{
+  attribute_decode (vb->layout.formats[semantic],
+                    attribute_address (vb, semantic, index),
+                    attribute_step (vb, semantic),
+                    min2i (vb->layout.components[semantic], 4), out);
+}
+
+/*
+ * any other layout with a position and color, in either storage and any
+ * format: missing color components are opaque black
+ */
+static bool
+vertex_fetch_generic (const VertexBuffer *vb, uint32_t index,
+                      ClipVertex *out)
+{
+  *out = (ClipVertex){ .color = { 0.0f, 0.0f, 0.0f, 1.0f } };
+  attribute_read (vb, ATTR_POSITION, index, out->pos);
+  attribute_read (vb, ATTR_COLOR, index, out->color);
+  return true;
+}
+
+/* read n float components of semantic of vertex index from SoA arrays */
+static inline void
+soa_read (const VertexBuffer *vb, AttributeSemantic semantic, uint32_t index,
+          uint32_t n, float *out)
+{
+  const uint8_t *stream = (const uint8_t *)vb->data + vb->streams[semantic]
+                          + (size_t)index * sizeof (float);
+  for (uint32_t c = 0; c < n; ++c)
+    memcpy (&out[c], stream + c * vb->stream_pitch[semantic], sizeof (float));
+}
+
+static bool
+vertex_fetch_soa_p3f_c4f (const VertexBuffer *vb, uint32_t index,
+                          ClipVertex *out)
+{
+  soa_read (vb, ATTR_POSITION, index, 3, out->pos);
+  out->pos[3] = 1.0f;
+  soa_read (vb, ATTR_COLOR, index, 4, out->color);
+  return true;
+}
+
+static bool
+vertex_fetch_soa_p4f_c4f (const VertexBuffer *vb, uint32_t index,
+                          ClipVertex *out)
+{
+  soa_read (vb, ATTR_POSITION, index, 4, out->pos);
+  soa_read (vb, ATTR_COLOR, index, 4, out->color);
+  return true;
+}
+
+static bool
+vertex_fetch_missing (const VertexBuffer *vb, uint32_t index,
+                      ClipVertex *out)
+{
+  (void)vb;
+  (void)index;
+  (void)out;
+  return false;
+}
+
+static VertexFetch
+vertex_fetch_select (const VertexLayout *layout)
+{
+  bool soa = layout->storage == VERTEX_STORAGE_SOA;
+
+  switch (layout->format)
+    {
+    case VERTEX_FORMAT_P3F_C4F:
+      return soa ? vertex_fetch_soa_p3f_c4f : vertex_fetch_p3f_c4f;
+    case VERTEX_FORMAT_P4F_C4F:
+      return soa ? vertex_fetch_soa_p4f_c4f : vertex_fetch_p4f_c4f;
+    default:
+      if (!layout->components[ATTR_POSITION]
+          || !layout->components[ATTR_COLOR])
+        return vertex_fetch_missing;
+      return vertex_fetch_generic;
+    }
+}
+
+/*
+ * convert position pos to a Pixel_t with color col. a clip-space pos is
+ * divided by its w and 1/w is kept for perspective-correct interpolation;
+ * otherwise pos is already in NDC. a w of 0 has no projection and is left
+ * undivided: the clip path drops or cuts such vertices before they get
+ * here, and only a draw without clipping can pass one.
+ */
+static inline void
+position_to_pixel (const Framebuffer *fb, const float *pos, bool clip_space,
+                   const float *col, Pixel_t *out)
+{
+  /* perspective divide for clip-space positions */
+  float ndc[3] = { pos[0], pos[1], pos[2] };
+  out->inv_w = 0.0f;
+
+  if (clip_space && pos[3] != 0.0f)
+    {
+      float inv_w = 1.0f / pos[3];
+      ndc[0] *= inv_w;
+      ndc[1] *= inv_w;
+      ndc[2] *= inv_w;
+      out->inv_w = inv_w;
+    }
+
+  /* convert NDC xy to framebuffer coords, split into pixel and sub-pixel */
+  Vec2i_t fixed = ndc_to_framebuffer_coords (fb, ndc);
+  out->pos = (Vec2i_t){ fixed.x >> SUBPIXEL_BITS, fixed.y >> SUBPIXEL_BITS };
+  out->sub = (Vec2i_t){ fixed.x & SUBPIXEL_MASK, fixed.y & SUBPIXEL_MASK };
+
+  /* convert float RGBA to 0-255 */
+  out->color = float4_to_color8 (col);
+
+  /* map NDC z from [-1,1] to depth [0,1] */
+  out->depth = ndc[2] * 0.5f + 0.5f;
+}
+
 /**
  * Convert a vertex at a given index in a vertex buffer to a Pixel_t suitable
  * for drawing.
@@ -37,8 +348,13 @@ ndc_to_framebuffer_coords (const Framebuffer *fb, const float *pos)
  * This function extracts necessary vertex data, performs coordinate
  * transformation, and prepares the pixel data for rendering.
  *
+ * A position with 4 components is taken as clip space: it is divided by w
+ * here and 1/w is kept for perspective-correct interpolation. A position
+ * with 3 components is taken as already being in NDC.
+ *
  * @param fb    Pointer to the framebuffer.
  * @param vb    Pointer to the vertex buffer.
+ * @param fetch Vertex fetch for the buffer's layout.
  * @param index Index of the vertex in the buffer.
  * @param out   Output pointer to Pixel_t that will be filled with transformed
  * vertex information.
@@ -46,340 +362,3421 @@ ndc_to_framebuffer_coords (const Framebuffer *fb, const float *pos)
  * invalid.
  */
 static inline bool
-vertex_to_pixel (const Framebuffer *fb, const VertexBuffer *vb, uint32_t index,
-                 Pixel_t *out)
+vertex_to_pixel (const Framebuffer *fb, const VertexBuffer *vb,
+                 VertexFetch fetch, uint32_t index, Pixel_t *out)
 {
-  /* reject missing framebuffer or vertex buffer */
-  if (!fb || !vb)
-    return false;
-
-
   /* fetch position and color attributes */
-  float *pos = get_attribute_pointer (vb, index, ATTR_POSITION);
-
-  float *col = get_attribute_pointer (vb, index, ATTR_COLOR);
+  ClipVertex v;
 
   /* fallback if attributes are missing */
-  if (!pos || !col)
+  if (!fetch (vb, index, &v))
     {
       *out = (Pixel_t){
         .pos    = { 0, 0 },
         .color  = { 0, 0, 0, 255 },
-        .depth  = 1.0f
+        .depth  = 1.0f,
+        .sub    = { 0, 0 },
+        .inv_w  = 0.0f
       };
       return false;
     }
 
-  /* convert NDC xy to framebuffer coords */
-  out->pos = ndc_to_framebuffer_coords (fb, pos);
-
-  /* convert float RGBA to 0-255 */
-  out->color = float4_to_color8 (col);
-
-  /* map NDC z from [-1,1] to depth [0,1] */
-  float ndc_z = pos[2];
-  float depth = ndc_z * 0.5f + 0.5f;
-
-  /* clamp depth to valid range */
-  clampi(depth, 0.0f, 1.0f);
-  out->depth = depth;
-
+  position_to_pixel (fb, v.pos, vb->layout.components[ATTR_POSITION] >= 4,
+                     v.color, out);
   return true;
 }
 
-void
-draw_vertex_buffer (Framebuffer *fb, const VertexBuffer *vb,
-                    PrimitiveType prim)
+/* per-draw vertex fetch and clipping of clip-space primitives */
+typedef struct
 {
-  switch (prim)
-    {
-    case PRIM_POINTS:
-      for (uint32_t i = 0; i < vb->vertex_count; ++i)
-        {
-          Pixel_t p;
-          vertex_to_pixel (fb, vb, i, &p);
-          draw_pixel (fb, p);
-        }
-      break;
+  VertexFetch fetch; /* fetch for the vertex buffer's layout */
+  bool     enabled; /* positions are in clip space and get clipped */
+  uint32_t planes;  /* state->clip_planes */
+  float    band;    /* guard band extent, in viewports from the center */
+  const Mat4x4f_t *mvp;     /* state->mvp */
+  const Vec4f_t *positions; /* clip-space positions from the vertex stage */
+  uint32_t components;      /* components of the source positions */
+  const AttributeSemantic *varyings; /* state->varyings */
+  uint32_t varying_attributes; /* entries of varyings that fit */
+  uint32_t varying_count;      /* floats they take, 0 without fragment_func */
+  const RasterVariant *raster; /* triangle rasterizer for the state */
+  const float *tint;           /* instance color scale, NULL for none */
+} ClipSetup;
 
-    case PRIM_LINES:
-      for (uint32_t i = 0; i + 1 < vb->vertex_count; i += 2)
-        {
-          Pixel_t p0;
-          Pixel_t p1;
-          vertex_to_pixel (fb, vb, i, &p0);
-          vertex_to_pixel (fb, vb, i + 1, &p1);
-          draw_line (fb, p0, p1);
-        }
-      break;
+/*
+ * a draw with an mvp always runs the clip path, since its positions only
+ * exist in clip space. positions stays NULL until the vertex stage runs.
+ */
+static inline ClipSetup
+clip_setup (const Framebuffer *fb, const DrawState *state,
+            const VertexBuffer *vb)
+{
+  /* the pixel limit must hold on the longer axis, so size by it */
+  float res = (float)(fb->vinfo.xres > fb->vinfo.yres ? fb->vinfo.xres
+                                                       : fb->vinfo.yres);
+  uint32_t components = vb->layout.components[ATTR_POSITION];
 
-    case PRIM_TRIANGLES:
-      for (uint32_t i = 0; i + 2 < vb->vertex_count; i += 3)
+  /* varyings are only read for a fragment function, as many as fit */
+  uint32_t attributes = 0;
+  uint32_t count = 0;
+  if (fragment_stage (state) && state->varyings)
+    {
+      for (; attributes < state->varying_count; ++attributes)
         {
-          Pixel_t p0;
-          Pixel_t p1;
-          Pixel_t p2;
-          vertex_to_pixel (fb, vb, i, &p0);
-          vertex_to_pixel (fb, vb, i + 1, &p1);
-          vertex_to_pixel (fb, vb, i + 2, &p2);
-          draw_triangle_fill (fb, p0, p1, p2);
+          uint32_t n = min2i (
+              vb->layout.components[state->varyings[attributes]], 4);
+          if (count + n > CLIP_MAX_VARYINGS)
+            break;
+          count += n;
         }
-      break;
-
-    default:
-      fprintf (stderr, "INVALID_PRIMITIVE_TYPE\n");
-      break;
     }
+
+  return (ClipSetup){
+    .fetch = vertex_fetch_select (&vb->layout),
+    .enabled = state->mvp || (state->clip_planes && components >= 4),
+    .planes = state->clip_planes,
+    .band = 2.0f * GUARD_BAND_LIMIT / res - 1.0f,
+    .mvp = state->mvp,
+    .positions = NULL,
+    .components = components,
+    .varyings = state->varyings,
+    .varying_attributes = attributes,
+    .varying_count = count,
+    .raster = raster_variant_select (fb, state),
+    .tint = NULL,
+  };
 }
 
-void
-draw_index_buffer (Framebuffer *fb, const IndexBuffer *ib,
-                   const VertexBuffer *vb, PrimitiveType prim)
+/*
+ * vertex stage: transform every position of vb by clip->mvp in batches
+ * into a clip-space array for the rest of the draw. returns the array to
+ * free after the draw, NULL without an mvp or memory for it, in which case
+ * vertex_fetch_clip transforms vertices one at a time instead.
+ */
+static Vec4f_t *
+vertex_stage (const VertexBuffer *vb, ClipSetup *clip)
 {
-  switch (prim)
-    {
-    case PRIM_POINTS:
-      for (uint32_t i = 0; i < ib->count; ++i)
-        {
-          uint32_t vertex_index = ib->data[i];
-          if (vertex_index >= vb->vertex_count)
-            continue;
+  if (!clip->mvp || vb->vertex_count == 0)
+    return NULL;
 
-          Pixel_t p;
-          vertex_to_pixel (fb, vb, vertex_index, &p);
-          draw_pixel (fb, p);
-        }
-      break;
-
-    case PRIM_LINES:
-      for (uint32_t i = 0; i + 1 < ib->count; i += 2)
-        {
-          uint32_t idx0 = ib->data[i];
-          uint32_t idx1 = ib->data[i + 1];
-
-          if (idx0 >= vb->vertex_count || idx1 >= vb->vertex_count)
-            continue;
-
-          Pixel_t p0;
-          Pixel_t p1;
-          vertex_to_pixel (fb, vb, idx0, &p0);
-          vertex_to_pixel (fb, vb, idx1, &p1);
-          draw_line (fb, p0, p1);
-        }
-      break;
-
-    case PRIM_TRIANGLES:
-      for (uint32_t i = 0; i + 2 < ib->count; i += 3)
-        {
-          uint32_t idx0 = ib->data[i];
-          uint32_t idx1 = ib->data[i + 1];
-          uint32_t idx2 = ib->data[i + 2];
+  Vec4f_t *positions = malloc ((size_t)vb->vertex_count * sizeof (Vec4f_t));
+  if (positions && vertex_transform_positions (clip->mvp, vb, positions))
+    clip->positions = positions;
+  return positions;
+}
 
-          if (idx0 >= vb->vertex_count ||
-              idx1 >= vb->vertex_count ||
-              idx2 >= vb->vertex_count)
-            continue;
+/* read the clip-space position and color of vertex index of vb */
+static inline bool
+vertex_fetch_clip (const VertexBuffer *vb, const ClipSetup *clip,
+                   uint32_t index, ClipVertex *out)
+{
+  if (!clip->fetch (vb, index, out))
+    return false;
 
-          Pixel_t p0;
-          Pixel_t p1;
-          Pixel_t p2;
-          vertex_to_pixel (fb, vb, idx0, &p0);
-          vertex_to_pixel (fb, vb, idx1, &p1);
-          vertex_to_pixel (fb, vb, idx2, &p2);
-          draw_triangle_fill (fb, p0, p1, p2);
-        }
-      break;
+  if (clip->positions)
+    memcpy (out->pos, &clip->positions[index], sizeof (out->pos));
+  else if (clip->mvp)
+    {
+      Vec4f_t v
+          = vertex_transform_position (clip->mvp, out->pos, clip->components);
+      memcpy (out->pos, &v, sizeof (out->pos));
+    }
+  return true;
+}
 
-    default:
-      fprintf (stderr, "INVALID_PRIMITIVE_TYPE\n");
-      break;
+/*
+ * read the varyings of vertex index of vb into out, the components of
+ * each attribute after those of the one before, and zero the rest
+ */
+static inline void
+varyings_fetch (const VertexBuffer *vb, const ClipSetup *clip,
+                uint32_t index, float *out)
+{
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < clip->varying_attributes; ++i)
+    {
+      AttributeSemantic semantic = clip->varyings[i];
+      if (!vb->layout.components[semantic])
+        continue;
+      attribute_read (vb, semantic, index, &out[n]);
+      n += min2i (vb->layout.components[semantic], 4);
     }
+  memset (&out[n], 0, (CLIP_MAX_VARYINGS - n) * sizeof (float));
 }
 
-void
-draw_pixel (Framebuffer *fb, Pixel_t p)
+/* a vertex after the per-vertex work of a draw, shared by its primitives */
+typedef struct
 {
-  /* extract coordinates */
-  int x = p.pos.x;
-  int y = p.pos.y;
+  Pixel_t    pixel;   /* projected vertex */
+  ClipVertex clip;    /* clip-space vertex, when clipping */
+  uint8_t    outcode; /* frustum planes the vertex is outside of */
+  uint8_t    band;    /* side planes of the guard band it is outside of */
+  bool       valid;   /* position and color were found */
+} PostVertex;
 
-  /* reject pixels outside framebuffer */
-  if (x < 0 || x >= (int)fb->vinfo.xres)
-    return;
-  if (y < 0 || y >= (int)fb->vinfo.yres)
+/*
+ * do the per-vertex work for vertex index of vb: fetch, classify against
+ * the frustum and guard band when clipping, and project. vertices behind
+ * the near plane are left unprojected, only clipped triangles use them.
+ */
+static inline void
+post_vertex_make (const Framebuffer *fb, const VertexBuffer *vb,
+                  const ClipSetup *clip, uint32_t index, PostVertex *out)
+{
+  if (!clip->enabled)
+    {
+      /* triangles and lines still draw the fallback of missing attributes */
+      out->valid = vertex_to_pixel (fb, vb, clip->fetch, index, &out->pixel);
+      out->outcode = 0;
+      out->band = 0;
+      if (clip->varying_count)
+        varyings_fetch (vb, clip, index, out->clip.varyings);
+      return;
+    }
+
+  out->valid = vertex_fetch_clip (vb, clip, index, &out->clip);
+  if (!out->valid)
     return;
+  varyings_fetch (vb, clip, index, out->clip.varyings);
+  if (clip->tint)
+    {
+      for (int c = 0; c < 4; ++c)
+        out->clip.color[c] *= clip->tint[c];
+    }
 
-  /* if no depth buffer, just write the pixel */
-  if (!fb->depth_buffer)
+  out->outcode = (uint8_t)clip_outcode (&out->clip, clip->planes, 1.0f);
+  out->band = out->outcode & ~CLIP_NEAR_FAR
+                  ? (uint8_t)clip_outcode (&out->clip,
+                                           clip->planes & ~CLIP_NEAR_FAR,
+                                           clip->band)
+                  : 0;
+  /*
+   * a w of 0 has no projection. the planes cut such a vertex away unless
+   * it is the origin or they leave out the sides; its primitives are
+   * dropped then.
+   */
+  if (out->clip.pos[3] == 0.0f && !out->outcode)
     {
-      set_pixel (fb, p.pos, p.color);
+      out->valid = false;
       return;
     }
 
-  /* compute index into depth buffer */
-  uint32_t w = fb->vinfo.xres;
-  size_t idx = (size_t)y * w + (size_t)x;
+  if (!(out->outcode & CLIP_NEAR))
+    position_to_pixel (fb, out->clip.pos, true, out->clip.color,
+                       &out->pixel);
+}
+
+/*
+ * per-draw post-transform cache: every vertex an index buffer references
+ * is transformed once, on first use, and shared by all its primitives
+ */
+typedef struct
+{
+  PostVertex *vertices; /* one slot per vertex of the buffer */
+  uint8_t    *ready;    /* nonzero once a slot holds its vertex */
+  uint64_t    hits;     /* lookups served from the cache */
+  uint64_t    misses;   /* vertices transformed */
+} VertexCache;
+
+static bool
+vertex_cache_init (VertexCache *cache, uint32_t vertex_count)
+{
+  cache->vertices = malloc ((size_t)vertex_count * sizeof (PostVertex));
+  cache->ready = calloc (vertex_count, 1);
+  cache->hits = 0;
+  cache->misses = 0;
+  if (cache->vertices && cache->ready)
+    return true;
 
-  /* read stored depth */
-  float current_depth = fb->depth_buffer[idx];
+  free (cache->vertices);
+  free (cache->ready);
+  return false;
+}
 
-  /* depth test */
-  if (p.depth < current_depth)
+static void
+vertex_cache_free (VertexCache *cache, const DrawState *state)
+{
+  if (state->stats)
     {
-      fb->depth_buffer[idx] = p.depth;
-      set_pixel (fb, p.pos, p.color);
+      state->stats->vertices_transformed += cache->misses;
+      state->stats->vertex_cache_hits += cache->hits;
     }
+  free (cache->vertices);
+  free (cache->ready);
 }
 
-/* lerp integer with fixed-point t_fixed */
-static inline uint8_t
-lerp_fixed (uint8_t c0, uint8_t c1, int t_fixed)
+static inline const PostVertex *
+vertex_cache_get (VertexCache *cache, const Framebuffer *fb,
+                  const VertexBuffer *vb, const ClipSetup *clip,
+                  uint32_t index)
 {
-  int diff = c1 - c0;
-  return c0 + ((diff * t_fixed) >> FIXED_SHIFT);
+  PostVertex *v = &cache->vertices[index];
+  if (cache->ready[index])
+    {
+      cache->hits++;
+      return v;
+    }
+
+  post_vertex_make (fb, vb, clip, index, v);
+  cache->ready[index] = 1;
+  cache->misses++;
+  return v;
 }
 
-void
-draw_line (Framebuffer *fb, Pixel_t p0, Pixel_t p1)
+/*
+ * rasterize the triangle v0 v1 v2. with clipping enabled triangles outside
+ * one plane of the view frustum are culled and ones inside it drawn as they
+ * are. triangles that only leave it through the side planes and stay
+ * inside the guard band are drawn as they are too, and the rasterizer's
+ * bounds clamp scissors them. only the rest, crossing the near or far plane
+ * or the guard band, are clipped before the perspective divide; the
+ * polygon left over is drawn as a fan.
+ */
+static void
+assemble_triangle (Framebuffer *fb, const DrawState *state,
+                   const ClipSetup *clip, const PostVertex *v0,
+                   const PostVertex *v1, const PostVertex *v2)
 {
-  /* starting pixel coords */
-  int x1 = p0.pos.x, y1 = p0.pos.y;
-  int x2 = p1.pos.x, y2 = p1.pos.y;
+  PrimVaryings var = {
+    { v0->clip.varyings, v1->clip.varyings, v2->clip.varyings },
+    clip->varying_count
+  };
 
-  /* Bresenham setup values */
-  int dx, dy, sx, sy, err;
-  bresenham_init (x1, y1, x2, y2, &dx, &dy, &sx, &sy, &err);
+  if (!clip->enabled)
+    {
+      raster_triangle (fb, state, v0->pixel, v1->pixel, v2->pixel, &var,
+                       clip->raster);
+      return;
+    }
 
-  /* total number of steps for interpolation */
-  int steps = abs (x2 - x1) > abs (y2 - y1) ? abs (x2 - x1) : abs (y2 - y1);
+  if (!v0->valid || !v1->valid || !v2->valid)
+    return;
 
-  /* If both endpoints are the same pixel, just draw it */
-  if (steps == 0)
+  DrawStats *stats = state->stats;
+  if (v0->outcode & v1->outcode & v2->outcode)
     {
-      /* degenerate line, draw single pixel */
-      draw_pixel (fb, p0);
+      if (stats)
+        stats->triangles_culled++;
       return;
     }
 
-  /* fixed point t = 0 */
-  int t_fixed = 0;
-
-  /* fixed point dt = 1 / steps */
-  int dt_fixed = FIXED_DIV (FIXED_ONE, steps);
+  /* past the side planes, the guard band decides */
+  uint32_t outside = v0->outcode | v1->outcode | v2->outcode;
+  uint32_t crossed = (outside & CLIP_NEAR_FAR) | v0->band | v1->band | v2->band;
 
-  for (;;)
+  if (!crossed)
     {
-      Pixel_t p;
+      if (stats)
+        {
+          if (outside)
+            stats->triangles_guard_band++;
+          else
+            stats->triangles_inside++;
+        }
+      raster_triangle (fb, state, v0->pixel, v1->pixel, v2->pixel, &var,
+                       clip->raster);
+      return;
+    }
 
-      /* current pixel coords */
-      p.pos.x = x1;
-      p.pos.y = y1;
+  if (stats)
+    stats->triangles_clipped++;
 
-      /* interpolate color in fixed point */
-      p.color.r = lerp_fixed (p0.color.r, p1.color.r, t_fixed);
-      p.color.g = lerp_fixed (p0.color.g, p1.color.g, t_fixed);
-      p.color.b = lerp_fixed (p0.color.b, p1.color.b, t_fixed);
-      p.color.a = lerp_fixed (p0.color.a, p1.color.a, t_fixed);
+  ClipVertex in[3] = { v0->clip, v1->clip, v2->clip };
+  ClipVertex poly[CLIP_MAX_VERTICES];
+  uint32_t count = clip_triangle (in, clip->planes, clip->band, poly);
+  if (!count)
+    return;
 
-      /* convert fixed-point t to float */
-      float t = (float)t_fixed / (float)FIXED_ONE;
-      /* interpolate depth */
-      p.depth = p0.depth * (1.0f - t) + p1.depth * t;
+  Pixel_t p[3];
+  position_to_pixel (fb, poly[0].pos, true, poly[0].color, &p[0]);
+  position_to_pixel (fb, poly[1].pos, true, poly[1].color, &p[2]);
+  var.v[0] = poly[0].varyings;
+  for (uint32_t k = 2; k < count; ++k)
+    {
+      p[1] = p[2];
+      position_to_pixel (fb, poly[k].pos, true, poly[k].color, &p[2]);
+      var.v[1] = poly[k - 1].varyings;
+      var.v[2] = poly[k].varyings;
+      raster_triangle (fb, state, p[0], p[1], p[2], &var, clip->raster);
+    }
+}
 
-      /* draw this pixel with depth test */
-      draw_pixel (fb, p);
+/*
+ * line counterpart of assemble_triangle. raster_line clips to the screen
+ * exactly, so lines are only cut at the near and far planes and the guard
+ * band.
+ */
+static void
+assemble_line (Framebuffer *fb, const DrawState *state, const ClipSetup *clip,
+               const PostVertex *v0, const PostVertex *v1)
+{
+  PrimVaryings var = { { v0->clip.varyings, v1->clip.varyings, NULL },
+                       clip->varying_count };
 
-      /* step Bresenham, break when done */
-      if (!bresenham_step (&x1, &y1, x2, y2, &err, dx, dy, sx, sy))
-        break;
+  if (!clip->enabled)
+    {
+      raster_line (fb, state, v0->pixel, v1->pixel, &var);
+      return;
+    }
 
-      /* advance t in fixed point */
-      t_fixed += dt_fixed;
-      if (t_fixed > FIXED_ONE)
-        t_fixed = FIXED_ONE;
+  if (!v0->valid || !v1->valid)
+    return;
+
+  if (!((v0->outcode | v1->outcode) & CLIP_NEAR_FAR) && !v0->band
+      && !v1->band)
+    {
+      if (!(v0->outcode & v1->outcode))
+        raster_line (fb, state, v0->pixel, v1->pixel, &var);
+      return;
     }
+
+  ClipVertex a = v0->clip;
+  ClipVertex b = v1->clip;
+  if (!clip_line (&a, &b, clip->planes, clip->band))
+    return;
+
+  Pixel_t p0;
+  Pixel_t p1;
+  position_to_pixel (fb, a.pos, true, a.color, &p0);
+  position_to_pixel (fb, b.pos, true, b.color, &p1);
+  var.v[0] = a.varyings;
+  var.v[1] = b.varyings;
+  raster_line (fb, state, p0, p1, &var);
 }
 
-void
-draw_triangle_wireframe (Framebuffer *fb, Pixel_t p0, Pixel_t p1, Pixel_t p2)
+DrawState
+draw_state_default (void)
 {
-  /* draw edges of the triangle */
-  draw_line (fb, p0, p1);
-  draw_line (fb, p1, p2);
-  draw_line (fb, p2, p0);
+  return default_state;
 }
 
-/*
- * returns the 2d cross product which is twice the area of the triangle abc.
- * the sign tells which side of edge ab the point c lies on.
+void
+draw_vertex_buffer (Framebuffer *fb, const VertexBuffer *vb,
+                    PrimitiveType prim, const DrawState *state)
+{
+  if (!state)
+    state = &default_state;
+
+  ClipSetup clip = clip_setup (fb, state, vb);
+  Vec4f_t *positions = prim != PRIM_POINTS ? vertex_stage (vb, &clip) : NULL;
+  PostVertex v[3];
+
+  switch (prim)
+    {
+    case PRIM_POINTS:
+      raster_points (fb, state, vb, NULL, vb->vertex_count);
+      break;
+
+    case PRIM_LINES:
+      for (uint32_t i = 0; i + 1 < vb->vertex_count; i += 2)
+        {
+          post_vertex_make (fb, vb, &clip, i, &v[0]);
+          post_vertex_make (fb, vb, &clip, i + 1, &v[1]);
+          assemble_line (fb, state, &clip, &v[0], &v[1]);
+        }
+      break;
+
+    case PRIM_TRIANGLES:
+      for (uint32_t i = 0; i + 2 < vb->vertex_count; i += 3)
+        {
+          post_vertex_make (fb, vb, &clip, i, &v[0]);
+          post_vertex_make (fb, vb, &clip, i + 1, &v[1]);
+          post_vertex_make (fb, vb, &clip, i + 2, &v[2]);
+          assemble_triangle (fb, state, &clip, &v[0], &v[1], &v[2]);
+        }
+      break;
+
+    default:
+      fprintf (stderr, "INVALID_PRIMITIVE_TYPE\n");
+      break;
+    }
+
+  free (positions);
+}
+
+/*
+ * draw_index_buffer without a vertex cache, for when there is no memory for
+ * one: every index transforms its vertex again
+ */
+static void
+draw_index_buffer_uncached (Framebuffer *fb, const IndexBuffer *ib,
+                            const VertexBuffer *vb, PrimitiveType prim,
+                            const DrawState *state, const ClipSetup *clip)
+{
+  uint32_t per_prim = prim == PRIM_LINES ? 2 : 3;
+  PostVertex v[3];
+
+  for (size_t i = 0; i + per_prim <= ib->count; i += per_prim)
+    {
+      bool valid = true;
+      for (uint32_t k = 0; k < per_prim; ++k)
+        {
+          uint32_t index = ib->data[i + k];
+          if (index >= vb->vertex_count)
+            valid = false;
+          else
+            post_vertex_make (fb, vb, clip, index, &v[k]);
+        }
+      if (!valid)
+        continue;
+
+      if (prim == PRIM_LINES)
+        assemble_line (fb, state, clip, &v[0], &v[1]);
+      else
+        assemble_triangle (fb, state, clip, &v[0], &v[1], &v[2]);
+    }
+}
+
+/* draw the lines or triangles of ib through the vertex cache */
+static void
+draw_index_buffer_cached (Framebuffer *fb, const IndexBuffer *ib,
+                          const VertexBuffer *vb, PrimitiveType prim,
+                          const DrawState *state, const ClipSetup *clip,
+                          VertexCache *cache)
+{
+  if (prim == PRIM_LINES)
+    {
+      for (size_t i = 0; i + 1 < ib->count; i += 2)
+        {
+          uint32_t idx0 = ib->data[i];
+          uint32_t idx1 = ib->data[i + 1];
+
+          if (idx0 >= vb->vertex_count || idx1 >= vb->vertex_count)
+            continue;
+
+          assemble_line (fb, state, clip,
+                         vertex_cache_get (cache, fb, vb, clip, idx0),
+                         vertex_cache_get (cache, fb, vb, clip, idx1));
+        }
+      return;
+    }
+
+  for (size_t i = 0; i + 2 < ib->count; i += 3)
+    {
+      uint32_t idx0 = ib->data[i];
+      uint32_t idx1 = ib->data[i + 1];
+      uint32_t idx2 = ib->data[i + 2];
+
+      if (idx0 >= vb->vertex_count ||
+          idx1 >= vb->vertex_count ||
+          idx2 >= vb->vertex_count)
+        continue;
+
+      const PostVertex *v0 = vertex_cache_get (cache, fb, vb, clip, idx0);
+      const PostVertex *v1 = vertex_cache_get (cache, fb, vb, clip, idx1);
+      const PostVertex *v2 = vertex_cache_get (cache, fb, vb, clip, idx2);
+      assemble_triangle (fb, state, clip, v0, v1, v2);
+    }
+}
+
+void
+draw_index_buffer (Framebuffer *fb, const IndexBuffer *ib,
+                   const VertexBuffer *vb, PrimitiveType prim,
+                   const DrawState *state)
+{
+  if (!state)
+    state = &default_state;
+
+  if (prim == PRIM_POINTS)
+    {
+      raster_points (fb, state, vb, ib->data, ib->count);
+      return;
+    }
+  if (prim != PRIM_LINES && prim != PRIM_TRIANGLES)
+    {
+      fprintf (stderr, "INVALID_PRIMITIVE_TYPE\n");
+      return;
+    }
+
+  ClipSetup clip = clip_setup (fb, state, vb);
+  Vec4f_t *positions = vertex_stage (vb, &clip);
+
+  VertexCache cache;
+  if (!vertex_cache_init (&cache, vb->vertex_count))
+    {
+      draw_index_buffer_uncached (fb, ib, vb, prim, state, &clip);
+      free (positions);
+      return;
+    }
+
+  draw_index_buffer_cached (fb, ib, vb, prim, state, &clip, &cache);
+  vertex_cache_free (&cache, state);
+  free (positions);
+}
+
+/*
+ * transform of instance i: its model matrix after state->mvp, the view
+ * projection, or the instance matrix alone without one
+ */
+static inline Mat4x4f_t
+instance_transform (const InstanceBuffer *instances, uint32_t i,
+                    const DrawState *state)
+{
+  if (!state->mvp)
+    return instances->transforms[i];
+  return mat4x4f_mul (state->mvp, &instances->transforms[i]);
+}
+
+/*
+ * corners of the object-space box around the positions of vb, decoded
+ * into positions, for culling whole instances. homogeneous positions are
+ * bounded after their divide: for w > 0 a point and its divide lie on the
+ * same side of every clip plane. false if any w is not positive.
+ */
+static bool
+instance_bounds (const VertexBuffer *vb, Vec4f_t *positions,
+                 Vec4f_t corners[8])
+{
+  Mat4x4f_t identity = mat4x4f_identity ();
+  if (!vertex_transform_positions (&identity, vb, positions))
+    return false;
+
+  for (uint32_t i = 0; i < vb->vertex_count; ++i)
+    {
+      float w = positions[i].w;
+      if (!(w > 0.0f))
+        return false;
+      if (w != 1.0f)
+        {
+          positions[i].x /= w;
+          positions[i].y /= w;
+          positions[i].z /= w;
+        }
+    }
+
+  Vec4f_t lo = positions[0];
+  Vec4f_t hi = positions[0];
+  for (uint32_t i = 1; i < vb->vertex_count; ++i)
+    {
+      lo.x = fmin2f (lo.x, positions[i].x);
+      lo.y = fmin2f (lo.y, positions[i].y);
+      lo.z = fmin2f (lo.z, positions[i].z);
+      hi.x = fmax2f (hi.x, positions[i].x);
+      hi.y = fmax2f (hi.y, positions[i].y);
+      hi.z = fmax2f (hi.z, positions[i].z);
+    }
+
+  for (int k = 0; k < 8; ++k)
+    corners[k] = (Vec4f_t){ k & 1 ? hi.x : lo.x, k & 2 ? hi.y : lo.y,
+                            k & 4 ? hi.z : lo.z, 1.0f };
+  return true;
+}
+
+/*
+ * true if every corner of the box lies outside one of the clip planes under
+ * transform m. every primitive of the instance would be culled then.
+ */
+static bool
+instance_culled (const Mat4x4f_t *m, const Vec4f_t corners[8],
+                 uint32_t planes)
+{
+  ClipVertex v;
+  uint32_t outside = planes;
+  for (int k = 0; k < 8 && outside; ++k)
+    {
+      Vec4f_t p = mat4x4f_mul_vec4f (m, &corners[k]);
+      memcpy (v.pos, &p, sizeof (v.pos));
+      outside &= clip_outcode (&v, planes, 1.0f);
+    }
+  return outside != 0;
+}
+
+void
+draw_index_buffer_instanced (Framebuffer *fb, const IndexBuffer *ib,
+                             const VertexBuffer *vb,
+                             const InstanceBuffer *instances,
+                             PrimitiveType prim, const DrawState *state)
+{
+  if (!state)
+    state = &default_state;
+
+  if (prim != PRIM_POINTS && prim != PRIM_LINES && prim != PRIM_TRIANGLES)
+    {
+      fprintf (stderr, "INVALID_PRIMITIVE_TYPE\n");
+      return;
+    }
+  if (!instances->transforms || instances->count == 0)
+    return;
+
+  /* points draw per instance through their own path, untinted */
+  if (prim == PRIM_POINTS)
+    {
+      DrawState instance_state = *state;
+      for (uint32_t i = 0; i < instances->count; ++i)
+        {
+          Mat4x4f_t m = instance_transform (instances, i, state);
+          instance_state.mvp = &m;
+          raster_points (fb, &instance_state, vb, ib->data, ib->count);
+        }
+      return;
+    }
+
+  /*
+   * the setup, the position array and the vertex cache are shared by all
+   * instances. instances whose bounds are outside the frustum are dropped
+   * whole; each other one refills the positions with its transform in one
+   * batched pass and empties the cache before its primitives. instances
+   * always run in clip space, so the setup is that of a draw with an mvp,
+   * clipping against state->clip_planes.
+   */
+  Mat4x4f_t identity = mat4x4f_identity ();
+  DrawState setup_state = *state;
+  setup_state.mvp = &identity;
+  ClipSetup clip = clip_setup (fb, &setup_state, vb);
+  Vec4f_t *positions
+      = vb->vertex_count
+            ? malloc ((size_t)vb->vertex_count * sizeof (Vec4f_t))
+            : NULL;
+  VertexCache cache;
+  bool cached = vertex_cache_init (&cache, vb->vertex_count);
+  Vec4f_t corners[8];
+  bool bounded = positions && clip.planes
+                 && instance_bounds (vb, positions, corners);
+
+  for (uint32_t i = 0; i < instances->count; ++i)
+    {
+      Mat4x4f_t m = instance_transform (instances, i, state);
+      if (bounded && instance_culled (&m, corners, clip.planes))
+        {
+          if (state->stats)
+            state->stats->instances_culled++;
+          continue;
+        }
+
+      float tint[4];
+      clip.mvp = &m;
+      clip.positions = NULL;
+      if (positions && vertex_transform_positions (&m, vb, positions))
+        clip.positions = positions;
+      clip.tint = NULL;
+      if (instances->colors)
+        {
+          Color8_t c = instances->colors[i];
+          tint[0] = c.r * (1.0f / 255.0f);
+          tint[1] = c.g * (1.0f / 255.0f);
+          tint[2] = c.b * (1.0f / 255.0f);
+          tint[3] = c.a * (1.0f / 255.0f);
+          clip.tint = tint;
+        }
+
+      if (!cached)
+        {
+          draw_index_buffer_uncached (fb, ib, vb, prim, state, &clip);
+          continue;
+        }
+      memset (cache.ready, 0, vb->vertex_count);
+      draw_index_buffer_cached (fb, ib, vb, prim, state, &clip, &cache);
+    }
+
+  if (cached)
+    vertex_cache_free (&cache, state);
+  free (positions);
+}
+
+/* Hi-Z tile index of pixel (x, y) */
+static inline size_t
+hiz_index (const Framebuffer *fb, int x, int y)
+{
+  return (size_t)(y / FB_HIZ_TILE_SIZE) * fb->hiz_width
+         + (size_t)(x / FB_HIZ_TILE_SIZE);
+}
+
+/* recompute the farthest stored depth of the Hi-Z tile holding (x, y) */
+static void
+hiz_update_tile (Framebuffer *fb, int x, int y)
+{
+  int tx = x / FB_HIZ_TILE_SIZE;
+  int ty = y / FB_HIZ_TILE_SIZE;
+
+  int x0 = tx * FB_HIZ_TILE_SIZE;
+  int y0 = ty * FB_HIZ_TILE_SIZE;
+  int x1 = min2i (x0 + FB_HIZ_TILE_SIZE, fb->vinfo.xres);
+  int y1 = min2i (y0 + FB_HIZ_TILE_SIZE, fb->vinfo.yres);
+
+  /* every sample of the tile counts, they are adjacent within a row */
+  size_t n = fb->samples > 1 ? fb->samples : 1;
+
+  float max = 0.0f;
+  for (int py = y0; py < y1; ++py)
+    {
+      const float *row = fb->depth_buffer + (size_t)py * fb->vinfo.xres * n;
+      for (size_t i = x0 * n; i < x1 * n; ++i)
+        max = fmax2f (max, row[i]);
+    }
+
+  fb->hiz_buffer[(size_t)ty * fb->hiz_width + tx] = max;
+}
+
+/*
+ * account for n depths stored into the Hi-Z tile holding (x, y), none of
+ * them farther than zfar. the tile value only has to stay a bound on its
+ * farthest depth, so it is raised to zfar when needed and otherwise left
+ * alone; nearer writes would tighten it, which is done by a recompute once
+ * a tile's worth of depths went in. that keeps the refresh at about one
+ * depth load per stored pixel however the writes are spread over draws.
+ */
+static inline void
+hiz_add_writes (Framebuffer *fb, int x, int y, int n, float zfar)
+{
+  size_t i = hiz_index (fb, x, y);
+
+  if (zfar > fb->hiz_buffer[i])
+    fb->hiz_buffer[i] = zfar;
+
+  fb->hiz_writes[i] += n;
+  if (fb->hiz_writes[i] >= HIZ_REFRESH_WRITES)
+    {
+      hiz_update_tile (fb, x, y);
+      fb->hiz_writes[i] = 0;
+    }
+}
+
+/* compare an incoming depth against the stored one */
+static inline bool
+depth_test (DepthFunc func, float depth, float stored)
+{
+  switch (func)
+    {
+    case DEPTH_LESS:
+      return depth < stored;
+    case DEPTH_LESS_EQUAL:
+      return depth <= stored;
+    case DEPTH_EQUAL:
+      return depth == stored;
+    case DEPTH_ALWAYS:
+    default:
+      return true;
+    }
+}
+
+/* color c in the framebuffer's pixel format */
+static inline uint32_t
+fb_pack (const Framebuffer *fb, Color8_t c)
+{
+  /* clang-format off */
+  return pack_fb_color (
+      c,
+      fb->vinfo.red.offset,    fb->vinfo.red.length,
+      fb->vinfo.green.offset,  fb->vinfo.green.length,
+      fb->vinfo.blue.offset,   fb->vinfo.blue.length,
+      fb->vinfo.transp.offset, fb->vinfo.transp.length);
+  /* clang-format on */
+}
+
+/* channel shifts of an 8-bit RGB framebuffer, alpha masked off without one */
+typedef struct
+{
+  int r, g, b, a;
+  uint32_t alpha;
+} Rgb8Layout;
+
+/* true if fb takes colors packed by rgb8_pack */
+static inline bool
+fb_is_rgb8 (const Framebuffer *fb)
+{
+  const struct fb_var_screeninfo *v = &fb->vinfo;
+  return v->bits_per_pixel == 32 && v->red.length == 8
+         && v->green.length == 8 && v->blue.length == 8
+         && (v->transp.length == 0 || v->transp.length == 8);
+}
+
+static inline Rgb8Layout
+rgb8_layout (const Framebuffer *fb)
+{
+  const struct fb_var_screeninfo *v = &fb->vinfo;
+  return (Rgb8Layout){ (int)v->red.offset, (int)v->green.offset,
+                       (int)v->blue.offset, (int)v->transp.offset,
+                       v->transp.length ? 0xFFu : 0u };
+}
+
+/* fb_pack for an fb_is_rgb8 framebuffer, every channel stored as is */
+static inline uint32_t
+rgb8_pack (const Rgb8Layout *l, Color8_t c)
+{
+  return (uint32_t)c.r << l->r | (uint32_t)c.g << l->g
+         | (uint32_t)c.b << l->b | ((uint32_t)c.a & l->alpha) << l->a;
+}
+
+/*
+ * store color c into the samples of pixel (x, y) selected by mask. a write
+ * to every sample keeps the pixel at one color, stored once and final in
+ * the back buffer; a partial write splits the pixel into a color per
+ * sample, which fb_resolve averages later.
+ */
+static void
+write_samples (Framebuffer *fb, int x, int y, uint32_t mask, Color8_t c)
+{
+  uint32_t n = fb->samples;
+  size_t i = (size_t)y * fb->vinfo.xres + (size_t)x;
+  uint32_t *s = fb->sample_colors + i * n;
+  uint32_t packed = fb_pack (fb, c);
+
+  if (mask == (1u << n) - 1u)
+    {
+      s[0] = packed;
+      fb->sample_split[i] = 0;
+      if (fb->vinfo.bits_per_pixel == 32)
+        memcpy (fb->back_buffer + (size_t)y * fb->finfo.line_length
+                    + (size_t)x * 4,
+                &packed, 4);
+      else
+        set_pixel (fb, (Vec2i_t){ x, y }, c);
+      return;
+    }
+
+  if (!fb->sample_split[i])
+    {
+      for (uint32_t k = 1; k < n; ++k)
+        s[k] = s[0];
+      fb->sample_split[i] = 1;
+    }
+
+  for (uint32_t k = 0; k < n; ++k)
+    {
+      if (mask & (1u << k))
+        s[k] = packed;
+    }
+}
+
+/* color from a value in the framebuffer's pixel format */
+static inline Color8_t
+fb_unpack (const Framebuffer *fb, uint32_t packed)
+{
+  /* clang-format off */
+  return unpack_fb_color (
+      packed,
+      fb->vinfo.red.offset,    fb->vinfo.red.length,
+      fb->vinfo.green.offset,  fb->vinfo.green.length,
+      fb->vinfo.blue.offset,   fb->vinfo.blue.length,
+      fb->vinfo.transp.offset, fb->vinfo.transp.length);
+  /* clang-format on */
+}
+
+/*
+ * depth test pixel (x, y) and blend c over it by coverage. partially covered
+ * pixels leave the depth buffer alone so they never hide what is drawn
+ * behind them later. with multisampling the blend is against sample 0 and
+ * the result goes to every sample.
+ */
+static void
+blend_fragment (Framebuffer *fb, const DrawState *state, int x, int y,
+                float depth, Color8_t c, float coverage)
+{
+  uint32_t n = fb->samples > 1 ? fb->samples : 1;
+  size_t i = (size_t)y * fb->vinfo.xres + (size_t)x;
+
+  if (fb->depth_buffer
+      && !depth_test (state->depth_func, depth, fb->depth_buffer[i * n]))
+    return;
+
+  if (!state->color_write)
+    return;
+
+  uint32_t packed = 0;
+  if (n > 1)
+    packed = fb->sample_colors[i * n];
+  else
+    memcpy (&packed,
+            fb->back_buffer + (size_t)y * fb->finfo.line_length
+                + (size_t)x * (fb->vinfo.bits_per_pixel / 8),
+            fb->vinfo.bits_per_pixel / 8);
+
+  Color8_t dst = fb_unpack (fb, packed);
+  c.r = (uint8_t)(dst.r + (c.r - dst.r) * coverage + 0.5f);
+  c.g = (uint8_t)(dst.g + (c.g - dst.g) * coverage + 0.5f);
+  c.b = (uint8_t)(dst.b + (c.b - dst.b) * coverage + 0.5f);
+  c.a = (uint8_t)(dst.a + (c.a - dst.a) * coverage + 0.5f);
+
+  if (n > 1)
+    write_samples (fb, x, y, (1u << n) - 1u, c);
+  else
+    set_pixel (fb, (Vec2i_t){ x, y }, c);
+}
+
+/* depth test and write one pixel, returns true if its depth was stored */
+static bool
+write_fragment (Framebuffer *fb, const DrawState *state, Pixel_t p)
+{
+  /* extract coordinates */
+  int x = p.pos.x;
+  int y = p.pos.y;
+
+  /* reject pixels outside framebuffer */
+  if (x < 0 || x >= (int)fb->vinfo.xres)
+    return false;
+  if (y < 0 || y >= (int)fb->vinfo.yres)
+    return false;
+
+  /* points and lines cover every sample of their pixels */
+  uint32_t n = fb->samples > 1 ? fb->samples : 1;
+  uint32_t pass = (1u << n) - 1u;
+
+  /* if no depth buffer, just write the pixel */
+  if (!fb->depth_buffer)
+    {
+      if (state->color_write && n > 1)
+        write_samples (fb, x, y, pass, p.color);
+      else if (state->color_write)
+        set_pixel (fb, p.pos, p.color);
+      return false;
+    }
+
+  /* compute index into depth buffer */
+  uint32_t w = fb->vinfo.xres;
+  size_t idx = ((size_t)y * w + (size_t)x) * n;
+
+  /* depth test every sample */
+  for (uint32_t k = 0; k < n; ++k)
+    {
+      if (!depth_test (state->depth_func, p.depth, fb->depth_buffer[idx + k]))
+        pass &= ~(1u << k);
+    }
+
+  if (!pass)
+    return false;
+
+  if (state->color_write && n > 1)
+    write_samples (fb, x, y, pass, p.color);
+  else if (state->color_write)
+    set_pixel (fb, p.pos, p.color);
+
+  if (!state->depth_write)
+    return false;
+
+  for (uint32_t k = 0; k < n; ++k)
+    {
+      if (pass & (1u << k))
+        fb->depth_buffer[idx + k] = p.depth;
+    }
+
+  if (fb->hiz_buffer)
+    hiz_add_writes (fb, x, y, 1, p.depth);
+
+  return true;
+}
+
+void
+draw_pixel (Framebuffer *fb, Pixel_t p)
+{
+  write_fragment (fb, &default_state, p);
+}
+
+/*
+ * a point ready to fill, kept small because point clouds make millions of
+ * them. its pixel bounds are clipped to the framebuffer.
+ */
+typedef struct
+{
+  float    cx, cy;  /* center in pixels */
+  float    radius;  /* half the size, 0 for one pixel points */
+  float    depth;
+  uint32_t packed;  /* color in the framebuffer's pixel format */
+  Color8_t color;
+  int32_t  x0, y0;  /* top-left pixel of the bounds */
+  int32_t  x1, y1;  /* bottom-right pixel of the bounds, inclusive */
+} PointSprite;
+
+/*
+ * floor and ceil of a sprite bound in pixels, clamped to [-1, limit] first
+ * so that huge sizes and far off-screen centers convert to int without
+ * overflowing
+ */
+static inline int
+sprite_floor (float v, int limit)
+{
+  return math_floorf_to_int (clampf (v, -1.0f, (float)limit));
+}
+
+static inline int
+sprite_ceil (float v, int limit)
+{
+  return math_ceilf_to_int (clampf (v, -1.0f, (float)limit));
+}
+
+/*
+ * set up the sprite of point p with the given size, returns false if it
+ * covers no pixel of the framebuffer. square sprites cover the pixels whose
+ * centers fall in (c - size / 2, c + size / 2] on both axes, which for size
+ * 1 is the pixel the point is in. round sprites are bounded by the closed
+ * square around their disc.
+ */
+static bool
+point_sprite_make (const Framebuffer *fb, Pixel_t p, float size, bool round,
+                   PointSprite *out)
+{
+  int x0, y0, x1, y1;
+  int w = (int)fb->vinfo.xres;
+  int h = (int)fb->vinfo.yres;
+
+  out->cx = p.pos.x + p.sub.x * (1.0f / SUBPIXEL_ONE);
+  out->cy = p.pos.y + p.sub.y * (1.0f / SUBPIXEL_ONE);
+
+  /* NaN sizes draw one pixel too */
+  if (!(size > 1.0f))
+    {
+      out->radius = 0.0f;
+      x0 = x1 = p.pos.x;
+      y0 = y1 = p.pos.y;
+    }
+  else
+    {
+      float r = size * 0.5f;
+      out->radius = r;
+      x0 = round ? sprite_ceil (out->cx - r - 0.5f, w)
+                 : sprite_floor (out->cx - r - 0.5f, w) + 1;
+      y0 = round ? sprite_ceil (out->cy - r - 0.5f, h)
+                 : sprite_floor (out->cy - r - 0.5f, h) + 1;
+      x1 = sprite_floor (out->cx + r - 0.5f, w);
+      y1 = sprite_floor (out->cy + r - 0.5f, h);
+    }
+
+  x0 = max2i (x0, 0);
+  y0 = max2i (y0, 0);
+  x1 = min2i (x1, w - 1);
+  y1 = min2i (y1, h - 1);
+  if (x0 > x1 || y0 > y1)
+    return false;
+
+  out->x0 = x0;
+  out->y0 = y0;
+  out->x1 = x1;
+  out->y1 = y1;
+  out->depth = p.depth;
+  out->color = p.color;
+  out->packed = fb_pack (fb, p.color);
+  return true;
+}
+
+/*
+ * fill the part of a sprite inside [cx0, cx1] x [cy0, cy1], one span per
+ * row. round sprites take the pixels whose centers are inside the disc.
+ * on 32-bit single-sample framebuffers the spans are written straight into
+ * the color and depth rows; other framebuffers go through write_fragment.
+ */
+static void
+raster_sprite (Framebuffer *fb, const DrawState *state, const PointSprite *s,
+               bool round, int cx0, int cy0, int cx1, int cy1)
+{
+  int y0 = max2i (s->y0, cy0);
+  int y1 = min2i (s->y1, cy1);
+  bool direct = fb->vinfo.bits_per_pixel == 32 && fb->samples <= 1;
+  float depth = s->depth;
+  float r2 = s->radius * s->radius;
+
+  for (int y = y0; y <= y1; ++y)
+    {
+      int x0 = s->x0;
+      int x1 = s->x1;
+
+      if (round && s->radius > 0.0f)
+        {
+          float dy = y + 0.5f - s->cy;
+          if (dy * dy > r2)
+            continue;
+          float hw = sqrtf (r2 - dy * dy);
+          x0 = max2i (x0, sprite_ceil (s->cx - hw - 0.5f, fb->vinfo.xres));
+          x1 = min2i (x1, sprite_floor (s->cx + hw - 0.5f, fb->vinfo.xres));
+        }
+
+      x0 = max2i (x0, cx0);
+      x1 = min2i (x1, cx1);
+
+      if (!direct)
+        {
+          for (int x = x0; x <= x1; ++x)
+            {
+              Pixel_t p = { 0 };
+              p.pos = (Vec2i_t){ x, y };
+              p.color = s->color;
+              p.depth = depth;
+              write_fragment (fb, state, p);
+            }
+          continue;
+        }
+
+      uint32_t *color = (uint32_t *)(fb->back_buffer
+                                     + (size_t)y * fb->finfo.line_length);
+      float *stored = fb->depth_buffer
+                          ? fb->depth_buffer + (size_t)y * fb->vinfo.xres
+                          : NULL;
+
+      for (int x = x0; x <= x1; ++x)
+        {
+          if (stored && !depth_test (state->depth_func, depth, stored[x]))
+            continue;
+
+          if (state->color_write)
+            color[x] = s->packed;
+
+          if (stored && state->depth_write)
+            {
+              stored[x] = depth;
+              if (fb->hiz_buffer)
+                hiz_add_writes (fb, x, y, 1, depth);
+            }
+        }
+    }
+}
+
+/*
+ * draw count points, the vertices indices[i] or i when indices is NULL.
+ *
+ * the sprites are binned into TILE_SIZE screen tiles with a counting sort:
+ * one pass sets the sprites up and counts the tiles each one overlaps, a
+ * prefix sum turns the counts into bin offsets and a second pass copies
+ * every sprite into the bins of its tiles. the fills then stream through
+ * the bins while writing the framebuffer one tile at a time. the sort is
+ * stable and a sprite is clipped to each tile it lands in, so every pixel
+ * still sees its points in draw order.
+ */
+static void
+raster_points (Framebuffer *fb, const DrawState *state,
+               const VertexBuffer *vb, const unsigned int *indices,
+               size_t count)
+{
+  if (count == 0)
+    return;
+
+  PointSprite *sprites = malloc (count * sizeof (PointSprite));
+  if (!sprites)
+    return;
+
+  bool sized = vb->layout.components[ATTR_POINT_SIZE] > 0;
+  bool round = state->point_round;
+  ClipSetup clip = clip_setup (fb, state, vb);
+  Vec4f_t *positions = vertex_stage (vb, &clip);
+  int tiles_x = (fb->vinfo.xres + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles_y = (fb->vinfo.yres + TILE_SIZE - 1) / TILE_SIZE;
+  size_t tile_count = (size_t)tiles_x * tiles_y;
+
+  /* sprite setup, with the tile references counted per bin */
+  uint32_t *bins = calloc (tile_count + 1, sizeof (uint32_t));
+  size_t sprite_count = 0;
+  size_t refs = 0;
+
+  for (size_t i = 0; i < count; ++i)
+    {
+      uint32_t index = indices ? indices[i] : (uint32_t)i;
+      if (index >= vb->vertex_count)
+        continue;
+
+      /*
+       * points are kept or dropped whole, and only by depth: a sprite whose
+       * center is off screen can still reach into it
+       */
+      PostVertex pv;
+      post_vertex_make (fb, vb, &clip, index, &pv);
+      if (!pv.valid || (pv.outcode & CLIP_NEAR_FAR))
+        continue;
+      Pixel_t p = pv.pixel;
+
+      float size = state->point_size;
+      if (sized)
+        {
+          float attr[4];
+          attribute_read (vb, ATTR_POINT_SIZE, index, attr);
+          size = attr[0];
+        }
+
+      PointSprite *s = &sprites[sprite_count];
+      if (!point_sprite_make (fb, p, size, round, s))
+        continue;
+      sprite_count++;
+
+      if (!bins)
+        continue;
+
+      for (int ty = s->y0 / TILE_SIZE; ty <= s->y1 / TILE_SIZE; ++ty)
+        for (int tx = s->x0 / TILE_SIZE; tx <= s->x1 / TILE_SIZE; ++tx)
+          {
+            bins[(size_t)ty * tiles_x + tx + 1]++;
+            refs++;
+          }
+    }
+  free (positions);
+
+  PointSprite *binned = bins ? malloc (refs * sizeof (PointSprite)) : NULL;
+
+  /* without memory for the bins, draw the sprites in order unbinned */
+  if (!binned)
+    {
+      for (size_t i = 0; i < sprite_count; ++i)
+        raster_sprite (fb, state, &sprites[i], round, 0, 0,
+                       fb->vinfo.xres - 1, fb->vinfo.yres - 1);
+      free (bins);
+      free (sprites);
+      return;
+    }
+
+  /* bins[t] becomes the offset of tile t, then advances while scattering */
+  for (size_t t = 1; t <= tile_count; ++t)
+    bins[t] += bins[t - 1];
+
+  for (size_t i = 0; i < sprite_count; ++i)
+    {
+      const PointSprite *s = &sprites[i];
+      for (int ty = s->y0 / TILE_SIZE; ty <= s->y1 / TILE_SIZE; ++ty)
+        for (int tx = s->x0 / TILE_SIZE; tx <= s->x1 / TILE_SIZE; ++tx)
+          binned[bins[(size_t)ty * tiles_x + tx]++] = *s;
+    }
+  free (sprites);
+
+  /* after the scatter bins[t] is the end of tile t and the start of t + 1 */
+  uint32_t start = 0;
+  for (size_t t = 0; t < tile_count; ++t)
+    {
+      int tx0 = (int)(t % tiles_x) * TILE_SIZE;
+      int ty0 = (int)(t / tiles_x) * TILE_SIZE;
+      int tx1 = min2i (tx0 + TILE_SIZE, fb->vinfo.xres) - 1;
+      int ty1 = min2i (ty0 + TILE_SIZE, fb->vinfo.yres) - 1;
+
+      for (uint32_t k = start; k < bins[t]; ++k)
+        raster_sprite (fb, state, &binned[k], round, tx0, ty0, tx1, ty1);
+      start = bins[t];
+    }
+
+  free (binned);
+  free (bins);
+}
+
+/*
+ * range of steps [*first, *last] of a line whose minor axis coordinate
+ * m0 + dir * q(i) stays inside [lo, hi]. q(i) = floor ((2 i a + n) / 2n)
+ * is the minor offset after i of n steps for a minor extent of a, which
+ * rounds the ideal line to the nearest pixel with ties going up.
+ */
+static void
+line_minor_range (int64_t m0, int dir, int64_t a, int64_t n, int64_t lo,
+                  int64_t hi, int64_t *first, int64_t *last)
+{
+  /* offsets q allowed by the bounds */
+  int64_t qlo = dir > 0 ? lo - m0 : m0 - hi;
+  int64_t qhi = dir > 0 ? hi - m0 : m0 - lo;
+
+  if (a == 0)
+    {
+      /* the minor coordinate never moves */
+      if (qlo > 0 || qhi < 0)
+        *first = n + 1, *last = -1;
+      else
+        *first = 0, *last = n;
+      return;
+    }
+
+  /* q(i) >= qlo from i = ceil ((2 n qlo - n) / 2a) */
+  int64_t num = 2 * n * qlo - n;
+  *first = num <= 0 ? 0 : (num + 2 * a - 1) / (2 * a);
+
+  /* q(i) <= qhi up to ceil ((2 n (qhi + 1) - n) / 2a) - 1 */
+  num = 2 * n * (qhi + 1) - n;
+  *last = num <= 0 ? -1 : (num + 2 * a - 1) / (2 * a) - 1;
+}
+
+/* color from 16.16 fixed-point channels */
+static inline Color8_t
+line_color (const int32_t *cf)
+{
+  return (Color8_t){ (uint8_t)(cf[0] >> FIXED_SHIFT),
+                     (uint8_t)(cf[1] >> FIXED_SHIFT),
+                     (uint8_t)(cf[2] >> FIXED_SHIFT),
+                     (uint8_t)(cf[3] >> FIXED_SHIFT) };
+}
+
+/*
+ * run the fragment function of state on pixel pos with the count varyings
+ * var, as a batch of one for a fragment_batch function. c holds the vertex
+ * color and receives the result; returns false if the pixel was discarded.
+ */
+static bool
+fragment_shade_one (const DrawState *state, Vec2i_t pos, float depth,
+                    const float *var, uint32_t count, Color8_t *c)
+{
+  if (!state->fragment_batch)
+    {
+      Fragment frag = { pos, depth, *c, var, count };
+      return state->fragment_func (&frag, state->fragment_data, c);
+    }
+
+  FragmentBatch b;
+  memset (&b, 0, sizeof (b));
+  b.depth[0] = depth;
+  for (uint32_t i = 0; i < count; ++i)
+    b.varyings[i][0] = var[i];
+  b.color[0] = *c;
+  b.x = pos.x;
+  b.y = pos.y;
+  b.count = 1;
+  b.mask = 1;
+  b.components = count;
+
+  state->fragment_batch (&b, state->fragment_data);
+  *c = b.color[0];
+  return b.mask & 1u;
+}
+
+/*
+ * run the fragment function of state on pixel p of a line, f of the way
+ * from its first endpoint to its second, with the varyings interpolated
+ * linearly. p->color holds the vertex color and receives the result;
+ * returns false if the pixel was discarded.
+ */
+static inline bool
+line_fragment (const DrawState *state, const PrimVaryings *var, float f,
+               Pixel_t *p)
+{
+  float v[CLIP_MAX_VARYINGS];
+  uint32_t count = var ? var->count : 0;
+  for (uint32_t i = 0; i < count; ++i)
+    v[i] = var->v[0][i] + (var->v[1][i] - var->v[0][i]) * f;
+
+  return fragment_shade_one (state, p->pos, p->depth, v, count, &p->color);
+}
+
+/*
+ * draw a line from the distance of pixel centers to it, for wide and smooth
+ * lines. the band of pixels the line can reach is walked along its major
+ * axis; for every major coordinate the minor coordinates within reach form
+ * one run, whose coverages are evaluated LINE_BATCH at a time in a
+ * branch-free loop over the signed distance across the line and the
+ * position along it, which the compiler can vectorize.
+ *
+ * smooth lines get a one pixel wide box filter across the line edges and at
+ * the butt ends, so a one pixel line spreads over two pixels the way Wu's
+ * algorithm does; aliased wide lines cover pixel centers within half the
+ * width.
+ */
+static void
+raster_line_coverage (Framebuffer *fb, const DrawState *state, Pixel_t p0,
+                      Pixel_t p1, const PrimVaryings *var)
+{
+  float inv_sub = 1.0f / SUBPIXEL_ONE;
+  float ax = p0.pos.x + p0.sub.x * inv_sub;
+  float ay = p0.pos.y + p0.sub.y * inv_sub;
+  float dx = (p1.pos.x + p1.sub.x * inv_sub) - ax;
+  float dy = (p1.pos.y + p1.sub.y * inv_sub) - ay;
+
+  float len = sqrtf (dx * dx + dy * dy);
+  if (len < inv_sub)
+    {
+      if (!fragment_stage (state) || line_fragment (state, var, 0.0f, &p0))
+        write_fragment (fb, state, p0);
+      return;
+    }
+
+  float ux = dx / len;
+  float uy = dy / len;
+
+  bool smooth = state->line_smooth;
+  float half = fmax2f (state->line_width, 1.0f) * 0.5f;
+  float reach = smooth ? half + 0.5f : half;
+
+  bool x_major = math_absf (dx) >= math_absf (dy);
+  float am = x_major ? ax : ay;
+  float an = x_major ? ay : ax;
+  float dm = x_major ? dx : dy;
+  float dn = x_major ? dy : dx;
+  int major_size = x_major ? fb->vinfo.xres : fb->vinfo.yres;
+  int minor_size = x_major ? fb->vinfo.yres : fb->vinfo.xres;
+
+  /* minor half-extent of the band and its drift per major step */
+  float slope = dn / dm;
+  float extent = reach * len / math_absf (dm);
+
+  /* signed distance and position along the line per minor step */
+  float ds = x_major ? -ux : uy;
+  float dt = x_major ? uy : ux;
+
+  float mlo = fmin2f (am, am + dm) - reach;
+  float mhi = fmax2f (am, am + dm) + reach;
+  int m0 = max2i (0, math_ceilf_to_int (mlo - 0.5f));
+  int m1 = min2i (major_size - 1, math_floorf_to_int (mhi - 0.5f));
+
+  float cov[LINE_BATCH];
+  float along[LINE_BATCH];
+
+  for (int m = m0; m <= m1; ++m)
+    {
+      float mc = m + 0.5f;
+      float nc = an + (mc - am) * slope;
+      int n0 = max2i (0, math_ceilf_to_int (nc - extent - 0.5f));
+      int n1 = min2i (minor_size - 1, math_floorf_to_int (nc + extent - 0.5f));
+
+      for (int nb = n0; nb <= n1; nb += LINE_BATCH)
+        {
+          int count = min2i (LINE_BATCH, n1 - nb + 1);
+
+          /* distance across (s) and along (t) the line at the first pixel */
+          float px = x_major ? mc : nb + 0.5f;
+          float py = x_major ? nb + 0.5f : mc;
+          float s0 = (px - ax) * uy - (py - ay) * ux;
+          float t0 = (px - ax) * ux + (py - ay) * uy;
+
+          for (int k = 0; k < count; ++k)
+            {
+              float s = math_absf (s0 + ds * k);
+              float t = t0 + dt * k;
+              float end = fmin2f (t, len - t);
+              float across = smooth ? clampf (reach - s, 0.0f, 1.0f)
+                                    : (float)(s < half);
+              float ends = smooth ? clampf (end + 0.5f, 0.0f, 1.0f)
+                                  : (float)(end >= 0.0f);
+              cov[k] = across * ends;
+              along[k] = clampf (t / len, 0.0f, 1.0f);
+            }
+
+          for (int k = 0; k < count; ++k)
+            {
+              if (cov[k] <= 0.0f)
+                continue;
+
+              float f = along[k];
+              Pixel_t p = { 0 };
+              p.pos.x = x_major ? m : nb + k;
+              p.pos.y = x_major ? nb + k : m;
+              p.depth = p0.depth + (p1.depth - p0.depth) * f;
+              p.color.r = (uint8_t)(p0.color.r + (p1.color.r - p0.color.r) * f);
+              p.color.g = (uint8_t)(p0.color.g + (p1.color.g - p0.color.g) * f);
+              p.color.b = (uint8_t)(p0.color.b + (p1.color.b - p0.color.b) * f);
+              p.color.a = (uint8_t)(p0.color.a + (p1.color.a - p0.color.a) * f);
+
+              if (fragment_stage (state) && !line_fragment (state, var, f, &p))
+                continue;
+
+              if (cov[k] >= 1.0f)
+                write_fragment (fb, state, p);
+              else
+                blend_fragment (fb, state, p.pos.x, p.pos.y, p.depth,
+                                p.color, cov[k]);
+            }
+        }
+    }
+}
+
+/*
+ * draw the line p0 p1, both endpoints included.
+ *
+ * the line is a DDA along its major axis with an integer error term for
+ * the minor one, which lets it be clipped exactly: the first and last steps
+ * inside the framebuffer are solved for up front and stepping starts there,
+ * so off-screen parts cost nothing. colors step in 16.16 and depth in 32.32
+ * fixed point. on 32-bit single-sample framebuffers the pixels are written
+ * through color and depth pointers that advance by a constant stride along
+ * the major axis, so runs need no per-pixel addressing or bounds checks;
+ * other framebuffers, and lines with a fragment function, go through
+ * write_fragment.
+ */
+static void
+raster_line (Framebuffer *fb, const DrawState *state, Pixel_t p0, Pixel_t p1,
+             const PrimVaryings *var)
+{
+  if (state->line_smooth || state->line_width > 1.0f)
+    {
+      raster_line_coverage (fb, state, p0, p1, var);
+      return;
+    }
+
+  int64_t dx = (int64_t)p1.pos.x - p0.pos.x;
+  int64_t dy = (int64_t)p1.pos.y - p0.pos.y;
+  int64_t adx = dx < 0 ? -dx : dx;
+  int64_t ady = dy < 0 ? -dy : dy;
+
+  bool x_major = adx >= ady;
+  int64_t n = x_major ? adx : ady;     /* steps */
+  int64_t a = x_major ? ady : adx;     /* minor extent */
+  int sx = dx < 0 ? -1 : 1;
+  int sy = dy < 0 ? -1 : 1;
+
+  int64_t w = fb->vinfo.xres;
+  int64_t h = fb->vinfo.yres;
+
+  /* steps with the major coordinate inside the framebuffer */
+  int64_t first = 0;
+  int64_t last = n;
+  int64_t major0 = x_major ? p0.pos.x : p0.pos.y;
+  int64_t major_size = x_major ? w : h;
+  int major_dir = x_major ? sx : sy;
+
+  int64_t lo = major_dir > 0 ? -major0 : major0 - (major_size - 1);
+  int64_t hi = major_dir > 0 ? major_size - 1 - major0 : major0;
+  if (lo > first)
+    first = lo;
+  if (hi < last)
+    last = hi;
+
+  /* and with the minor coordinate inside */
+  int64_t mfirst, mlast;
+  if (x_major)
+    line_minor_range (p0.pos.y, sy, a, n, 0, h - 1, &mfirst, &mlast);
+  else
+    line_minor_range (p0.pos.x, sx, a, n, 0, w - 1, &mfirst, &mlast);
+  if (mfirst > first)
+    first = mfirst;
+  if (mlast < last)
+    last = mlast;
+
+  if (first > last)
+    return;
+
+  /* minor offset and error term at the first step */
+  int64_t r = 2 * first * a + n;
+  int64_t q = n > 0 ? r / (2 * n) : 0;
+  r -= q * 2 * n;
+
+  int x = (int)(p0.pos.x + (x_major ? first * sx : q * sx));
+  int y = (int)(p0.pos.y + (x_major ? q * sy : first * sy));
+
+  /* per-step increments of the interpolants */
+  int64_t div = n > 0 ? n : 1;
+  int32_t c[4] = { p0.color.r, p0.color.g, p0.color.b, p0.color.a };
+  int32_t c1[4] = { p1.color.r, p1.color.g, p1.color.b, p1.color.a };
+  int32_t cf[4], dc[4];
+  bool flat = true;
+  for (int k = 0; k < 4; ++k)
+    {
+      dc[k] = (int32_t)(((int64_t)(c1[k] - c[k]) << FIXED_SHIFT) / div);
+      cf[k] = (c[k] << FIXED_SHIFT) + FIXED_ONE / 2 + dc[k] * (int32_t)first;
+      flat = flat && dc[k] == 0;
+    }
+
+  int64_t dz = (int64_t)((double)(p1.depth - p0.depth) * LINE_DEPTH_ONE
+                         / (double)div);
+  int64_t zf = (int64_t)((double)p0.depth * LINE_DEPTH_ONE) + dz * first;
+
+  int64_t count = last - first + 1;
+  int64_t step2a = 2 * a;
+  int64_t step2n = 2 * n;
+
+  bool direct = fb->vinfo.bits_per_pixel == 32 && fb->samples <= 1
+                && !fragment_stage (state);
+
+  if (!direct)
+    {
+      float inv_n = 1.0f / (float)div;
+      for (int64_t i = first;; ++i)
+        {
+          Pixel_t p = { 0 };
+          p.pos = (Vec2i_t){ x, y };
+          p.depth = (float)((double)zf / LINE_DEPTH_ONE);
+          p.color = line_color (cf);
+          if (!fragment_stage (state)
+              || line_fragment (state, var, (float)i * inv_n, &p))
+            write_fragment (fb, state, p);
+
+          if (--count == 0)
+            break;
+
+          for (int k = 0; k < 4; ++k)
+            cf[k] += dc[k];
+          zf += dz;
+          r += step2a;
+          if (r >= step2n)
+            {
+              r -= step2n;
+              if (x_major)
+                y += sy;
+              else
+                x += sx;
+            }
+          if (x_major)
+            x += sx;
+          else
+            y += sy;
+        }
+      return;
+    }
+
+  /* pointer strides along the major and minor axes */
+  ptrdiff_t line = (ptrdiff_t)fb->finfo.line_length;
+  ptrdiff_t c_major = x_major ? sx * 4 : sy * line;
+  ptrdiff_t c_minor = x_major ? sy * line : sx * 4;
+  ptrdiff_t d_major = x_major ? sx : sy * (ptrdiff_t)w;
+  ptrdiff_t d_minor = x_major ? sy * (ptrdiff_t)w : sx;
+
+  uint8_t *cp = fb->back_buffer + (ptrdiff_t)y * line + (ptrdiff_t)x * 4;
+  float *dp = fb->depth_buffer
+                  ? fb->depth_buffer + (ptrdiff_t)y * w + x
+                  : NULL;
+
+  uint32_t packed = fb_pack (fb, p0.color);
+
+  for (;;)
+    {
+      float z = (float)((double)zf / LINE_DEPTH_ONE);
+
+      if (!dp || depth_test (state->depth_func, z, *dp))
+        {
+          if (state->color_write)
+            {
+              if (!flat)
+                packed = fb_pack (fb, line_color (cf));
+              memcpy (cp, &packed, 4);
+            }
+
+          if (dp && state->depth_write)
+            {
+              *dp = z;
+              if (fb->hiz_buffer)
+                hiz_add_writes (fb, x, y, 1, z);
+            }
+        }
+
+      /* stop before the pointers leave the framebuffer */
+      if (--count == 0)
+        break;
+
+      for (int k = 0; k < 4; ++k)
+        cf[k] += dc[k];
+      zf += dz;
+
+      cp += c_major;
+      if (dp)
+        dp += d_major;
+      if (x_major)
+        x += sx;
+      else
+        y += sy;
+
+      r += step2a;
+      if (r >= step2n)
+        {
+          r -= step2n;
+          cp += c_minor;
+          if (dp)
+            dp += d_minor;
+          if (x_major)
+            y += sy;
+          else
+            x += sx;
+        }
+    }
+}
+
+void
+draw_line (Framebuffer *fb, Pixel_t p0, Pixel_t p1)
+{
+  raster_line (fb, &default_state, p0, p1, NULL);
+}
+
+void
+draw_triangle_wireframe (Framebuffer *fb, Pixel_t p0, Pixel_t p1, Pixel_t p2)
+{
+  /* draw edges of the triangle */
+  draw_line (fb, p0, p1);
+  draw_line (fb, p1, p2);
+  draw_line (fb, p2, p0);
+}
+
+/*
+ * returns the 2d cross product which is twice the area of the triangle abc.
+ * the sign tells which side of edge ab the point c lies on.
  * if the 2d cross product is 0 then it means the point lies on the line.
+ * 28.4 inputs give a result with 8 fractional bits, so it is done in 64 bits.
  * */
-static inline int
+static inline int64_t
 edge_func (Vec2i_t a, Vec2i_t b, Vec2i_t c)
 {
-  Vec2i_t ab = vec2i_delta (a, b);
-  Vec2i_t ac = vec2i_delta (a, c);
-  return ab.x * ac.y - ab.y * ac.x;
+  Vec2i_t ab = vec2i_delta (a, b);
+  Vec2i_t ac = vec2i_delta (a, c);
+  return (int64_t)ab.x * ac.y - (int64_t)ab.y * ac.x;
+}
+
+/* block classification results for hierarchical traversal */
+typedef enum
+{
+  BLOCK_OUTSIDE,
+  BLOCK_PARTIAL,
+  BLOCK_INSIDE
+} BlockCoverage;
+
+/*
+ * edge function ab written as a plane equation a * x + b * y + c over integer
+ * pixel coordinates, so it can be evaluated at any pixel center and stepped
+ * incrementally along rows and columns.
+ */
+typedef struct
+{
+  int64_t a; /* change per pixel in x */
+  int64_t b; /* change per pixel in y */
+  int64_t c; /* value at the center of pixel (0, 0) */
+} EdgeEq;
+
+/* per-triangle state shared by every block of the traversal */
+typedef struct
+{
+  const DrawState *state;
+  const RasterVariant *raster; /* rect and small triangle functions */
+  EdgeEq  e[3];      /* edges v0v1, v1v2, v2v0 */
+  int64_t bias[3];   /* fill rule or conservative offset in each edge's c */
+  float   inv_area;  /* 1 / twice the area, for barycentrics */
+  float   z0;        /* depth at v0 */
+  float   dz10;      /* depth change from v0 to v1 */
+  float   dz20;      /* depth change from v0 to v2 */
+  float   dzdx;      /* depth change per pixel in x */
+  float   dzdy;      /* depth change per pixel in y */
+  float   zmin;      /* nearest vertex depth */
+  float   zmax;      /* farthest vertex depth */
+  bool    clamp;     /* keep attributes of pixels outside the triangle in range */
+  float   zfar;      /* farthest depth a write can leave, for Hi-Z */
+  float   q[3];      /* 1 / w per vertex, all 1 for affine interpolation */
+  bool    wire;      /* blend state->wire_color along the edges */
+  float   wire_reach; /* pixels from an edge that still get some edge color */
+  float   edge_scale[3]; /* pixels per unit of each edge value */
+  Pixel_t v[3];      /* vertices in counter-clockwise screen order */
+  bool    fragment;  /* color pixels by a fragment function */
+  bool    batch;     /* by state->fragment_batch, FRAGMENT_BATCH at a time */
+  const float *var[3]; /* varyings of v[0], v[1] and v[2] */
+  uint32_t varying_count; /* floats in each of var */
+  uint32_t samples;  /* samples per pixel, 1 without multisampling */
+  int     margin;    /* pixels around a block whose samples may reach it */
+  int64_t sample_dw[FB_MAX_SAMPLES][3]; /* edge value offset per sample */
+  int64_t sample_reach[3];              /* largest |sample_dw| per edge */
+  float   sample_dz[FB_MAX_SAMPLES];    /* depth offset per sample */
+} TriangleSetup;
+
+/* rasterizers for rects of pixels and for small triangles */
+struct RasterVariant
+{
+  int (*rect) (Framebuffer *fb, const TriangleSetup *t, int x0, int y0,
+               int x1, int y1, bool test_edges);
+  void (*small) (Framebuffer *fb, const TriangleSetup *t, int xmin, int ymin,
+                 int xmax, int ymax);
+};
+
+/* 28.4 fixed-point position of a vertex */
+static inline Vec2i_t
+pixel_fixed_pos (const Pixel_t *p)
+{
+  return (Vec2i_t){ p->pos.x * SUBPIXEL_ONE + p->sub.x,
+                    p->pos.y * SUBPIXEL_ONE + p->sub.y };
+}
+
+/*
+ * build the equation of edge ab from 28.4 positions, sampled at pixel
+ * centers.
+ *
+ * (the fill rule only applies without conservative rasterization, see
+ * edge_eq_conservative.)
+ *
+ * top-left fill rule: a pixel center exactly on an edge belongs to the
+ * triangle only if the edge is a left edge (inside lies towards +x) or a
+ * top edge (horizontal with inside below). other edges get a bias of 1 so
+ * their zero values fail the >= 0 test, and a pixel on an edge shared by two
+ * triangles is drawn exactly once.
+ */
+static inline EdgeEq
+edge_eq_make (Vec2i_t a, Vec2i_t b, int64_t *bias)
+{
+  int64_t ea = (int64_t)a.y - b.y;
+  int64_t eb = (int64_t)b.x - a.x;
+
+  bool top_left = ea > 0 || (ea == 0 && eb > 0);
+  *bias = top_left ? 0 : 1;
+
+  /* value at the center of pixel (0, 0), which is at (0.5, 0.5) */
+  int64_t half = SUBPIXEL_ONE / 2;
+
+  EdgeEq e;
+  e.a = ea * SUBPIXEL_ONE;
+  e.b = eb * SUBPIXEL_ONE;
+  e.c = ea * (half - a.x) + eb * (half - a.y) - *bias;
+  return e;
+}
+
+/* squared length of the edge from a to b, in 1/SUBPIXEL_ONE pixel units */
+static inline double
+edge_length2 (Vec2i_t a, Vec2i_t b)
+{
+  double dx = (double)b.x - a.x;
+  double dy = (double)b.y - a.y;
+  return dx * dx + dy * dy;
+}
+
+/*
+ * move edge e by half a pixel's extent along its normal for conservative
+ * rasterization. over the pixel square the edge value ranges over the
+ * center value plus or minus (|a| + |b|) / 2, so testing the center against
+ * the shifted edge tells whether any point of the square (CONSERVATIVE_OVER)
+ * or all of it (CONSERVATIVE_UNDER) is inside. touching counts, so the fill
+ * rule bias is dropped; bias keeps the shift so barycentrics can still
+ * take it back out.
+ */
+static inline void
+edge_eq_conservative (EdgeEq *e, int64_t *bias, ConservativeMode mode)
+{
+  int64_t shift = ((e->a < 0 ? -e->a : e->a) + (e->b < 0 ? -e->b : e->b)) / 2;
+
+  e->c += *bias;
+  *bias = mode == CONSERVATIVE_OVER ? -shift : shift;
+  e->c -= *bias;
+}
+
+static inline int64_t
+edge_eq_eval (const EdgeEq *e, int x, int y)
+{
+  return e->a * x + e->b * y + e->c;
+}
+
+/*
+ * classify the size x size block whose top-left pixel is (x, y).
+ * an edge equation is linear, so its extremes over the block are at the
+ * corners: the corner picked by the signs of a and b gives the largest value
+ * (if that is negative the whole block is outside) and the opposite corner
+ * gives the smallest (if that is not negative the block is inside the edge).
+ * with multisampling the block grows by the margin, so the verdict holds for
+ * samples off the pixel centers too.
+ */
+static inline BlockCoverage
+classify_block (const TriangleSetup *t, int x, int y, int size)
+{
+  BlockCoverage result = BLOCK_INSIDE;
+  x -= t->margin;
+  y -= t->margin;
+  int extent = size - 1 + 2 * t->margin;
+
+  for (int i = 0; i < 3; ++i)
+    {
+      const EdgeEq *e = &t->e[i];
+      int64_t corner = edge_eq_eval (e, x, y);
+      int64_t dx = e->a * extent;
+      int64_t dy = e->b * extent;
+
+      int64_t max = corner + (dx > 0 ? dx : 0) + (dy > 0 ? dy : 0);
+      int64_t min = corner + (dx < 0 ? dx : 0) + (dy < 0 ? dy : 0);
+
+      if (max < 0)
+        return BLOCK_OUTSIDE;
+      if (min < 0)
+        result = BLOCK_PARTIAL;
+    }
+
+  return result;
+}
+
+/*
+ * blend the wireframe color over c by how much of the pixel lies within the
+ * edge band. e0, e1 and e2 are the unbiased edge values opposite v0, v1 and
+ * v2; scaled they are the pixel's distance to each edge. the band is wide
+ * enough inside the triangle for half the wire, with one pixel of falloff.
+ */
+static inline Color8_t
+wire_blend (const TriangleSetup *t, float e0, float e1, float e2, Color8_t c)
+{
+  float d = fmin3f (e0 * t->edge_scale[1], e1 * t->edge_scale[2],
+                    e2 * t->edge_scale[0]);
+  float cover = clampf (t->wire_reach - d, 0.0f, 1.0f);
+  if (cover <= 0.0f)
+    return c;
+
+  Color8_t w = t->state->wire_color;
+  c.r = (uint8_t)(c.r + (w.r - c.r) * cover + 0.5f);
+  c.g = (uint8_t)(c.g + (w.g - c.g) * cover + 0.5f);
+  c.b = (uint8_t)(c.b + (w.b - c.b) * cover + 0.5f);
+  c.a = (uint8_t)(c.a + (w.a - c.a) * cover + 0.5f);
+  return c;
+}
+
+/*
+ * run the fragment function on pixel (x, y) of a triangle, with the
+ * varyings interpolated by the normalized perspective weights p0, p1 and
+ * p2. c holds the vertex color and receives the result; returns false if
+ * the pixel was discarded.
+ */
+static inline bool
+shade_fragment (const TriangleSetup *t, int x, int y, float depth, float p0,
+                float p1, float p2, Color8_t *c)
+{
+  float var[CLIP_MAX_VARYINGS];
+  for (uint32_t i = 0; i < t->varying_count; ++i)
+    var[i] = p0 * t->var[0][i] + p1 * t->var[1][i] + p2 * t->var[2][i];
+
+  return fragment_shade_one (t->state, (Vec2i_t){ x, y }, depth, var,
+                             t->varying_count, c);
+}
+
+/*
+ * interpolate and draw one covered pixel from its edge function values,
+ * returns true if its depth was stored.
+ *
+ * depth (z/w) is linear in screen space and uses the plain barycentrics. it
+ * is interpolated and tested first, so pixels failing the depth test never
+ * pay for colors. colors are linear in clip space, so each barycentric is
+ * weighted by its vertex 1/w and renormalized; the reciprocal is taken once
+ * per pixel.
+ */
+static inline bool
+shade_pixel (Framebuffer *fb, const TriangleSetup *t, int x, int y,
+             int64_t w0, int64_t w1, int64_t w2)
+{
+  const DrawState *state = t->state;
+
+  /* unnormalized barycentrics, with the fill rule bias taken back out */
+  float e0 = (float)(w1 + t->bias[1]);
+  float e1 = (float)(w2 + t->bias[2]);
+  float e2 = (float)(w0 + t->bias[0]);
+
+  /* depth interpolation and early depth test */
+  float depth = t->z0 + (e1 * t->dz10 + e2 * t->dz20) * t->inv_area;
+
+  /* conservative pixels may have their center outside the triangle */
+  if (t->clamp)
+    {
+      depth = clampf (depth, t->zmin, t->zmax);
+      e0 = fmax2f (e0, 0.0f);
+      e1 = fmax2f (e1, 0.0f);
+      e2 = fmax2f (e2, 0.0f);
+    }
+
+  float *stored = NULL;
+  if (fb->depth_buffer)
+    {
+      stored = &fb->depth_buffer[(size_t)y * fb->vinfo.xres + x];
+      if (!depth_test (state->depth_func, depth, *stored))
+        return false;
+    }
+
+  if (state->color_write || t->fragment)
+    {
+      const Pixel_t *v0 = &t->v[0];
+      const Pixel_t *v1 = &t->v[1];
+      const Pixel_t *v2 = &t->v[2];
+
+      /* perspective-correct weights */
+      float p0 = e0 * t->q[0];
+      float p1 = e1 * t->q[1];
+      float p2 = e2 * t->q[2];
+      float inv = 1.0f / (p0 + p1 + p2);
+      p0 *= inv;
+      p1 *= inv;
+      p2 *= inv;
+
+      /* color interpolation */
+      Color8_t c;
+      c.r = (uint8_t)(p0 * v0->color.r + p1 * v1->color.r + p2 * v2->color.r);
+      c.g = (uint8_t)(p0 * v0->color.g + p1 * v1->color.g + p2 * v2->color.g);
+      c.b = (uint8_t)(p0 * v0->color.b + p1 * v1->color.b + p2 * v2->color.b);
+      c.a = (uint8_t)(p0 * v0->color.a + p1 * v1->color.a + p2 * v2->color.a);
+
+      if (t->fragment && !shade_fragment (t, x, y, depth, p0, p1, p2, &c))
+        return false;
+
+      if (t->wire)
+        c = wire_blend (t, e0, e1, e2, c);
+
+      if (state->color_write)
+        set_pixel (fb, (Vec2i_t){ x, y }, c);
+    }
+
+  if (!stored || !state->depth_write)
+    return false;
+
+  *stored = depth;
+  return true;
+}
+
+/*
+ * multisampled version of shade_pixel. coverage and depth are tested per
+ * sample from the pixel center values plus the per-sample offsets, color is
+ * interpolated once at the center. when the center itself is outside the
+ * triangle the barycentrics are clamped, so the color stays within the
+ * vertex colors instead of being extrapolated. all_covered skips the
+ * coverage tests for pixels the caller proved inside.
+ */
+static inline bool
+shade_pixel_msaa (Framebuffer *fb, const TriangleSetup *t, int x, int y,
+                  int64_t w0, int64_t w1, int64_t w2, bool all_covered)
+{
+  const DrawState *state = t->state;
+  uint32_t n = t->samples;
+  uint32_t pass = (1u << n) - 1u;
+
+  if (!all_covered)
+    {
+      for (uint32_t k = 0; k < n; ++k)
+        {
+          const int64_t *dw = t->sample_dw[k];
+          if (((w0 + dw[0]) | (w1 + dw[1]) | (w2 + dw[2])) < 0)
+            pass &= ~(1u << k);
+        }
+      if (!pass)
+        return false;
+    }
+
+  float e0 = (float)(w1 + t->bias[1]);
+  float e1 = (float)(w2 + t->bias[2]);
+  float e2 = (float)(w0 + t->bias[0]);
+
+  float depth = t->z0 + (e1 * t->dz10 + e2 * t->dz20) * t->inv_area;
+
+  float *stored = NULL;
+  if (fb->depth_buffer)
+    {
+      stored = &fb->depth_buffer[((size_t)y * fb->vinfo.xres + x) * n];
+      for (uint32_t k = 0; k < n; ++k)
+        {
+          if ((pass & (1u << k))
+              && !depth_test (state->depth_func, depth + t->sample_dz[k],
+                              stored[k]))
+            pass &= ~(1u << k);
+        }
+      if (!pass)
+        return false;
+    }
+
+  if (state->color_write || t->fragment)
+    {
+      const Pixel_t *v0 = &t->v[0];
+      const Pixel_t *v1 = &t->v[1];
+      const Pixel_t *v2 = &t->v[2];
+
+      float p0 = fmax2f (e0, 0.0f) * t->q[0];
+      float p1 = fmax2f (e1, 0.0f) * t->q[1];
+      float p2 = fmax2f (e2, 0.0f) * t->q[2];
+      float inv = 1.0f / (p0 + p1 + p2);
+      p0 *= inv;
+      p1 *= inv;
+      p2 *= inv;
+
+      Color8_t c;
+      c.r = (uint8_t)(p0 * v0->color.r + p1 * v1->color.r + p2 * v2->color.r);
+      c.g = (uint8_t)(p0 * v0->color.g + p1 * v1->color.g + p2 * v2->color.g);
+      c.b = (uint8_t)(p0 * v0->color.b + p1 * v1->color.b + p2 * v2->color.b);
+      c.a = (uint8_t)(p0 * v0->color.a + p1 * v1->color.a + p2 * v2->color.a);
+
+      if (t->fragment && !shade_fragment (t, x, y, depth, p0, p1, p2, &c))
+        return false;
+
+      if (t->wire)
+        c = wire_blend (t, e0, e1, e2, c);
+
+      if (state->color_write)
+        write_samples (fb, x, y, pass, c);
+    }
+
+  if (!stored || !state->depth_write)
+    return false;
+
+  for (uint32_t k = 0; k < n; ++k)
+    {
+      if (pass & (1u << k))
+        stored[k] = depth + t->sample_dz[k];
+    }
+  return true;
+}
+
+/* mask bit of each slot of a FragmentBatch */
+static const uint32_t slot_bits[FRAGMENT_BATCH] = { 1u << 0, 1u << 1, 1u << 2,
+                                                    1u << 3, 1u << 4, 1u << 5,
+                                                    1u << 6, 1u << 7 };
+
+/*
+ * copy the n items of size bytes of a run from a buffer row into an array
+ * of FRAGMENT_BATCH, zeroing the slots past the run, so the loops over the
+ * array need no tail. a full run is a copy of constant size.
+ */
+static inline void
+batch_load (void *slots, const void *row, int n, size_t size)
+{
+  if (n == FRAGMENT_BATCH)
+    {
+      memcpy (slots, row, FRAGMENT_BATCH * size);
+      return;
+    }
+  memset (slots, 0, FRAGMENT_BATCH * size);
+  memcpy (slots, row, (size_t)n * size);
+}
+
+/* and the n first slots back into the row */
+static inline void
+batch_store (void *row, const void *slots, int n, size_t size)
+{
+  if (n == FRAGMENT_BATCH)
+    memcpy (row, slots, FRAGMENT_BATCH * size);
+  else
+    memcpy (row, slots, (size_t)n * size);
+}
+
+/*
+ * true if the edge values v + a * k of the slots of a batch, and the steps
+ * a * k to them, all fit in an int32_t
+ */
+static inline bool
+edge_run_fits_32 (int64_t v, int64_t a)
+{
+  int64_t end = v + a * (FRAGMENT_BATCH - 1);
+  int64_t reach = a * (FRAGMENT_BATCH - 1);
+  return v >= INT32_MIN && v <= INT32_MAX && end >= INT32_MIN
+         && end <= INT32_MAX && reach >= INT32_MIN && reach <= INT32_MAX;
+}
+
+/* depth_test of every slot of a batch, as the mask of the slots passing */
+static inline uint32_t
+depth_test_batch (DepthFunc func, const float *depth, const float *stored)
+{
+  uint32_t pass = 0;
+  switch (func)
+    {
+    case DEPTH_LESS:
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        pass |= depth[k] < stored[k] ? slot_bits[k] : 0u;
+      return pass;
+    case DEPTH_LESS_EQUAL:
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        pass |= depth[k] <= stored[k] ? slot_bits[k] : 0u;
+      return pass;
+    case DEPTH_EQUAL:
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        pass |= depth[k] == stored[k] ? slot_bits[k] : 0u;
+      return pass;
+    case DEPTH_ALWAYS:
+    default:
+      return (1u << FRAGMENT_BATCH) - 1u;
+    }
+}
+
+/*
+ * batched version of shade_pixel for state->fragment_batch: shade the
+ * pixels of mask among the n from (x, y) along the row, whose edge values
+ * at (x, y) are w0, w1 and w2. every step up to the call runs over all
+ * FRAGMENT_BATCH slots without branches, so the compiler can vectorize it.
+ * the depth test and the depth and color writes of an 8-bit RGB
+ * framebuffer do too, on copies of the run blended by the mask. returns
+ * the mask of pixels whose depths were stored.
+ */
+static uint32_t
+shade_batch (Framebuffer *fb, const TriangleSetup *t, int x, int y, int n,
+             int64_t w0, int64_t w1, int64_t w2, uint32_t mask)
+{
+  const DrawState *state = t->state;
+  const EdgeEq *e = t->e;
+  FragmentBatch b;
+  float e0[FRAGMENT_BATCH];
+  float e1[FRAGMENT_BATCH];
+  float e2[FRAGMENT_BATCH];
+
+  /*
+   * unnormalized barycentrics, each converted from the exact edge value of
+   * its pixel as shade_pixel does: stepped in float they drift once edge
+   * values pass 2^24, and the depths would no longer match a depth
+   * pre-pass. runs whose edge values fit in 32 bits, all but those of huge
+   * triangles, convert them a vector at a time.
+   */
+  int64_t b0 = w1 + t->bias[1];
+  int64_t b1 = w2 + t->bias[2];
+  int64_t b2 = w0 + t->bias[0];
+  if (edge_run_fits_32 (b0, e[1].a) && edge_run_fits_32 (b1, e[2].a)
+      && edge_run_fits_32 (b2, e[0].a))
+    {
+      int32_t v0 = (int32_t)b0, a0 = (int32_t)e[1].a;
+      int32_t v1 = (int32_t)b1, a1 = (int32_t)e[2].a;
+      int32_t v2 = (int32_t)b2, a2 = (int32_t)e[0].a;
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        {
+          e0[k] = (float)(v0 + a0 * k);
+          e1[k] = (float)(v1 + a1 * k);
+          e2[k] = (float)(v2 + a2 * k);
+        }
+    }
+  else
+    {
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        {
+          e0[k] = (float)(b0 + e[1].a * k);
+          e1[k] = (float)(b1 + e[2].a * k);
+          e2[k] = (float)(b2 + e[0].a * k);
+        }
+    }
+
+  /*
+   * depth and perspective-correct weights. the weights of pixels not
+   * covered are zeroed, and FLT_MIN keeps their sum from being 0 without
+   * changing any other.
+   */
+  float lo = t->clamp ? 0.0f : -FLT_MAX;
+  float p0[FRAGMENT_BATCH];
+  float p1[FRAGMENT_BATCH];
+  float p2[FRAGMENT_BATCH];
+  for (int k = 0; k < FRAGMENT_BATCH; ++k)
+    {
+      /* conservative pixels may have their center outside the triangle */
+      e0[k] = fmax2f (e0[k], lo);
+      e1[k] = fmax2f (e1[k], lo);
+      e2[k] = fmax2f (e2[k], lo);
+      b.depth[k] = t->z0 + (e1[k] * t->dz10 + e2[k] * t->dz20) * t->inv_area;
+
+      float in = (mask & slot_bits[k]) ? 1.0f : 0.0f;
+      p0[k] = e0[k] * t->q[0] * in;
+      p1[k] = e1[k] * t->q[1] * in;
+      p2[k] = e2[k] * t->q[2] * in;
+      float inv = 1.0f / (p0[k] + p1[k] + p2[k] + FLT_MIN);
+      p0[k] *= inv;
+      p1[k] *= inv;
+      p2[k] *= inv;
+    }
+
+  float *stored = NULL;
+  float z[FRAGMENT_BATCH];
+  if (fb->depth_buffer)
+    {
+      stored = &fb->depth_buffer[(size_t)y * fb->vinfo.xres + x];
+      batch_load (z, stored, n, sizeof (float));
+      mask &= depth_test_batch (state->depth_func, b.depth, z);
+      if (!mask)
+        return 0;
+    }
+
+  /* varyings and vertex colors */
+  for (uint32_t i = 0; i < t->varying_count; ++i)
+    {
+      float v0 = t->var[0][i];
+      float v1 = t->var[1][i];
+      float v2 = t->var[2][i];
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        b.varyings[i][k] = p0[k] * v0 + p1[k] * v1 + p2[k] * v2;
+    }
+
+  const Color8_t *c0 = &t->v[0].color;
+  const Color8_t *c1 = &t->v[1].color;
+  const Color8_t *c2 = &t->v[2].color;
+  for (int k = 0; k < FRAGMENT_BATCH; ++k)
+    {
+      b.color[k].r = (uint8_t)(p0[k] * c0->r + p1[k] * c1->r + p2[k] * c2->r);
+      b.color[k].g = (uint8_t)(p0[k] * c0->g + p1[k] * c1->g + p2[k] * c2->g);
+      b.color[k].b = (uint8_t)(p0[k] * c0->b + p1[k] * c1->b + p2[k] * c2->b);
+      b.color[k].a = (uint8_t)(p0[k] * c0->a + p1[k] * c1->a + p2[k] * c2->a);
+    }
+
+  b.x = x;
+  b.y = y;
+  b.count = (uint32_t)n;
+  b.mask = mask;
+  b.components = t->varying_count;
+  state->fragment_batch (&b, state->fragment_data);
+  mask &= b.mask;
+
+  if (state->color_write && !t->wire && fb_is_rgb8 (fb))
+    {
+      Rgb8Layout rgb8 = rgb8_layout (fb);
+      uint8_t *row = fb->back_buffer + (size_t)y * fb->finfo.line_length
+                     + (size_t)x * 4;
+      uint32_t px[FRAGMENT_BATCH];
+      batch_load (px, row, n, sizeof (uint32_t));
+      for (int k = 0; k < FRAGMENT_BATCH; ++k)
+        px[k] = (mask & slot_bits[k]) ? rgb8_pack (&rgb8, b.color[k]) : px[k];
+      batch_store (row, px, n, sizeof (uint32_t));
+    }
+  else if (state->color_write || t->wire)
+    {
+      for (int k = 0; k < n; ++k)
+        {
+          if (!(mask & (1u << k)))
+            continue;
+
+          Color8_t c = b.color[k];
+          if (t->wire)
+            c = wire_blend (t, e0[k], e1[k], e2[k], c);
+          if (state->color_write)
+            set_pixel (fb, (Vec2i_t){ x + k, y }, c);
+        }
+    }
+
+  if (!stored || !state->depth_write)
+    return 0;
+
+  for (int k = 0; k < FRAGMENT_BATCH; ++k)
+    z[k] = (mask & slot_bits[k]) ? b.depth[k] : z[k];
+  batch_store (stored, z, n, sizeof (float));
+  return mask;
+}
+
+/*
+ * raster_rect for state->fragment_batch: every row is handed over in runs
+ * of FRAGMENT_BATCH pixels, with the coverage of a run tested up front
+ */
+static int
+raster_rect_batch (Framebuffer *fb, const TriangleSetup *t, int x0, int y0,
+                   int x1, int y1, bool test_edges)
+{
+  const EdgeEq *e = t->e;
+  int stored = 0;
+
+  int64_t r0 = edge_eq_eval (&e[0], x0, y0);
+  int64_t r1 = edge_eq_eval (&e[1], x0, y0);
+  int64_t r2 = edge_eq_eval (&e[2], x0, y0);
+
+  for (int y = y0; y <= y1; ++y)
+    {
+      int64_t w0 = r0, w1 = r1, w2 = r2;
+
+      for (int x = x0; x <= x1; x += FRAGMENT_BATCH)
+        {
+          int n = min2i (FRAGMENT_BATCH, x1 - x + 1);
+          uint32_t mask = (1u << n) - 1u;
+          if (test_edges)
+            {
+              mask = 0;
+              for (int k = 0; k < n; ++k)
+                mask |= (uint32_t)(((w0 + e[0].a * k) | (w1 + e[1].a * k)
+                                    | (w2 + e[2].a * k))
+                                   >= 0)
+                        << k;
+            }
+          if (mask)
+            stored += popcount_32 (
+                shade_batch (fb, t, x, y, n, w0, w1, w2, mask));
+
+          w0 += e[0].a * FRAGMENT_BATCH;
+          w1 += e[1].a * FRAGMENT_BATCH;
+          w2 += e[2].a * FRAGMENT_BATCH;
+        }
+
+      r0 += e[0].b;
+      r1 += e[1].b;
+      r2 += e[2].b;
+    }
+
+  return stored;
+}
+
+/*
+ * rasterize the rectangle [x0, x1] x [y0, y1], returns the number of depths
+ * stored.
+ * when test_edges is false the caller has proven the whole rectangle is
+ * inside the triangle, so the edge tests are skipped and only the stepping
+ * of the edge values (needed for interpolation) remains.
+ */
+static inline int
+raster_rect (Framebuffer *fb, const TriangleSetup *t, int x0, int y0, int x1,
+             int y1, bool test_edges)
+{
+  if (t->batch)
+    return raster_rect_batch (fb, t, x0, y0, x1, y1, test_edges);
+
+  const EdgeEq *e = t->e;
+  bool msaa = t->samples > 1;
+  int stored = 0;
+
+  /* edge values at the first pixel of the first row */
+  int64_t r0 = edge_eq_eval (&e[0], x0, y0);
+  int64_t r1 = edge_eq_eval (&e[1], x0, y0);
+  int64_t r2 = edge_eq_eval (&e[2], x0, y0);
+
+  for (int y = y0; y <= y1; ++y)
+    {
+      int64_t w0 = r0, w1 = r1, w2 = r2;
+
+      for (int x = x0; x <= x1; ++x)
+        {
+          if (msaa)
+            stored += shade_pixel_msaa (fb, t, x, y, w0, w1, w2, !test_edges);
+          else if (!test_edges || (w0 | w1 | w2) >= 0)
+            stored += shade_pixel (fb, t, x, y, w0, w1, w2);
+
+          w0 += e[0].a;
+          w1 += e[1].a;
+          w2 += e[2].a;
+        }
+
+      r0 += e[0].b;
+      r1 += e[1].b;
+      r2 += e[2].b;
+    }
+
+  return stored;
+}
+
+/*
+ * nearest depth of the triangle's plane over the size x size block at
+ * (x, y), grown by the multisample margin. the plane is linear so the
+ * minimum is at a corner; it never goes below the nearest vertex, which
+ * bounds blocks the triangle only clips.
+ */
+static inline float
+block_min_depth (const TriangleSetup *t, int x, int y, int size)
+{
+  x -= t->margin;
+  y -= t->margin;
+  size += 2 * t->margin;
+
+  float e1 = (float)(edge_eq_eval (&t->e[2], x, y) + t->bias[2]);
+  float e2 = (float)(edge_eq_eval (&t->e[0], x, y) + t->bias[0]);
+  float z = t->z0 + (e1 * t->dz10 + e2 * t->dz20) * t->inv_area;
+
+  float extent = (float)(size - 1);
+  z += fmin2f (0.0f, t->dzdx * extent) + fmin2f (0.0f, t->dzdy * extent);
+
+  return fmax2f (z, t->zmin);
+}
+
+/*
+ * true if a primitive whose nearest depth is zmin cannot pass the depth test
+ * anywhere in a tile whose farthest stored depth is tile_max.
+ */
+static inline bool
+hiz_occluded (DepthFunc func, float zmin, float tile_max)
+{
+  switch (func)
+    {
+    case DEPTH_LESS:
+      return zmin >= tile_max;
+    case DEPTH_LESS_EQUAL:
+    case DEPTH_EQUAL:
+      return zmin > tile_max;
+    case DEPTH_ALWAYS:
+    default:
+      return false;
+    }
+}
+
+/*
+ * true if no pixel of the triangle inside [xmin, xmax] x [ymin, ymax] can
+ * pass the depth test, judged from the Hi-Z tiles under the bounds.
+ */
+static bool
+hiz_reject_bounds (Framebuffer *fb, DepthFunc func, float zmin,
+                   int xmin, int ymin, int xmax, int ymax)
+{
+  for (int y = ymin & ~(FB_HIZ_TILE_SIZE - 1); y <= ymax;
+       y += FB_HIZ_TILE_SIZE)
+    {
+      for (int x = xmin & ~(FB_HIZ_TILE_SIZE - 1); x <= xmax;
+           x += FB_HIZ_TILE_SIZE)
+        {
+          if (!hiz_occluded (func, zmin,
+                             fb->hiz_buffer[hiz_index (fb, x, y)]))
+            return false;
+        }
+    }
+  return true;
+}
+
+/* floor (n / d) for d > 0 */
+static inline int64_t
+div_floor (int64_t n, int64_t d)
+{
+  int64_t q = n / d;
+  return (n % d != 0 && n < 0) ? q - 1 : q;
+}
+
+/*
+ * walk the triangle row by row. each edge a * x + cy >= 0 bounds x on one
+ * side, so the covered pixels of a row are the exact span between the
+ * tightest left and right bounds and need neither edge tests nor visits to
+ * empty pixels. the bounds come from the same biased edge values the block
+ * path tests, so both paths cover the same pixels.
+ */
+static void
+raster_spans (Framebuffer *fb, const TriangleSetup *t, int xmin, int ymin,
+              int xmax, int ymax)
+{
+  const EdgeEq *e = t->e;
+
+  /* edge values at x = 0 of the first row */
+  int64_t cy[3];
+  for (int i = 0; i < 3; ++i)
+    cy[i] = edge_eq_eval (&e[i], 0, ymin);
+
+  for (int y = ymin; y <= ymax; ++y)
+    {
+      int64_t left = xmin;
+      int64_t right = xmax;
+
+      for (int i = 0; i < 3; ++i)
+        {
+          if (e[i].a > 0)
+            {
+              /* a * x + cy >= 0  <=>  x >= ceil (-cy / a) */
+              int64_t bound = -div_floor (cy[i], e[i].a);
+              if (bound > left)
+                left = bound;
+            }
+          else if (e[i].a < 0)
+            {
+              /* a * x + cy >= 0  <=>  x <= floor (cy / -a) */
+              int64_t bound = div_floor (cy[i], -e[i].a);
+              if (bound < right)
+                right = bound;
+            }
+          else if (cy[i] < 0)
+            {
+              /* horizontal edge with the whole row outside */
+              right = left - 1;
+            }
+
+          cy[i] += e[i].b;
+        }
+
+      /* split at Hi-Z tile edges so stored depths are counted per tile */
+      for (int x0 = (int)left; x0 <= right;)
+        {
+          int x1 = min2i (x0 | (FB_HIZ_TILE_SIZE - 1), (int)right);
+          int stored = t->raster->rect (fb, t, x0, y, x1, y, false);
+          if (stored && fb->hiz_buffer)
+            hiz_add_writes (fb, x0, y, stored, t->zfar);
+          x0 = x1 + 1;
+        }
+    }
 }
 
-void
-draw_triangle_fill (Framebuffer *fb, Pixel_t v0, Pixel_t v1, Pixel_t v2)
+/*
+ * coverage of a small triangle over the rows x cols pixels at (x0, y0) as a
+ * bit mask, bit y * SMALL_TRIANGLE_SIZE + x. the triangle spans less than
+ * SMALL_TRIANGLE_SIZE pixels on each axis, so its edge values rebased at
+ * (x0, y0) fit in 32 bits, and every row is one fixed-width pass over all
+ * its pixels that the compiler can turn into vector code.
+ */
+static inline uint64_t
+small_triangle_mask (const TriangleSetup *t, int x0, int y0, int rows,
+                     int cols)
 {
-  /* clamp triangle bounds to framebuffer */
-  int xmin = max2i (0, min3i (v0.pos.x, v1.pos.x, v2.pos.x));
-  int xmax = min2i (fb->vinfo.xres - 1, max3i (v0.pos.x, v1.pos.x, v2.pos.x));
-  int ymin = max2i (0, min3i (v0.pos.y, v1.pos.y, v2.pos.y));
-  int ymax = min2i (fb->vinfo.yres - 1, max3i (v0.pos.y, v1.pos.y, v2.pos.y));
+  int32_t a[3], b[3], r[3];
+  for (int i = 0; i < 3; ++i)
+    {
+      a[i] = (int32_t)t->e[i].a;
+      b[i] = (int32_t)t->e[i].b;
+      r[i] = (int32_t)edge_eq_eval (&t->e[i], x0, y0);
+    }
 
-  /* signed area of the triangle */
-  int area = edge_func (v0.pos, v1.pos, v2.pos);
-  if (area == 0)
+  uint32_t col_mask = (1u << cols) - 1u;
+  uint64_t mask = 0;
+
+  for (int y = 0; y < rows; ++y)
+    {
+      uint32_t bits = 0;
+      for (int x = 0; x < SMALL_TRIANGLE_SIZE; ++x)
+        {
+          int32_t w0 = r[0] + a[0] * x;
+          int32_t w1 = r[1] + a[1] * x;
+          int32_t w2 = r[2] + a[2] * x;
+          bits |= (uint32_t)((w0 | w1 | w2) >= 0) << x;
+        }
+
+      mask |= (uint64_t)(bits & col_mask) << (y * SMALL_TRIANGLE_SIZE);
+
+      r[0] += b[0];
+      r[1] += b[1];
+      r[2] += b[2];
+    }
+
+  return mask;
+}
+
+/*
+ * rasterize a triangle whose bounds fit one SMALL_TRIANGLE_SIZE square:
+ * coverage for the whole block in one pass, then only covered pixels are
+ * shaded. no tile or block classification is needed.
+ */
+static void
+raster_small (Framebuffer *fb, const TriangleSetup *t, int xmin, int ymin,
+              int xmax, int ymax)
+{
+  int rows = ymax - ymin + 1;
+  int cols = xmax - xmin + 1;
+
+  uint64_t mask = small_triangle_mask (t, xmin, ymin, rows, cols);
+  if (!mask)
+    return;
+
+  const EdgeEq *e = t->e;
+
+  /* depths stored per Hi-Z tile, the block straddles at most 2 x 2 */
+  int stored[2][2] = { { 0, 0 }, { 0, 0 } };
+  int tx0 = xmin / FB_HIZ_TILE_SIZE;
+  int ty0 = ymin / FB_HIZ_TILE_SIZE;
+
+  /* columns left of the second Hi-Z tile the block may reach into */
+  int split = (tx0 + 1) * FB_HIZ_TILE_SIZE - xmin;
+
+  for (int y = 0; y < rows; ++y)
+    {
+      uint32_t bits = (uint32_t)(mask >> (y * SMALL_TRIANGLE_SIZE))
+                      & ((1u << SMALL_TRIANGLE_SIZE) - 1u);
+
+      /* fragment_batch gets the covered pixels of the row in one call */
+      if (t->batch)
+        {
+          int py = ymin + y;
+          if (!bits)
+            continue;
+
+          uint32_t done = shade_batch (fb, t, xmin, py, cols,
+                                       edge_eq_eval (&e[0], xmin, py),
+                                       edge_eq_eval (&e[1], xmin, py),
+                                       edge_eq_eval (&e[2], xmin, py), bits);
+          uint32_t left = split < 32 ? done & ((1u << split) - 1u) : done;
+          stored[py / FB_HIZ_TILE_SIZE - ty0][0] += popcount_32 (left);
+          stored[py / FB_HIZ_TILE_SIZE - ty0][1] += popcount_32 (done & ~left);
+          continue;
+        }
+
+      for (int x = 0; bits; ++x, bits >>= 1)
+        {
+          if (!(bits & 1u))
+            continue;
+
+          int px = xmin + x;
+          int py = ymin + y;
+          stored[py / FB_HIZ_TILE_SIZE - ty0][px / FB_HIZ_TILE_SIZE - tx0]
+              += shade_pixel (fb, t, px, py, edge_eq_eval (&e[0], px, py),
+                              edge_eq_eval (&e[1], px, py),
+                              edge_eq_eval (&e[2], px, py));
+        }
+    }
+
+  if (!fb->hiz_buffer)
+    return;
+
+  for (int ty = 0; ty < 2; ++ty)
+    for (int tx = 0; tx < 2; ++tx)
+      if (stored[ty][tx])
+        hiz_add_writes (fb, (tx0 + tx) * FB_HIZ_TILE_SIZE,
+                        (ty0 + ty) * FB_HIZ_TILE_SIZE, stored[ty][tx],
+                        t->zfar);
+}
+
+/*
+ * pipeline variants. the common triangle, with no fragment stage, wireframe
+ * or conservative clamp, is drawn by copies of raster_rect and raster_small
+ * generated from the templates below for every combination of depth test,
+ * depth write, color write and pixel format, and by multisampled copies of
+ * raster_rect for 2 and 4 samples. the mode and sample count of each copy
+ * are constants, so the per-pixel and per-sample branches on that state
+ * fold away. a draw picks its copy once, in raster_variant_select;
+ * everything else goes through the generic raster_rect and raster_small.
+ */
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__ ((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+#define MODE_DEPTH_WRITE (1 << 0) /* store the depths that pass */
+#define MODE_COLOR_WRITE (1 << 1) /* write colors */
+#define MODE_RGB8        (1 << 2) /* 32-bit pixels of 8-bit channels */
+#define MODE_DEPTH_SHIFT 3        /* then 0 untested, or 1 + the DepthFunc */
+#define MODE_COUNT       ((DEPTH_ALWAYS + 2) << MODE_DEPTH_SHIFT)
+
+/*
+ * shade_pixel for a variant: no clamp, fragment stage or wireframe, with
+ * the rows of pixel (x, y) in the color and depth buffers passed in
+ */
+static ALWAYS_INLINE bool
+shade_pixel_mode (Framebuffer *fb, const TriangleSetup *t, uint8_t *color_row,
+                  float *depth_row, const Rgb8Layout *rgb8, int x, int y,
+                  int64_t w0, int64_t w1, int64_t w2, int mode)
+{
+  int depth_mode = mode >> MODE_DEPTH_SHIFT;
+
+  float e0 = (float)(w1 + t->bias[1]);
+  float e1 = (float)(w2 + t->bias[2]);
+  float e2 = (float)(w0 + t->bias[0]);
+  float depth = t->z0 + (e1 * t->dz10 + e2 * t->dz20) * t->inv_area;
+
+  if (depth_mode
+      && !depth_test ((DepthFunc)(depth_mode - 1), depth, depth_row[x]))
+    return false;
+
+  if (mode & MODE_COLOR_WRITE)
+    {
+      const Pixel_t *v0 = &t->v[0];
+      const Pixel_t *v1 = &t->v[1];
+      const Pixel_t *v2 = &t->v[2];
+
+      float p0 = e0 * t->q[0];
+      float p1 = e1 * t->q[1];
+      float p2 = e2 * t->q[2];
+      float inv = 1.0f / (p0 + p1 + p2);
+      p0 *= inv;
+      p1 *= inv;
+      p2 *= inv;
+
+      Color8_t c;
+      c.r = (uint8_t)(p0 * v0->color.r + p1 * v1->color.r + p2 * v2->color.r);
+      c.g = (uint8_t)(p0 * v0->color.g + p1 * v1->color.g + p2 * v2->color.g);
+      c.b = (uint8_t)(p0 * v0->color.b + p1 * v1->color.b + p2 * v2->color.b);
+      c.a = (uint8_t)(p0 * v0->color.a + p1 * v1->color.a + p2 * v2->color.a);
+
+      if (mode & MODE_RGB8)
+        {
+          uint32_t packed = rgb8_pack (rgb8, c);
+          memcpy (color_row + (size_t)x * 4, &packed, 4);
+        }
+      else
+        set_pixel (fb, (Vec2i_t){ x, y }, c);
+    }
+
+  if (!depth_mode || !(mode & MODE_DEPTH_WRITE))
+    return false;
+
+  depth_row[x] = depth;
+  return true;
+}
+
+/* row pointers of the color and depth buffers at row y */
+static inline uint8_t *
+color_row (Framebuffer *fb, int y)
+{
+  return fb->back_buffer + (size_t)y * fb->finfo.line_length;
+}
+
+static inline float *
+depth_row (Framebuffer *fb, int y)
+{
+  return fb->depth_buffer ? fb->depth_buffer + (size_t)y * fb->vinfo.xres
+                          : NULL;
+}
+
+/* raster_rect for a variant, test_edges constant as well */
+static ALWAYS_INLINE int
+raster_rect_rows (Framebuffer *fb, const TriangleSetup *t, int x0, int y0,
+                  int x1, int y1, bool test_edges, int mode)
+{
+  const EdgeEq *e = t->e;
+  Rgb8Layout rgb8 = rgb8_layout (fb);
+  int stored = 0;
+
+  int64_t r0 = edge_eq_eval (&e[0], x0, y0);
+  int64_t r1 = edge_eq_eval (&e[1], x0, y0);
+  int64_t r2 = edge_eq_eval (&e[2], x0, y0);
+
+  for (int y = y0; y <= y1; ++y)
+    {
+      uint8_t *crow = color_row (fb, y);
+      float *drow = depth_row (fb, y);
+      int64_t w0 = r0, w1 = r1, w2 = r2;
+
+      for (int x = x0; x <= x1; ++x)
+        {
+          if (!test_edges || (w0 | w1 | w2) >= 0)
+            stored += shade_pixel_mode (fb, t, crow, drow, &rgb8, x, y, w0,
+                                        w1, w2, mode);
+
+          w0 += e[0].a;
+          w1 += e[1].a;
+          w2 += e[2].a;
+        }
+
+      r0 += e[0].b;
+      r1 += e[1].b;
+      r2 += e[2].b;
+    }
+
+  return stored;
+}
+
+static ALWAYS_INLINE int
+raster_rect_mode (Framebuffer *fb, const TriangleSetup *t, int x0, int y0,
+                  int x1, int y1, bool test_edges, int mode)
+{
+  if (test_edges)
+    return raster_rect_rows (fb, t, x0, y0, x1, y1, true, mode);
+  return raster_rect_rows (fb, t, x0, y0, x1, y1, false, mode);
+}
+
+/* raster_small for a variant */
+static ALWAYS_INLINE void
+raster_small_mode (Framebuffer *fb, const TriangleSetup *t, int xmin,
+                   int ymin, int xmax, int ymax, int mode)
+{
+  int rows = ymax - ymin + 1;
+  int cols = xmax - xmin + 1;
+
+  uint64_t mask = small_triangle_mask (t, xmin, ymin, rows, cols);
+  if (!mask)
+    return;
+
+  const EdgeEq *e = t->e;
+  Rgb8Layout rgb8 = rgb8_layout (fb);
+
+  int stored[2][2] = { { 0, 0 }, { 0, 0 } };
+  int tx0 = xmin / FB_HIZ_TILE_SIZE;
+  int ty0 = ymin / FB_HIZ_TILE_SIZE;
+
+  for (int y = 0; y < rows; ++y)
+    {
+      uint32_t bits = (uint32_t)(mask >> (y * SMALL_TRIANGLE_SIZE))
+                      & ((1u << SMALL_TRIANGLE_SIZE) - 1u);
+      int py = ymin + y;
+      uint8_t *crow = color_row (fb, py);
+      float *drow = depth_row (fb, py);
+
+      for (int x = 0; bits; ++x, bits >>= 1)
+        {
+          if (!(bits & 1u))
+            continue;
+
+          int px = xmin + x;
+          stored[py / FB_HIZ_TILE_SIZE - ty0][px / FB_HIZ_TILE_SIZE - tx0]
+              += shade_pixel_mode (fb, t, crow, drow, &rgb8, px, py,
+                                   edge_eq_eval (&e[0], px, py),
+                                   edge_eq_eval (&e[1], px, py),
+                                   edge_eq_eval (&e[2], px, py), mode);
+        }
+    }
+
+  if (!fb->hiz_buffer)
     return;
 
-  for (int y = ymin; y <= ymax; y++)
+  for (int ty = 0; ty < 2; ++ty)
+    for (int tx = 0; tx < 2; ++tx)
+      if (stored[ty][tx])
+        hiz_add_writes (fb, (tx0 + tx) * FB_HIZ_TILE_SIZE,
+                        (ty0 + ty) * FB_HIZ_TILE_SIZE, stored[ty][tx],
+                        t->zfar);
+}
+
+/*
+ * shade_pixel_msaa for a variant with n samples. the color is shaded once
+ * at the pixel center, and a pixel whose samples all pass, which is every
+ * pixel of a fully covered block that is not hidden, stores it once for
+ * all of them. test_edges false skips the per-sample coverage tests.
+ */
+static ALWAYS_INLINE bool
+shade_pixel_msaa_mode (Framebuffer *fb, const TriangleSetup *t,
+                       uint8_t *color_row, float *depth_row,
+                       const Rgb8Layout *rgb8, int x, int y, int64_t w0,
+                       int64_t w1, int64_t w2, bool test_edges, int mode,
+                       uint32_t n)
+{
+  int depth_mode = mode >> MODE_DEPTH_SHIFT;
+  uint32_t all = (1u << n) - 1u;
+  uint32_t pass = all;
+
+  /*
+   * a center farther from every edge than any sample offset reaches has
+   * all its samples on the same side, so only pixels near an edge test
+   * their samples one by one
+   */
+  const int64_t *reach = t->sample_reach;
+  if (test_edges
+      && ((w0 - reach[0]) | (w1 - reach[1]) | (w2 - reach[2])) < 0)
+    {
+      if (w0 + reach[0] < 0 || w1 + reach[1] < 0 || w2 + reach[2] < 0)
+        return false;
+
+      for (uint32_t k = 0; k < n; ++k)
+        {
+          const int64_t *dw = t->sample_dw[k];
+          if (((w0 + dw[0]) | (w1 + dw[1]) | (w2 + dw[2])) < 0)
+            pass &= ~(1u << k);
+        }
+      if (!pass)
+        return false;
+    }
+
+  float e0 = (float)(w1 + t->bias[1]);
+  float e1 = (float)(w2 + t->bias[2]);
+  float e2 = (float)(w0 + t->bias[0]);
+  float depth = t->z0 + (e1 * t->dz10 + e2 * t->dz20) * t->inv_area;
+
+  /* per-sample depths, tested and stored without branches per sample */
+  float z[FB_MAX_SAMPLES];
+  for (uint32_t k = 0; k < n; ++k)
+    z[k] = depth + t->sample_dz[k];
+
+  float *stored = depth_mode ? depth_row + (size_t)x * n : NULL;
+  if (depth_mode)
+    {
+      uint32_t hidden = 0;
+      for (uint32_t k = 0; k < n; ++k)
+        hidden |= (uint32_t)!depth_test ((DepthFunc)(depth_mode - 1), z[k],
+                                         stored[k])
+                  << k;
+      pass &= ~hidden;
+      if (!pass)
+        return false;
+    }
+
+  if (mode & MODE_COLOR_WRITE)
+    {
+      const Pixel_t *v0 = &t->v[0];
+      const Pixel_t *v1 = &t->v[1];
+      const Pixel_t *v2 = &t->v[2];
+
+      /* clamped like shade_pixel_msaa, the center may be outside */
+      float p0 = fmax2f (e0, 0.0f) * t->q[0];
+      float p1 = fmax2f (e1, 0.0f) * t->q[1];
+      float p2 = fmax2f (e2, 0.0f) * t->q[2];
+      float inv = 1.0f / (p0 + p1 + p2);
+      p0 *= inv;
+      p1 *= inv;
+      p2 *= inv;
+
+      Color8_t c;
+      c.r = (uint8_t)(p0 * v0->color.r + p1 * v1->color.r + p2 * v2->color.r);
+      c.g = (uint8_t)(p0 * v0->color.g + p1 * v1->color.g + p2 * v2->color.g);
+      c.b = (uint8_t)(p0 * v0->color.b + p1 * v1->color.b + p2 * v2->color.b);
+      c.a = (uint8_t)(p0 * v0->color.a + p1 * v1->color.a + p2 * v2->color.a);
+
+      if (mode & MODE_RGB8)
+        {
+          /* write_samples with the packing and sample count folded in */
+          size_t i = (size_t)y * fb->vinfo.xres + (size_t)x;
+          uint32_t *samples = fb->sample_colors + i * n;
+          uint32_t packed = rgb8_pack (rgb8, c);
+          if (pass == all)
+            {
+              samples[0] = packed;
+              fb->sample_split[i] = 0;
+              memcpy (color_row + (size_t)x * 4, &packed, 4);
+            }
+          else
+            {
+              if (!fb->sample_split[i])
+                {
+                  for (uint32_t k = 1; k < n; ++k)
+                    samples[k] = samples[0];
+                  fb->sample_split[i] = 1;
+                }
+              for (uint32_t k = 0; k < n; ++k)
+                {
+                  if (pass & (1u << k))
+                    samples[k] = packed;
+                }
+            }
+        }
+      else
+        write_samples (fb, x, y, pass, c);
+    }
+
+  if (!depth_mode || !(mode & MODE_DEPTH_WRITE))
+    return false;
+
+  for (uint32_t k = 0; k < n; ++k)
+    stored[k] = (pass & (1u << k)) ? z[k] : stored[k];
+  return true;
+}
+
+/* raster_rect_rows with n samples per pixel */
+static ALWAYS_INLINE int
+raster_rect_msaa_rows (Framebuffer *fb, const TriangleSetup *t, int x0,
+                       int y0, int x1, int y1, bool test_edges, int mode,
+                       uint32_t n)
+{
+  const EdgeEq *e = t->e;
+  Rgb8Layout rgb8 = rgb8_layout (fb);
+  int stored = 0;
+
+  int64_t r0 = edge_eq_eval (&e[0], x0, y0);
+  int64_t r1 = edge_eq_eval (&e[1], x0, y0);
+  int64_t r2 = edge_eq_eval (&e[2], x0, y0);
+
+  for (int y = y0; y <= y1; ++y)
+    {
+      uint8_t *crow = color_row (fb, y);
+      float *drow = fb->depth_buffer
+                        ? fb->depth_buffer + (size_t)y * fb->vinfo.xres * n
+                        : NULL;
+      int64_t w0 = r0, w1 = r1, w2 = r2;
+
+      for (int x = x0; x <= x1; ++x)
+        {
+          stored += shade_pixel_msaa_mode (fb, t, crow, drow, &rgb8, x, y,
+                                           w0, w1, w2, test_edges, mode, n);
+
+          w0 += e[0].a;
+          w1 += e[1].a;
+          w2 += e[2].a;
+        }
+
+      r0 += e[0].b;
+      r1 += e[1].b;
+      r2 += e[2].b;
+    }
+
+  return stored;
+}
+
+static ALWAYS_INLINE int
+raster_rect_msaa_mode (Framebuffer *fb, const TriangleSetup *t, int x0,
+                       int y0, int x1, int y1, bool test_edges, int mode,
+                       uint32_t n)
+{
+  if (test_edges)
+    return raster_rect_msaa_rows (fb, t, x0, y0, x1, y1, true, mode, n);
+  return raster_rect_msaa_rows (fb, t, x0, y0, x1, y1, false, mode, n);
+}
+
+/* the rect and small functions of depth mode d and write and format bits l */
+#define RASTER_VARIANT(d, l)                                                  \
+  static int raster_rect_##d##_##l (Framebuffer *fb, const TriangleSetup *t, \
+                                    int x0, int y0, int x1, int y1,         \
+                                    bool test_edges)                        \
+  {                                                                         \
+    return raster_rect_mode (fb, t, x0, y0, x1, y1, test_edges,             \
+                             (d) << MODE_DEPTH_SHIFT | (l));                \
+  }                                                                         \
+  static void raster_small_##d##_##l (Framebuffer *fb,                      \
+                                      const TriangleSetup *t, int xmin,     \
+                                      int ymin, int xmax, int ymax)         \
+  {                                                                         \
+    raster_small_mode (fb, t, xmin, ymin, xmax, ymax,                       \
+                       (d) << MODE_DEPTH_SHIFT | (l));                      \
+  }                                                                         \
+  static int raster_rect_2x_##d##_##l (Framebuffer *fb,                     \
+                                       const TriangleSetup *t, int x0,      \
+                                       int y0, int x1, int y1,              \
+                                       bool test_edges)                     \
+  {                                                                         \
+    return raster_rect_msaa_mode (fb, t, x0, y0, x1, y1, test_edges,        \
+                                  (d) << MODE_DEPTH_SHIFT | (l), 2);        \
+  }                                                                         \
+  static int raster_rect_4x_##d##_##l (Framebuffer *fb,                     \
+                                       const TriangleSetup *t, int x0,      \
+                                       int y0, int x1, int y1,              \
+                                       bool test_edges)                     \
+  {                                                                         \
+    return raster_rect_msaa_mode (fb, t, x0, y0, x1, y1, test_edges,        \
+                                  (d) << MODE_DEPTH_SHIFT | (l), 4);        \
+  }
+
+#define RASTER_VARIANTS(d)                                                    \
+  RASTER_VARIANT (d, 0) RASTER_VARIANT (d, 1) RASTER_VARIANT (d, 2)           \
+  RASTER_VARIANT (d, 3) RASTER_VARIANT (d, 4) RASTER_VARIANT (d, 5)           \
+  RASTER_VARIANT (d, 6) RASTER_VARIANT (d, 7)
+
+/*
+ * multisampled triangles never take the small triangle path, so their
+ * entries keep the generic raster_small
+ */
+#define RASTER_ENTRY(d, l) { raster_rect_##d##_##l, raster_small_##d##_##l }
+#define RASTER_ENTRY_2X(d, l) { raster_rect_2x_##d##_##l, raster_small }
+#define RASTER_ENTRY_4X(d, l) { raster_rect_4x_##d##_##l, raster_small }
+#define RASTER_ENTRIES(e, d)                                                  \
+  e (d, 0), e (d, 1), e (d, 2), e (d, 3), e (d, 4), e (d, 5), e (d, 6),       \
+  e (d, 7)
+
+RASTER_VARIANTS (0)
+RASTER_VARIANTS (1)
+RASTER_VARIANTS (2)
+RASTER_VARIANTS (3)
+RASTER_VARIANTS (4)
+
+/* indexed by mode, for 1, 2 and 4 samples */
+static const RasterVariant raster_variants[MODE_COUNT] = {
+  RASTER_ENTRIES (RASTER_ENTRY, 0), RASTER_ENTRIES (RASTER_ENTRY, 1),
+  RASTER_ENTRIES (RASTER_ENTRY, 2), RASTER_ENTRIES (RASTER_ENTRY, 3),
+  RASTER_ENTRIES (RASTER_ENTRY, 4),
+};
+
+static const RasterVariant raster_variants_2x[MODE_COUNT] = {
+  RASTER_ENTRIES (RASTER_ENTRY_2X, 0), RASTER_ENTRIES (RASTER_ENTRY_2X, 1),
+  RASTER_ENTRIES (RASTER_ENTRY_2X, 2), RASTER_ENTRIES (RASTER_ENTRY_2X, 3),
+  RASTER_ENTRIES (RASTER_ENTRY_2X, 4),
+};
+
+static const RasterVariant raster_variants_4x[MODE_COUNT] = {
+  RASTER_ENTRIES (RASTER_ENTRY_4X, 0), RASTER_ENTRIES (RASTER_ENTRY_4X, 1),
+  RASTER_ENTRIES (RASTER_ENTRY_4X, 2), RASTER_ENTRIES (RASTER_ENTRY_4X, 3),
+  RASTER_ENTRIES (RASTER_ENTRY_4X, 4),
+};
+
+static const RasterVariant raster_generic = { raster_rect, raster_small };
+
+static const RasterVariant *
+raster_variant_select (const Framebuffer *fb, const DrawState *state)
+{
+  if (fragment_stage (state) || state->fill_mode == FILL_SOLID_WIREFRAME
+      || state->conservative == CONSERVATIVE_OVER
+      || (unsigned)state->depth_func > DEPTH_ALWAYS)
+    return &raster_generic;
+
+  int mode = 0;
+  if (fb->depth_buffer)
+    mode |= (1 + (int)state->depth_func) << MODE_DEPTH_SHIFT;
+  if (state->depth_write)
+    mode |= MODE_DEPTH_WRITE;
+  if (state->color_write)
+    mode |= MODE_COLOR_WRITE;
+  if (fb_is_rgb8 (fb))
+    mode |= MODE_RGB8;
+
+  if (fb->samples == 4)
+    return &raster_variants_4x[mode];
+  if (fb->samples == 2)
+    return &raster_variants_2x[mode];
+  return fb->samples > 1 ? &raster_generic : &raster_variants[mode];
+}
+
+/*
+ * walk the BLOCK_SIZE blocks of one tile, skipping blocks outside the
+ * triangle and filling blocks fully inside it without edge tests. with a
+ * Hi-Z buffer, blocks whose nearest depth is behind the farthest depth
+ * already stored are skipped before any per-pixel work.
+ */
+static void
+raster_tile (Framebuffer *fb, const TriangleSetup *t, int tx, int ty,
+             int xmin, int ymin, int xmax, int ymax, bool tile_inside)
+{
+  bool hiz = fb->depth_buffer && fb->hiz_buffer;
+
+  for (int by = ty; by < ty + TILE_SIZE; by += BLOCK_SIZE)
     {
-      for (int x = xmin; x <= xmax; x++)
+      if (by > ymax || by + BLOCK_SIZE - 1 < ymin)
+        continue;
+
+      for (int bx = tx; bx < tx + TILE_SIZE; bx += BLOCK_SIZE)
         {
-          /* current pixel position */
-          Vec2i_t p = { x, y };
+          if (bx > xmax || bx + BLOCK_SIZE - 1 < xmin)
+            continue;
 
-          /* edge function tests */
-          int w0 = edge_func (v0.pos, v1.pos, p);
-          int w1 = edge_func (v1.pos, v2.pos, p);
-          int w2 = edge_func (v2.pos, v0.pos, p);
+          BlockCoverage cov = tile_inside
+                                  ? BLOCK_INSIDE
+                                  : classify_block (t, bx, by, BLOCK_SIZE);
+          if (cov == BLOCK_OUTSIDE)
+            continue;
 
-          /* skip if point is outside triangle */
-          if (!((w0 >= 0 && w1 >= 0 && w2 >= 0)
-                || (w0 <= 0 && w1 <= 0 && w2 <= 0)))
+          /* occluded by what is already in the depth buffer */
+          if (hiz
+              && hiz_occluded (t->state->depth_func,
+                               block_min_depth (t, bx, by, BLOCK_SIZE),
+                               fb->hiz_buffer[hiz_index (fb, bx, by)]))
             continue;
 
-          /* barycentrics in fixed-point */
-          int32_t b0 = FIXED_DIV (w1, area);
-          int32_t b1 = FIXED_DIV (w2, area);
-          int32_t b2 = FIXED_DIV (w0, area);
+          /* clip block to the triangle bounds */
+          int x0 = max2i (bx, xmin);
+          int y0 = max2i (by, ymin);
+          int x1 = min2i (bx + BLOCK_SIZE - 1, xmax);
+          int y1 = min2i (by + BLOCK_SIZE - 1, ymax);
+
+          int stored = t->raster->rect (fb, t, x0, y0, x1, y1,
+                                        cov != BLOCK_INSIDE);
+
+          if (hiz && stored)
+            hiz_add_writes (fb, bx, by, stored, t->zfar);
+        }
+    }
+}
+
+static void
+raster_triangle (Framebuffer *fb, const DrawState *state, Pixel_t v0,
+                 Pixel_t v1, Pixel_t v2, const PrimVaryings *var,
+                 const RasterVariant *raster)
+{
+  Vec2i_t f0 = pixel_fixed_pos (&v0);
+  Vec2i_t f1 = pixel_fixed_pos (&v1);
+  Vec2i_t f2 = pixel_fixed_pos (&v2);
+
+  /*
+   * pixels whose centers fall inside the fixed-point bounds, clamped to the
+   * framebuffer. a center x + 0.5 is inside [min, max] for
+   * ceil(min - 0.5) <= x <= floor(max - 0.5).
+   */
+  int half = SUBPIXEL_ONE / 2;
+  int xmin = (min3i (f0.x, f1.x, f2.x) - half + SUBPIXEL_MASK) >> SUBPIXEL_BITS;
+  int ymin = (min3i (f0.y, f1.y, f2.y) - half + SUBPIXEL_MASK) >> SUBPIXEL_BITS;
+  int xmax = (max3i (f0.x, f1.x, f2.x) - half) >> SUBPIXEL_BITS;
+  int ymax = (max3i (f0.y, f1.y, f2.y) - half) >> SUBPIXEL_BITS;
+
+  /*
+   * overestimation takes every pixel whose square touches the bounds, which
+   * also trims what the shifted edges add past sharp corners
+   */
+  ConservativeMode conservative = state->conservative;
+  if (conservative == CONSERVATIVE_OVER)
+    {
+      xmin = ((min3i (f0.x, f1.x, f2.x) + SUBPIXEL_MASK) >> SUBPIXEL_BITS) - 1;
+      ymin = ((min3i (f0.y, f1.y, f2.y) + SUBPIXEL_MASK) >> SUBPIXEL_BITS) - 1;
+      xmax = max3i (f0.x, f1.x, f2.x) >> SUBPIXEL_BITS;
+      ymax = max3i (f0.y, f1.y, f2.y) >> SUBPIXEL_BITS;
+    }
+
+  /* samples off the pixel centers reach pixels one further out */
+  uint32_t samples = fb->samples > 1 ? fb->samples : 1;
+  int margin = samples > 1 ? 1 : 0;
+
+  xmin = max2i (0, xmin - margin);
+  ymin = max2i (0, ymin - margin);
+  xmax = min2i (fb->vinfo.xres - 1, xmax + margin);
+  ymax = min2i (fb->vinfo.yres - 1, ymax + margin);
+
+  if (xmin > xmax || ymin > ymax)
+    return;
+
+  /* signed area of the triangle */
+  int64_t area = edge_func (f0, f1, f2);
+  if (area == 0)
+    return;
+
+  /* screen y points down, so counter-clockwise with y up is negative */
+  if (state->cull_mode != CULL_NONE)
+    {
+      bool front = (area < 0) == (state->front_face == FRONT_FACE_CCW);
+      if (front == (state->cull_mode == CULL_FRONT))
+        return;
+    }
+
+  /* flip clockwise triangles so inside is always where all edges are >= 0 */
+  bool flipped = area < 0;
+  if (flipped)
+    {
+      Pixel_t tmp = v1;
+      v1 = v2;
+      v2 = tmp;
+
+      Vec2i_t ftmp = f1;
+      f1 = f2;
+      f2 = ftmp;
+
+      area = -area;
+    }
+
+  TriangleSetup t;
+  t.state = state;
+  t.raster = raster;
+  t.fragment = fragment_stage (state);
+  t.batch = state->fragment_batch && samples == 1;
+  t.varying_count = var ? var->count : 0;
+  if (t.varying_count)
+    {
+      /* in the order the vertices were put in above */
+      t.var[0] = var->v[0];
+      t.var[1] = var->v[flipped ? 2 : 1];
+      t.var[2] = var->v[flipped ? 1 : 2];
+    }
+  t.samples = samples;
+  t.margin = margin;
+  t.e[0] = edge_eq_make (f0, f1, &t.bias[0]);
+  t.e[1] = edge_eq_make (f1, f2, &t.bias[1]);
+  t.e[2] = edge_eq_make (f2, f0, &t.bias[2]);
+  if (conservative != CONSERVATIVE_OFF)
+    {
+      for (int i = 0; i < 3; ++i)
+        edge_eq_conservative (&t.e[i], &t.bias[i], conservative);
+    }
+  t.clamp = conservative == CONSERVATIVE_OVER;
+  t.inv_area = 1.0f / (float)area;
+  t.z0 = v0.depth;
+  t.dz10 = v1.depth - v0.depth;
+  t.dz20 = v2.depth - v0.depth;
+  t.zmin = fmin3f (v0.depth, v1.depth, v2.depth);
+  t.zmax = fmax3f (v0.depth, v1.depth, v2.depth);
+
+  /*
+   * the ordered depth funcs only store depths nearer than what they replace,
+   * so only DEPTH_ALWAYS can push a Hi-Z tile farther
+   */
+  t.zfar = state->depth_func == DEPTH_ALWAYS ? t.zmax : 0.0f;
+
+  /* small triangles behind everything under them are dropped right away */
+  if (fb->depth_buffer && fb->hiz_buffer)
+    {
+      int tiles_x = (xmax / FB_HIZ_TILE_SIZE) - (xmin / FB_HIZ_TILE_SIZE) + 1;
+      int tiles_y = (ymax / FB_HIZ_TILE_SIZE) - (ymin / FB_HIZ_TILE_SIZE) + 1;
+
+      if (tiles_x * tiles_y <= HIZ_TRIANGLE_TEST_TILES
+          && hiz_reject_bounds (fb, state->depth_func, t.zmin, xmin, ymin,
+                                xmax, ymax))
+        return;
+    }
+
+  /* without 1/w on every vertex fall back to affine interpolation */
+  bool perspective = v0.inv_w > 0.0f && v1.inv_w > 0.0f && v2.inv_w > 0.0f;
+  t.q[0] = perspective ? v0.inv_w : 1.0f;
+  t.q[1] = perspective ? v1.inv_w : 1.0f;
+  t.q[2] = perspective ? v2.inv_w : 1.0f;
+
+  /* edge values per pixel of distance, for the wireframe band */
+  t.wire = state->fill_mode == FILL_SOLID_WIREFRAME;
+  if (t.wire)
+    {
+      t.wire_reach = state->wire_width * 0.5f + 0.5f;
+      for (int i = 0; i < 3; ++i)
+        t.edge_scale[i] = 1.0f / sqrtf ((float)t.e[i].a * t.e[i].a
+                                        + (float)t.e[i].b * t.e[i].b);
+    }
+
+  t.v[0] = v0;
+  t.v[1] = v1;
+  t.v[2] = v2;
+
+  /* small triangles skip the traversal setup below */
+  int small_limit = SMALL_TRIANGLE_SIZE * SUBPIXEL_ONE;
+  if (state->raster_path == RASTER_PATH_AUTO && samples == 1
+      && max3i (f0.x, f1.x, f2.x) - min3i (f0.x, f1.x, f2.x) < small_limit
+      && max3i (f0.y, f1.y, f2.y) - min3i (f0.y, f1.y, f2.y) < small_limit
+      && xmax - xmin < SMALL_TRIANGLE_SIZE && ymax - ymin < SMALL_TRIANGLE_SIZE)
+    {
+      raster->small (fb, &t, xmin, ymin, xmax, ymax);
+      return;
+    }
+
+  /* depth plane slopes for the per-block Hi-Z tests */
+  t.dzdx = ((float)t.e[2].a * t.dz10 + (float)t.e[0].a * t.dz20) * t.inv_area;
+  t.dzdy = ((float)t.e[2].b * t.dz10 + (float)t.e[0].b * t.dz20) * t.inv_area;
+
+  /* edge and depth offsets from the pixel center to each sample */
+  if (samples > 1)
+    {
+      const Vec2i_t *offsets
+          = samples == 4 ? sample_offsets_4x : sample_offsets_2x;
+
+      for (int i = 0; i < 3; ++i)
+        t.sample_reach[i] = 0;
+      for (uint32_t k = 0; k < samples; ++k)
+        {
+          for (int i = 0; i < 3; ++i)
+            {
+              int64_t dw = (t.e[i].a * offsets[k].x + t.e[i].b * offsets[k].y)
+                           / SUBPIXEL_ONE;
+              t.sample_dw[k][i] = dw;
+              if (dw < 0)
+                dw = -dw;
+              if (dw > t.sample_reach[i])
+                t.sample_reach[i] = dw;
+            }
+          t.sample_dz[k] = (t.dzdx * offsets[k].x + t.dzdy * offsets[k].y)
+                           / SUBPIXEL_ONE;
+        }
+    }
+
+  /*
+   * slivers are cheaper to walk as spans. spans bound pixel centers only,
+   * so multisampled triangles always walk blocks.
+   */
+  bool spans = state->raster_path == RASTER_PATH_SPANS && samples == 1;
+  if (state->raster_path == RASTER_PATH_AUTO && samples == 1
+      && ymax - ymin + 1 >= SPAN_MIN_ROWS)
+    {
+      /*
+       * area is twice the triangle area, so area over the longest edge is
+       * the width across it. compared squared to skip the square root.
+       */
+      double longest = fmax (edge_length2 (f0, f1),
+                             fmax (edge_length2 (f1, f2),
+                                   edge_length2 (f2, f0)));
+      double width = (double)SPAN_MAX_WIDTH * SUBPIXEL_ONE;
+      spans = (double)area * (double)area < width * width * longest;
+    }
 
-          /* convert to float barycentrics */
-          float fb0 = (float)b0 / (float)FIXED_ONE;
-          float fb1 = (float)b1 / (float)FIXED_ONE;
-          float fb2 = (float)b2 / (float)FIXED_ONE;
+  if (spans)
+    {
+      raster_spans (fb, &t, xmin, ymin, xmax, ymax);
+      return;
+    }
 
-          /* depth interpolation */
-          float depth = fb0 * v0.depth + fb1 * v1.depth + fb2 * v2.depth;
+  /* walk tiles aligned to the tile grid that overlap the bounds */
+  int tx0 = xmin & ~(TILE_SIZE - 1);
+  int ty0 = ymin & ~(TILE_SIZE - 1);
 
-          /* color interpolation in fixed-point */
-          Color8_t c;
-          c.r = (uint8_t)((b0 * v0.color.r + b1 * v1.color.r + b2 * v2.color.r)
-                          >> FIXED_SHIFT);
-          c.g = (uint8_t)((b0 * v0.color.g + b1 * v1.color.g + b2 * v2.color.g)
-                          >> FIXED_SHIFT);
-          c.b = (uint8_t)((b0 * v0.color.b + b1 * v1.color.b + b2 * v2.color.b)
-                          >> FIXED_SHIFT);
-          c.a = (uint8_t)((b0 * v0.color.a + b1 * v1.color.a + b2 * v2.color.a)
-                          >> FIXED_SHIFT);
+  for (int ty = ty0; ty <= ymax; ty += TILE_SIZE)
+    {
+      for (int tx = tx0; tx <= xmax; tx += TILE_SIZE)
+        {
+          BlockCoverage cov = classify_block (&t, tx, ty, TILE_SIZE);
+          if (cov == BLOCK_OUTSIDE)
+            continue;
 
-          /* prepare pixel for drawing */
-          Pixel_t out = { p, c, depth };
-          draw_pixel (fb, out);
+          /* a tile fully inside skips the per-block coverage tests */
+          raster_tile (fb, &t, tx, ty, xmin, ymin, xmax, ymax,
+                       cov == BLOCK_INSIDE);
         }
     }
 }
+
+void
+draw_triangle_fill (Framebuffer *fb, Pixel_t v0, Pixel_t v1, Pixel_t v2)
+{
+  raster_triangle (fb, &default_state, v0, v1, v2, NULL,
+                   raster_variant_select (fb, &default_state));
+}
@@ -1,9 +1,11 @@
 #ifndef DRAW_H
 #define DRAW_H
 
+#include "graphics/clip.h"
 #include "graphics/pixel.h"
 #include "platform/framebuffer.h"
 #include "graphics/buffer.h"
+#include "math/matrix.h"
 
 /**
  * @enum PrimitiveType
@@ -16,6 +18,204 @@ typedef enum
   PRIM_TRIANGLES
 } PrimitiveType;
 
+/**
+ * @enum DepthFunc
+ * @brief Comparison of an incoming depth against the stored depth.
+ */
+typedef enum
+{
+  DEPTH_LESS,       /**< Pass if nearer than the stored depth (default) */
+  DEPTH_LESS_EQUAL, /**< Pass if nearer or equal */
+  DEPTH_EQUAL,      /**< Pass if equal, used to shade after a depth pre-pass */
+  DEPTH_ALWAYS      /**< Always pass */
+} DepthFunc;
+
+/**
+ * @enum RasterPath
+ * @brief How triangles are traversed.
+ */
+typedef enum
+{
+  RASTER_PATH_AUTO,   /**< Pick per triangle from its shape (default) */
+  RASTER_PATH_BLOCKS, /**< Hierarchical tile/block traversal of the bounds */
+  RASTER_PATH_SPANS   /**< Edge walking, one exact span per row */
+} RasterPath;
+
+/**
+ * @enum ConservativeMode
+ * @brief Which pixels count as covered by a triangle.
+ */
+typedef enum
+{
+  CONSERVATIVE_OFF,   /**< Pixels whose centers are inside, top-left fill rule (default) */
+  CONSERVATIVE_OVER,  /**< Every pixel the triangle touches, edges included */
+  CONSERVATIVE_UNDER  /**< Only pixels entirely inside the triangle */
+} ConservativeMode;
+
+/**
+ * @enum CullMode
+ * @brief Which triangles are dropped by the way they face.
+ */
+typedef enum
+{
+  CULL_NONE,  /**< Draw both faces (default) */
+  CULL_BACK,  /**< Drop triangles facing away */
+  CULL_FRONT  /**< Drop triangles facing the viewer */
+} CullMode;
+
+/**
+ * @enum FrontFace
+ * @brief Winding of front-facing triangles as seen on screen, y up.
+ */
+typedef enum
+{
+  FRONT_FACE_CCW, /**< Counter-clockwise triangles face the viewer (default) */
+  FRONT_FACE_CW   /**< Clockwise triangles face the viewer */
+} FrontFace;
+
+/**
+ * @enum FillMode
+ * @brief How the inside of triangles is drawn.
+ */
+typedef enum
+{
+  FILL_SOLID,          /**< Interpolated vertex colors (default) */
+  FILL_SOLID_WIREFRAME /**< Vertex colors with wire_color blended along the edges */
+} FillMode;
+
+/**
+ * @struct DrawStats
+ * @brief Clip-space triangles counted per clipping path, and the vertex
+ * cache use of indexed draws.
+ *
+ * Counts add up over every draw call given the same DrawStats through
+ * DrawState.stats; zero it to start over.
+ */
+typedef struct
+{
+  uint64_t triangles_inside;     /**< Inside the view frustum, drawn as they are */
+  uint64_t triangles_guard_band; /**< Partly off screen within the guard band, scissored by the rasterizer */
+  uint64_t triangles_clipped;    /**< Crossing the near or far plane or the guard band, clipped */
+  uint64_t triangles_culled;     /**< Entirely outside one frustum plane, dropped */
+  uint64_t vertices_transformed; /**< Vertices fetched and projected by indexed draws */
+  uint64_t vertex_cache_hits;    /**< Indices of indexed draws served from the vertex cache */
+  uint64_t instances_culled;     /**< Instances of instanced draws entirely outside the view frustum, dropped */
+} DrawStats;
+
+/**
+ * @struct Fragment
+ * @brief A covered pixel of a triangle or line, as seen by a FragmentFunc.
+ */
+typedef struct
+{
+  Vec2i_t      pos;        /**< Pixel coordinates */
+  float        depth;      /**< Interpolated depth in [0, 1] */
+  Color8_t     color;      /**< Interpolated vertex color */
+  const float *varyings;   /**< Interpolated varyings, see DrawState.varyings */
+  uint32_t     components; /**< Number of floats in varyings */
+} Fragment;
+
+/**
+ * @brief Fragment function: compute the color of a covered pixel.
+ *
+ * @param frag The pixel with its interpolated attributes.
+ * @param user DrawState.fragment_data.
+ * @param out  Receives the color, frag->color to keep the vertex color.
+ * @return False to discard the pixel, which then writes neither color nor
+ * depth.
+ */
+typedef bool (*FragmentFunc) (const Fragment *frag, void *user,
+                              Color8_t *out);
+
+/* pixels of a row a FragmentBatchFunc gets at once, one row of a block */
+#define FRAGMENT_BATCH 8
+
+/**
+ * @struct FragmentBatch
+ * @brief A run of pixels on one row of a triangle, for a FragmentBatchFunc.
+ *
+ * Attributes are stored an array per attribute with a slot per pixel, so
+ * a shader looping over all FRAGMENT_BATCH slots without branches is
+ * vectorized by the compiler, or can load them into SIMD registers itself.
+ * Slots past count, or whose mask bit is clear, hold meaningless values
+ * that are still safe to compute with.
+ */
+typedef struct
+{
+  float    depth[FRAGMENT_BATCH]; /**< Interpolated depth in [0, 1] */
+  float    varyings[CLIP_MAX_VARYINGS][FRAGMENT_BATCH]; /**< varyings[i][k] is varying i of slot k */
+  Color8_t color[FRAGMENT_BATCH]; /**< Interpolated vertex colors, replaced by the shaded ones */
+  int      x;          /**< Column of slot 0, slot k is at x + k */
+  int      y;          /**< Row of the run */
+  uint32_t count;      /**< Slots on the row, at most FRAGMENT_BATCH */
+  uint32_t mask;       /**< Bit k set if slot k is drawn; clear it to discard the pixel */
+  uint32_t components; /**< Number of varyings */
+} FragmentBatch;
+
+/**
+ * @brief Batched fragment function: shade up to FRAGMENT_BATCH pixels.
+ *
+ * @param batch The pixels, whose colors and mask it updates.
+ * @param user  DrawState.fragment_data.
+ */
+typedef void (*FragmentBatchFunc) (FragmentBatch *batch, void *user);
+
+/**
+ * @struct DrawState
+ * @brief Pipeline state applied to every primitive of a draw call.
+ *
+ * Start from draw_state_default() and change the fields needed.
+ */
+typedef struct
+{
+  DepthFunc  depth_func;  /**< Depth comparison, run before colors are interpolated */
+  bool       depth_write; /**< Store depths of passing pixels, off with DEPTH_EQUAL to shade after a depth pre-pass */
+  bool       color_write; /**< Write colors of passing pixels, off for a depth pre-pass */
+  RasterPath raster_path; /**< Triangle traversal, normally RASTER_PATH_AUTO */
+  CullMode   cull_mode;   /**< Faces dropped from the sign of their area before any pixel work, CULL_NONE by default */
+  FrontFace  front_face;  /**< Winding of front faces, FRONT_FACE_CCW by default */
+  ConservativeMode conservative; /**< Triangle coverage rule, for occlusion buffers and voxelization; touched pixels get clamped attributes */
+  FillMode   fill_mode;   /**< Triangle fill, FILL_SOLID by default */
+  Color8_t   wire_color;  /**< Edge color of FILL_SOLID_WIREFRAME, blended in the fill pass, opaque white by default */
+  float      wire_width;  /**< Edge width in pixels of FILL_SOLID_WIREFRAME, shared edges included, 1 by default */
+  const Mat4x4f_t *mvp;   /**< Object to clip space transform the draw runs on the buffer's positions, NULL if they already are in clip space or NDC */
+  uint32_t   clip_planes; /**< CLIP_* planes clip-space primitives are clipped against before the divide, the sides at a guard band; CLIP_ALL by default */
+  DrawStats *stats;       /**< Counts primitives per clipping path and vertex cache use when not NULL */
+  float      line_width;  /**< Line width in pixels, with butt ends at the exact endpoints, 1 by default */
+  bool       line_smooth; /**< Blend line edge pixels by coverage, storing depth only where fully covered */
+  float      point_size;  /**< Sprite size in pixels for vertices without ATTR_POINT_SIZE, 1 by default */
+  bool       point_round; /**< Draw points as discs instead of squares */
+  const AttributeSemantic *varyings; /**< Attributes interpolated for the fragment stage, up to 4 components each and CLIP_MAX_VARYINGS floats in all */
+  uint32_t   varying_count; /**< Number of entries in varyings */
+  FragmentFunc fragment_func; /**< Colors triangle pixels after the depth test and line pixels before it, NULL for the vertex color; points keep theirs */
+  FragmentBatchFunc fragment_batch; /**< Replaces fragment_func, a block row of a triangle at a time; pixels of lines and MSAA one at a time */
+  void      *fragment_data; /**< Passed to fragment_func or fragment_batch */
+} DrawState;
+
+/**
+ * @struct InstanceBuffer
+ * @brief Per-instance data of draw_index_buffer_instanced.
+ *
+ * The arrays are borrowed, not owned; both hold count entries.
+ */
+typedef struct
+{
+  const Mat4x4f_t *transforms; /**< Model matrix of each instance, object to world space */
+  const Color8_t  *colors;     /**< Color each instance's vertex colors are multiplied by, or NULL */
+  uint32_t         count;      /**< Number of instances */
+} InstanceBuffer;
+
+/**
+ * @brief Get the default draw state.
+ *
+ * DEPTH_LESS with depth and color writes enabled, which is also what the
+ * single-primitive draw functions use.
+ *
+ * @return The default DrawState.
+ */
+DrawState
+draw_state_default (void);
+
 /**
  * @brief Draw a single pixel to the framebuffer.
  *
@@ -82,16 +282,65 @@ draw_triangle_fill (Framebuffer *fb,
  * @param fb    Pointer to the framebuffer.
  * @param vb    Pointer to the vertex buffer containing vertex data.
  * @param prim  Primitive type to draw.
+ * @param state Draw state, or NULL for draw_state_default().
  */
 void
 draw_vertex_buffer (Framebuffer *fb,
                     const VertexBuffer *vb,
-                    PrimitiveType prim);
+                    PrimitiveType prim,
+                    const DrawState *state);
 
+/**
+ * @brief Draw primitives from an index buffer.
+ *
+ * Like draw_vertex_buffer, but vertices are taken in index buffer order.
+ * Indices outside the vertex buffer skip their primitive.
+ *
+ * Each referenced vertex is fetched and projected once per call into a
+ * post-transform buffer, and every primitive sharing it reuses the result.
+ *
+ * @param fb    Pointer to the framebuffer.
+ * @param ib    Pointer to the index buffer.
+ * @param vb    Pointer to the vertex buffer containing vertex data.
+ * @param prim  Primitive type to draw.
+ * @param state Draw state, or NULL for draw_state_default().
+ */
 void
 draw_index_buffer (Framebuffer* fb,
                    const IndexBuffer* ib,
                    const VertexBuffer* vb,
-                   PrimitiveType prim);
+                   PrimitiveType prim,
+                   const DrawState *state);
+
+/**
+ * @brief Draw an indexed mesh once per instance.
+ *
+ * Like draw_index_buffer called for every instance, with state->mvp as the
+ * view projection and the instance's model matrix applied first; without
+ * an mvp the instance matrices take clip space directly. The setup, the
+ * post-transform buffer and the index data are shared by all instances,
+ * and each instance transforms the mesh's positions in one batched pass.
+ * Like any draw with an mvp, instances always run in clip space, and are
+ * clipped against state->clip_planes. Instances whose bounds lie outside
+ * one of those planes are dropped before any of their vertices are
+ * transformed. Positions with w > 0, such as w = 1, are bounded after
+ * their divide. A mesh with any other w, or a state with no clip planes,
+ * draws every instance. Instance colors tint lines and triangles; points
+ * keep their vertex color.
+ *
+ * @param fb        Pointer to the framebuffer.
+ * @param ib        Pointer to the index buffer.
+ * @param vb        Pointer to the vertex buffer containing vertex data.
+ * @param instances Per-instance transforms and optional colors.
+ * @param prim      Primitive type to draw.
+ * @param state     Draw state, or NULL for draw_state_default().
+ */
+void
+draw_index_buffer_instanced (Framebuffer *fb,
+                             const IndexBuffer *ib,
+                             const VertexBuffer *vb,
+                             const InstanceBuffer *instances,
+                             PrimitiveType prim,
+                             const DrawState *state);
 
 #endif /* DRAW_H */
@@ -0,0 +1,180 @@
+#include "graphics/format.h"
+#include "utils/bit.h"
+#include <string.h>
+
+uint32_t
+attribute_format_size (AttributeFormat format)
+{
+  switch (format)
+    {
+    case ATTR_FORMAT_FLOAT16:
+    case ATTR_FORMAT_SNORM16:
+      return 2;
+    case ATTR_FORMAT_UNORM8:
+      return 1;
+    default:
+      return 4;
+    }
+}
+
+uint32_t
+attribute_format_elements (AttributeFormat format, uint32_t components)
+{
+  return format == ATTR_FORMAT_UNORM10_10_10_2 ? 1 : components;
+}
+
+void
+attribute_decode (AttributeFormat format, const uint8_t *src, size_t step,
+                  uint32_t components, float *out)
+{
+  switch (format)
+    {
+    case ATTR_FORMAT_FLOAT16:
+      for (uint32_t c = 0; c < components; ++c)
+        {
+          uint16_t h;
+          memcpy (&h, src + c * step, sizeof (h));
+          out[c] = half_to_float (h);
+        }
+      break;
+
+    case ATTR_FORMAT_SNORM16:
+      for (uint32_t c = 0; c < components; ++c)
+        {
+          int16_t v;
+          memcpy (&v, src + c * step, sizeof (v));
+          /* -32768 is -1 as well */
+          out[c] = v < -32767 ? -1.0f : v * (1.0f / 32767.0f);
+        }
+      break;
+
+    case ATTR_FORMAT_UNORM8:
+      for (uint32_t c = 0; c < components; ++c)
+        out[c] = src[c * step] * (1.0f / 255.0f);
+      break;
+
+    case ATTR_FORMAT_UNORM10_10_10_2:
+      {
+        uint32_t word;
+        memcpy (&word, src, sizeof (word));
+        for (uint32_t c = 0; c < components && c < 3; ++c)
+          out[c] = extract_bits_32 (word, 10 * c, 10) * (1.0f / 1023.0f);
+        if (components > 3)
+          out[3] = extract_bits_32 (word, 30, 2) * (1.0f / 3.0f);
+      }
+      break;
+
+    default:
+      for (uint32_t c = 0; c < components; ++c)
+        memcpy (&out[c], src + c * step, sizeof (float));
+      break;
+    }
+}
+
+uint16_t
+float_to_half (float f)
+{
+  uint32_t x;
+  memcpy (&x, &f, sizeof (x));
+
+  uint16_t sign = (uint16_t)((x >> 16) & 0x8000u);
+  uint32_t abs = x & 0x7FFFFFFFu;
+
+  /* nan stays nan, with a quiet bit set so it keeps a nonzero mantissa */
+  if (abs > 0x7F800000u)
+    return sign | 0x7E00u;
+
+  /* 65520 and up round to infinity */
+  if (abs >= 0x477FF000u)
+    return sign | 0x7C00u;
+
+  /* normal halves: rebias the exponent, round the mantissa to 10 bits */
+  if (abs >= 0x38800000u)
+    {
+      uint32_t h = (abs - 0x38000000u) >> 13;
+      uint32_t rest = abs & 0x1FFFu;
+      if (rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+        h++;
+      return sign | (uint16_t)h;
+    }
+
+  /* subnormal halves, or zero: shift the implicit one into the mantissa */
+  if (abs < 0x33000000u)
+    return sign;
+
+  uint32_t exponent = abs >> 23;
+  uint32_t mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+  uint32_t shift = 126 - exponent;
+  uint32_t h = mantissa >> shift;
+  uint32_t rest = mantissa & ((1u << shift) - 1u);
+  uint32_t halfway = 1u << (shift - 1);
+  if (rest > halfway || (rest == halfway && (h & 1u)))
+    h++;
+  return sign | (uint16_t)h;
+}
+
+float
+half_to_float (uint16_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+  uint32_t exponent = (h >> 10) & 0x1Fu;
+  uint32_t mantissa = h & 0x3FFu;
+  uint32_t x;
+
+  if (exponent == 0x1Fu)
+    x = sign | 0x7F800000u | (mantissa << 13);
+  else if (exponent)
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  else if (mantissa)
+    {
+      /* subnormal: normalize the mantissa */
+      exponent = 113;
+      while (!(mantissa & 0x400u))
+        {
+          mantissa <<= 1;
+          exponent--;
+        }
+      x = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+  else
+    x = sign;
+
+  float f;
+  memcpy (&f, &x, sizeof (f));
+  return f;
+}
+
+/* round v, clamped to [0, 1], to an integer in [0, max] */
+static inline uint32_t
+unorm_encode (float v, uint32_t max)
+{
+  if (!(v > 0.0f))
+    return 0;
+  if (v >= 1.0f)
+    return max;
+  return (uint32_t)(v * max + 0.5f);
+}
+
+int16_t
+float_to_snorm16 (float f)
+{
+  if (!(f > -1.0f))
+    return -32767;
+  if (f >= 1.0f)
+    return 32767;
+  float scaled = f * 32767.0f;
+  return (int16_t)(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+}
+
+uint8_t
+float_to_unorm8 (float f)
+{
+  return (uint8_t)unorm_encode (f, 255);
+}
+
+uint32_t
+float4_to_unorm10_10_10_2 (const float *v)
+{
+  return unorm_encode (v[0], 1023) | unorm_encode (v[1], 1023) << 10
+         | unorm_encode (v[2], 1023) << 20 | unorm_encode (v[3], 3) << 30;
+}
@@ -0,0 +1,99 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum  AttributeFormat
+ * @brief Encoding of the components of a vertex attribute.
+ *
+ * Normalized formats decode to [0, 1] (unorm) or [-1, 1] (snorm), so
+ * positions stored as snorm16 are scaled into the unit cube and scaled
+ * back by the model matrix.
+ */
+typedef enum
+{
+  ATTR_FORMAT_FLOAT32,          /**< 32-bit float per component */
+  ATTR_FORMAT_FLOAT16,          /**< IEEE 754 half float per component */
+  ATTR_FORMAT_SNORM16,          /**< int16_t per component, +-32767 is +-1 */
+  ATTR_FORMAT_UNORM8,           /**< uint8_t per component, 255 is 1 */
+  ATTR_FORMAT_UNORM10_10_10_2,  /**< x, y, z in 10 bits and w in 2 from bit 0 up, one uint32_t in all */
+} AttributeFormat;
+
+/**
+ * @brief Get the bytes one stored element of a format takes.
+ *
+ * An element is one component, except for packed formats, where it is all
+ * of the attribute's components in one word.
+ *
+ * @param format Attribute format.
+ * @return Bytes per element.
+ */
+uint32_t
+attribute_format_size (AttributeFormat format);
+
+/**
+ * @brief Get the number of stored elements of an attribute.
+ *
+ * @param format     Attribute format.
+ * @param components Number of components of the attribute.
+ * @return components, or 1 for packed formats.
+ */
+uint32_t
+attribute_format_elements (AttributeFormat format, uint32_t components);
+
+/**
+ * @brief Decode the components of one attribute to floats.
+ *
+ * @param format     Format of the stored components.
+ * @param src        First stored element.
+ * @param step       Bytes from one element to the next, the element size
+ *                   for interleaved data. Unused by packed formats.
+ * @param components Number of components to decode, at most 4.
+ * @param out        Receives the decoded components.
+ */
+void
+attribute_decode (AttributeFormat format, const uint8_t *src, size_t step,
+                  uint32_t components, float *out);
+
+/**
+ * @brief Convert a float to an IEEE 754 half, rounding to nearest even.
+ *
+ * @param f Value to convert; out of range values become infinity.
+ * @return The half's bits.
+ */
+uint16_t
+float_to_half (float f);
+
+/**
+ * @brief Convert an IEEE 754 half to a float, exactly.
+ *
+ * @param h The half's bits.
+ * @return The half's value.
+ */
+float
+half_to_float (uint16_t h);
+
+/**
+ * @brief Encode a float in [-1, 1] as snorm16, clamping outside of it.
+ */
+int16_t
+float_to_snorm16 (float f);
+
+/**
+ * @brief Encode a float in [0, 1] as unorm8, clamping outside of it.
+ */
+uint8_t
+float_to_unorm8 (float f);
+
+/**
+ * @brief Pack 4 floats in [0, 1] as unorm 10:10:10:2, clamping outside of it.
+ *
+ * @param v x, y, z in 10 bits each from bit 0 up, then w in the top 2.
+ * @return The packed word.
+ */
+uint32_t
+float4_to_unorm10_10_10_2 (const float *v);
+
+#endif /* FORMAT_H */
@@ -5,11 +5,18 @@
 #include "math/vector.h"
 #include "platform/framebuffer.h"
 
+/* sub-pixel precision of vertex positions (28.4 fixed point) */
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_MASK (SUBPIXEL_ONE - 1)
+
 typedef struct
 {
-  Vec2i_t pos;
+  Vec2i_t pos;   /* integer pixel coordinates */
   Color8_t color;
   float depth;
+  Vec2i_t sub;   /* sub-pixel offset from pos in [0, SUBPIXEL_ONE) steps */
+  float inv_w;   /* 1 / clip-space w, 0 when unknown (affine interpolation) */
 } Pixel_t;
 
 /* clang-format off */
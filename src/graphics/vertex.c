@@ -0,0 +1,261 @@
+#include "graphics/vertex.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VERTEX_SSE 1
+#else
+#define VERTEX_SSE 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VERTEX_NEON 1
+#else
+#define VERTEX_NEON 0
+#endif
+
+Vec4f_t
+vertex_transform_position (const Mat4x4f_t *m, const float *pos,
+                           uint32_t components)
+{
+  Vec4f_t v = { pos[0], components > 1 ? pos[1] : 0.0f,
+                components > 2 ? pos[2] : 0.0f,
+                components > 3 ? pos[3] : 1.0f };
+  return mat4x4f_mul_vec4f (m, &v);
+}
+
+#if VERTEX_SSE
+
+/*
+ * transform four vertices given as one register per component, x of all
+ * four in in[0] and so on. every output component is four multiply-adds
+ * with the matrix entries broadcast, and the results are transposed back
+ * to x, y, z, w. the sums run in the order of mat4x4f_mul_vec4f, so a
+ * batch gives the same bits as transforming its vertices one at a time.
+ */
+static inline void
+transform_soa4 (const Mat4x4f_t *m, const __m128 in[4], Vec4f_t *out)
+{
+  __m128 r[4];
+  for (int row = 0; row < 4; ++row)
+    {
+      const float *mr = &m->m[row * 4];
+      __m128 acc = _mm_mul_ps (_mm_set1_ps (mr[0]), in[0]);
+      acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (mr[1]), in[1]));
+      acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (mr[2]), in[2]));
+      r[row] = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (mr[3]), in[3]));
+    }
+  _MM_TRANSPOSE4_PS (r[0], r[1], r[2], r[3]);
+
+  for (int k = 0; k < 4; ++k)
+    _mm_storeu_ps (&out[k].x, r[k]);
+}
+
+/* transform the VERTEX_BATCH interleaved positions at src, stride apart */
+static inline void
+transform_batch (const Mat4x4f_t *m, const uint8_t *src, size_t stride,
+                 uint32_t components, Vec4f_t *out)
+{
+  __m128 in[4];
+  for (int k = 0; k < 4; ++k)
+    {
+      if (components == 4)
+        {
+          in[k] = _mm_loadu_ps ((const float *)(src + k * stride));
+          continue;
+        }
+      float v[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+      memcpy (v, src + k * stride, components * sizeof (float));
+      in[k] = _mm_loadu_ps (v);
+    }
+  _MM_TRANSPOSE4_PS (in[0], in[1], in[2], in[3]);
+  transform_soa4 (m, in, out);
+}
+
+/*
+ * transform VERTEX_BATCH positions of SoA arrays, read straight into the
+ * registers; components past the arrays are z = 0 and w = 1
+ */
+static inline void
+transform_batch_soa (const Mat4x4f_t *m, const float *const stream[4],
+                     size_t i, Vec4f_t *out)
+{
+  __m128 in[4];
+  for (int c = 0; c < 4; ++c)
+    in[c] = stream[c] ? _mm_load_ps (stream[c] + i)
+                      : _mm_set1_ps (c == 3 ? 1.0f : 0.0f);
+  transform_soa4 (m, in, out);
+}
+
+#elif VERTEX_NEON
+
+/* NEON version of the SSE transform_soa4 above */
+static inline void
+transform_soa4 (const Mat4x4f_t *m, const float32x4_t in[4], Vec4f_t *out)
+{
+  float32x4x4_t r;
+  for (int row = 0; row < 4; ++row)
+    {
+      const float *mr = &m->m[row * 4];
+      float32x4_t acc = vmulq_n_f32 (in[0], mr[0]);
+      acc = vaddq_f32 (acc, vmulq_n_f32 (in[1], mr[1]));
+      acc = vaddq_f32 (acc, vmulq_n_f32 (in[2], mr[2]));
+      r.val[row] = vaddq_f32 (acc, vmulq_n_f32 (in[3], mr[3]));
+    }
+
+  /* interleaving stores write x, y, z, w of each vertex in turn */
+  vst4q_f32 (&out[0].x, r);
+}
+
+static inline void
+transform_batch (const Mat4x4f_t *m, const uint8_t *src, size_t stride,
+                 uint32_t components, Vec4f_t *out)
+{
+  float soa[4][4];
+  for (int k = 0; k < 4; ++k)
+    {
+      float v[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+      memcpy (v, src + k * stride, components * sizeof (float));
+      for (int c = 0; c < 4; ++c)
+        soa[c][k] = v[c];
+    }
+
+  float32x4_t in[4];
+  for (int c = 0; c < 4; ++c)
+    in[c] = vld1q_f32 (soa[c]);
+  transform_soa4 (m, in, out);
+}
+
+static inline void
+transform_batch_soa (const Mat4x4f_t *m, const float *const stream[4],
+                     size_t i, Vec4f_t *out)
+{
+  float32x4_t in[4];
+  for (int c = 0; c < 4; ++c)
+    in[c] = stream[c] ? vld1q_f32 (stream[c] + i)
+                      : vdupq_n_f32 (c == 3 ? 1.0f : 0.0f);
+  transform_soa4 (m, in, out);
+}
+
+#endif
+
+/*
+ * vertex_transform_positions for positions in any other format than
+ * float32: a batch is decoded to floats first, then transformed as usual
+ */
+static void
+transform_positions_decoded (const Mat4x4f_t *m, const VertexBuffer *vb,
+                             uint32_t components, Vec4f_t *out)
+{
+  const VertexLayout *layout = &vb->layout;
+  AttributeFormat format = layout->formats[ATTR_POSITION];
+  const uint8_t *base = (const uint8_t *)vb->data;
+  size_t vertex_step;
+  size_t component_step;
+
+  if (layout->storage == VERTEX_STORAGE_SOA)
+    {
+      base += vb->streams[ATTR_POSITION];
+      vertex_step = layout->type_sizes[ATTR_POSITION];
+      component_step = vb->stream_pitch[ATTR_POSITION];
+    }
+  else
+    {
+      base += layout->offsets[ATTR_POSITION];
+      vertex_step = layout->vertex_stride;
+      component_step = layout->type_sizes[ATTR_POSITION];
+    }
+
+  uint32_t i = 0;
+
+#if VERTEX_SSE || VERTEX_NEON
+  for (; i + VERTEX_BATCH <= vb->vertex_count; i += VERTEX_BATCH)
+    {
+      float v[VERTEX_BATCH][4];
+      for (int k = 0; k < VERTEX_BATCH; ++k)
+        {
+          v[k][1] = 0.0f;
+          v[k][2] = 0.0f;
+          v[k][3] = 1.0f;
+          attribute_decode (format, base + (size_t)(i + k) * vertex_step,
+                            component_step, components, v[k]);
+        }
+      transform_batch (m, (const uint8_t *)v, sizeof (v[0]), 4, &out[i]);
+    }
+#endif
+
+  for (; i < vb->vertex_count; ++i)
+    {
+      float v[4];
+      attribute_decode (format, base + (size_t)i * vertex_step,
+                        component_step, components, v);
+      out[i] = vertex_transform_position (m, v, components);
+    }
+}
+
+/* vertex_transform_positions for SoA buffers */
+static void
+transform_positions_soa (const Mat4x4f_t *m, const VertexBuffer *vb,
+                         uint32_t components, Vec4f_t *out)
+{
+  const float *stream[4] = { NULL, NULL, NULL, NULL };
+  for (uint32_t c = 0; c < components; ++c)
+    stream[c] = vertex_buffer_stream (vb, ATTR_POSITION, c);
+  uint32_t i = 0;
+
+#if VERTEX_SSE || VERTEX_NEON
+  for (; i + VERTEX_BATCH <= vb->vertex_count; i += VERTEX_BATCH)
+    transform_batch_soa (m, stream, i, &out[i]);
+#endif
+
+  for (; i < vb->vertex_count; ++i)
+    {
+      float v[4];
+      for (uint32_t c = 0; c < components; ++c)
+        v[c] = stream[c][i];
+      out[i] = vertex_transform_position (m, v, components);
+    }
+}
+
+bool
+vertex_transform_positions (const Mat4x4f_t *m, const VertexBuffer *vb,
+                            Vec4f_t *out)
+{
+  uint32_t components = vb->layout.components[ATTR_POSITION];
+  if (!components || !vb->data)
+    return false;
+  if (components > 4)
+    components = 4;
+
+  if (vb->layout.formats[ATTR_POSITION] != ATTR_FORMAT_FLOAT32)
+    {
+      transform_positions_decoded (m, vb, components, out);
+      return true;
+    }
+  if (vb->layout.storage == VERTEX_STORAGE_SOA)
+    {
+      transform_positions_soa (m, vb, components, out);
+      return true;
+    }
+
+  const uint8_t *src
+      = (const uint8_t *)vb->data + vb->layout.offsets[ATTR_POSITION];
+  size_t stride = vb->layout.vertex_stride;
+  uint32_t i = 0;
+
+#if VERTEX_SSE || VERTEX_NEON
+  for (; i + VERTEX_BATCH <= vb->vertex_count; i += VERTEX_BATCH)
+    transform_batch (m, src + (size_t)i * stride, stride, components, &out[i]);
+#endif
+
+  for (; i < vb->vertex_count; ++i)
+    {
+      float v[4];
+      memcpy (v, src + (size_t)i * stride, components * sizeof (float));
+      out[i] = vertex_transform_position (m, v, components);
+    }
+
+  return true;
+}
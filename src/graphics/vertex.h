@@ -0,0 +1,43 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include "graphics/buffer.h"
+#include "math/matrix.h"
+#include "math/vector.h"
+
+/* vertices the transform handles per SIMD batch */
+#define VERTEX_BATCH 4
+
+/**
+ * @brief Transform the positions of a vertex buffer to clip space.
+ *
+ * Positions are read from the buffer's ATTR_POSITION attribute, 3 components
+ * taken with w = 1, and written to out as x, y, z, w; the buffer itself is
+ * left untouched. Batches of VERTEX_BATCH vertices are transformed together
+ * with SSE or NEON where available, the rest one at a time. Batches of SoA
+ * buffers load straight from the x, y and z arrays; interleaved ones are
+ * gathered and transposed first. Positions in other formats than float32
+ * are decoded as they are gathered.
+ *
+ * @param m   Transform, normally projection * view * model.
+ * @param vb  Vertex buffer with the object-space positions.
+ * @param out Receives vb->vertex_count clip-space positions.
+ * @return False if vb has no position attribute.
+ */
+bool
+vertex_transform_positions (const Mat4x4f_t *m, const VertexBuffer *vb,
+                            Vec4f_t *out);
+
+/**
+ * @brief Transform one position to clip space.
+ *
+ * @param m          Transform, normally projection * view * model.
+ * @param pos        Object-space position.
+ * @param components Number of components in pos, w = 1 if fewer than 4.
+ * @return The clip-space position.
+ */
+Vec4f_t
+vertex_transform_position (const Mat4x4f_t *m, const float *pos,
+                           uint32_t components);
+
+#endif /* VERTEX_H */
@@ -831,7 +831,7 @@ mat4x4f_lookat (Vec3f_t eye, Vec3f_t target, Vec3f_t up)
   return (Mat4x4f_t){ .m = {
      right.x,    right.y,     right.z,    -vec3f_dot(right, eye),
      true_up.x,  true_up.y,   true_up.z,  -vec3f_dot(true_up, eye),
-    -forward.x, -forward.y,  -forward.z,  -vec3f_dot(forward, eye),
+    -forward.x, -forward.y,  -forward.z,   vec3f_dot(forward, eye),
      0,          0,           0,           1
   }};
 }
@@ -842,10 +842,10 @@ mat4x4f_perspective (float fov, float aspect, float near, float far)
   float f = 1.0f / tanf (fov * 0.5f);
 
   return (Mat4x4f_t) {.m = {
-    f / aspect,  0.0f, 0.0f,                             0.0f,
-    0.0f,        f,    0.0f,                             0.0f,
-    0.0f,        0.0f, (far + near) / (near - far),     -1.0f,
-    0.0f,        0.0f, (2 * far * near) / (near - far),  0.0f
+    f / aspect,  0.0f, 0.0f,                         0.0f,
+    0.0f,        f,    0.0f,                         0.0f,
+    0.0f,        0.0f, (far + near) / (near - far),  (2 * far * near) / (near - far),
+    0.0f,        0.0f, -1.0f,                        0.0f
   }};
 }
 
@@ -7,29 +7,110 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 
-bool
-fb_init (Framebuffer* fb,
-         const char* path) {
-  if (!fb_open(fb, path)) return false;
-  if (!fb_get_info(fb))   return false;
-  if (!fb_map(fb))        return false;
-
+/* allocate the back, depth and Hi-Z buffers once vinfo is known */
+static bool
+fb_alloc_buffers (Framebuffer* fb) {
   fb->size = fb->vinfo.xres * fb->vinfo.yres * (fb->vinfo.bits_per_pixel / 8);
 
   uint8_t *back_buffer = (uint8_t*)malloc(fb->size);
   if (!back_buffer) { return false; }
   fb->back_buffer = back_buffer;
 
-  float *depth_buffer = (float*)malloc(fb->size);
+  size_t pixel_count = (size_t)fb->vinfo.xres * fb->vinfo.yres;
+
+  float *depth_buffer = (float*)malloc(pixel_count * sizeof(float));
   if (!depth_buffer) { return false; }
   fb->depth_buffer = depth_buffer;
 
+  fb->hiz_width  = (fb->vinfo.xres + FB_HIZ_TILE_SIZE - 1) / FB_HIZ_TILE_SIZE;
+  fb->hiz_height = (fb->vinfo.yres + FB_HIZ_TILE_SIZE - 1) / FB_HIZ_TILE_SIZE;
+
+  float *hiz_buffer = (float*)malloc((size_t)fb->hiz_width * fb->hiz_height * sizeof(float));
+  if (!hiz_buffer) { return false; }
+  fb->hiz_buffer = hiz_buffer;
+
+  uint16_t *hiz_writes = (uint16_t*)malloc((size_t)fb->hiz_width * fb->hiz_height * sizeof(uint16_t));
+  if (!hiz_writes) { return false; }
+  fb->hiz_writes = hiz_writes;
+
+  fb->samples = 1;
   fb->aspect = (float)fb->vinfo.xres / fb->vinfo.yres;
-  if (!fb->back_buffer) return false;
 
   return true;
 }
 
+bool
+fb_set_samples (Framebuffer* fb,
+                uint32_t samples) {
+  if (samples != 1 && samples != 2 && samples != 4) { return false; }
+
+  size_t pixel_count = (size_t)fb->vinfo.xres * fb->vinfo.yres;
+
+  float *depth_buffer = (float*)realloc(fb->depth_buffer, pixel_count * samples * sizeof(float));
+  if (!depth_buffer) { return false; }
+  fb->depth_buffer = depth_buffer;
+
+  free(fb->sample_colors);
+  free(fb->sample_split);
+  fb->sample_colors = NULL;
+  fb->sample_split = NULL;
+  fb->samples = 1;
+
+  if (samples > 1) {
+    uint32_t *sample_colors = (uint32_t*)malloc(pixel_count * samples * sizeof(uint32_t));
+    uint8_t *sample_split = (uint8_t*)malloc(pixel_count);
+    if (!sample_colors || !sample_split) {
+      free(sample_colors);
+      free(sample_split);
+      return false;
+    }
+    fb->sample_colors = sample_colors;
+    fb->sample_split = sample_split;
+    fb->samples = samples;
+  }
+
+  fb_clear(fb);
+  return true;
+}
+
+bool
+fb_init (Framebuffer* fb,
+         const char* path) {
+  /* buffers fb_init leaves unset must read as absent, not stack garbage */
+  memset(fb, 0, sizeof(*fb));
+  fb->fd = -1;
+
+  if (!fb_open(fb, path)) return false;
+  if (!fb_get_info(fb))   return false;
+  if (!fb_map(fb))        return false;
+
+  return fb_alloc_buffers(fb);
+}
+
+bool
+fb_init_memory (Framebuffer* fb,
+                uint32_t width,
+                uint32_t height) {
+  memset(fb, 0, sizeof(*fb));
+  fb->fd = -1;
+
+  fb->vinfo.xres            = width;
+  fb->vinfo.yres            = height;
+  fb->vinfo.bits_per_pixel  = 32;
+  fb->vinfo.red.offset      = 16;
+  fb->vinfo.red.length      = 8;
+  fb->vinfo.green.offset    = 8;
+  fb->vinfo.green.length    = 8;
+  fb->vinfo.blue.offset     = 0;
+  fb->vinfo.blue.length     = 8;
+  fb->finfo.line_length     = width * 4;
+
+  if (!fb_alloc_buffers(fb)) return false;
+
+  fb_clear(fb);
+  return true;
+}
+
 void
 fb_shutdown(Framebuffer* fb) {
   if (!fb) return;
@@ -42,6 +123,22 @@ fb_shutdown(Framebuffer* fb) {
     free(fb->depth_buffer);
   }
 
+  if (fb->hiz_buffer) {
+    free(fb->hiz_buffer);
+  }
+
+  if (fb->hiz_writes) {
+    free(fb->hiz_writes);
+  }
+
+  if (fb->sample_colors) {
+    free(fb->sample_colors);
+  }
+
+  if (fb->sample_split) {
+    free(fb->sample_split);
+  }
+
   fb_close(fb);
 }
 
@@ -50,15 +147,114 @@ fb_clear (Framebuffer* fb)
 {
   memset(fb->back_buffer, 0, fb->size);
 
-  size_t n = (float)fb->vinfo.xres * fb->vinfo.yres;
+  size_t pixel_count = (size_t)fb->vinfo.xres * fb->vinfo.yres;
+  size_t n = pixel_count * (fb->samples > 1 ? fb->samples : 1);
   for (size_t i = 0; i < n; ++i) {
     fb->depth_buffer[i] = 1.0f;
   }
+
+  if (fb->sample_colors) {
+    memset(fb->sample_colors, 0, n * sizeof(uint32_t));
+    memset(fb->sample_split, 0, pixel_count);
+  }
+
+  if (fb->hiz_buffer) {
+    size_t tiles = (size_t)fb->hiz_width * fb->hiz_height;
+    for (size_t i = 0; i < tiles; ++i) {
+      fb->hiz_buffer[i] = 1.0f;
+    }
+  }
+
+  if (fb->hiz_writes) {
+    memset(fb->hiz_writes, 0, (size_t)fb->hiz_width * fb->hiz_height * sizeof(uint16_t));
+  }
+}
+
+/*
+ * average n (2 or 4) packed pixels whose channels are whole bytes. the
+ * bytes are split into two 0x00FF00FF halves so each channel sums in its own
+ * 16-bit lane, four channels per two 32-bit adds.
+ */
+static inline uint32_t
+average_bytes (const uint32_t *s, uint32_t n, int shift)
+{
+  uint32_t lo = 0;
+  uint32_t hi = 0;
+  for (uint32_t k = 0; k < n; ++k) {
+    lo += s[k] & 0x00FF00FFu;
+    hi += (s[k] >> 8) & 0x00FF00FFu;
+  }
+
+  uint32_t round = (n >> 1) * 0x00010001u;
+  lo = ((lo + round) >> shift) & 0x00FF00FFu;
+  hi = ((hi + round) >> shift) & 0x00FF00FFu;
+  return lo | (hi << 8);
+}
+
+/* average n packed pixels channel by channel, for any pixel layout */
+static uint32_t
+average_channels (const Framebuffer* fb, const uint32_t *s, uint32_t n)
+{
+  const struct fb_bitfield *fields[4] = {
+    &fb->vinfo.red, &fb->vinfo.green, &fb->vinfo.blue, &fb->vinfo.transp
+  };
+
+  uint32_t result = 0;
+  for (int c = 0; c < 4; ++c) {
+    if (fields[c]->length == 0) continue;
+
+    uint32_t mask = (1u << fields[c]->length) - 1u;
+    uint32_t sum = 0;
+    for (uint32_t k = 0; k < n; ++k) {
+      sum += (s[k] >> fields[c]->offset) & mask;
+    }
+    result |= ((sum + n / 2) / n) << fields[c]->offset;
+  }
+  return result;
+}
+
+static inline bool
+is_byte_field (const struct fb_bitfield *f)
+{
+  return f->length == 0 || (f->length == 8 && f->offset % 8 == 0);
+}
+
+void
+fb_resolve (Framebuffer* fb)
+{
+  if (fb->samples <= 1) return;
+
+  uint32_t n = fb->samples;
+  int shift = n == 4 ? 2 : 1;
+  int bytes = fb->vinfo.bits_per_pixel / 8;
+  bool byte_lanes = bytes == 4
+                    && is_byte_field(&fb->vinfo.red)
+                    && is_byte_field(&fb->vinfo.green)
+                    && is_byte_field(&fb->vinfo.blue)
+                    && is_byte_field(&fb->vinfo.transp);
+
+  for (uint32_t y = 0; y < fb->vinfo.yres; ++y) {
+    size_t row = (size_t)y * fb->vinfo.xres;
+    uint8_t *dst = fb->back_buffer + (size_t)y * fb->finfo.line_length;
+
+    for (uint32_t x = 0; x < fb->vinfo.xres; ++x) {
+      /* pixels with one color are final in the back buffer already */
+      if (!fb->sample_split[row + x]) continue;
+
+      const uint32_t *s = fb->sample_colors + (row + x) * n;
+      uint32_t c = byte_lanes ? average_bytes(s, n, shift)
+                              : average_channels(fb, s, n);
+      memcpy(dst + (size_t)x * bytes, &c, bytes);
+    }
+  }
 }
 
 void
 fb_present (Framebuffer* fb)
 {
+  fb_resolve(fb);
+
+  if (!fb->fbp) return;
   memcpy(fb->fbp, fb->back_buffer, fb->size);
 }
 
@@ -7,6 +7,12 @@
 #include <stdint.h>
 #include <unistd.h>
 
+/* side in pixels of the square tiles tracked by the hierarchical z-buffer */
+#define FB_HIZ_TILE_SIZE 8
+
+/* most samples per pixel fb_set_samples accepts */
+#define FB_MAX_SAMPLES 4
+
 /**
  * @struct Framebuffer
  * @brief Represents a Linux framebuffer device.
@@ -21,7 +27,14 @@ typedef struct
   float                      aspect;        /**< Aspect ratio of the screen */
   uint8_t                   *fbp;           /**< Pointer to mapped framebuffer memory */
   uint8_t                   *back_buffer;   /**< Pointer to backbuffer */
-  float                     *depth_buffer;
+  float                     *depth_buffer;  /**< Depth per sample, samples of a pixel are adjacent */
+  float                     *hiz_buffer;    /**< Bound on the farthest depth per tile, exact after a recompute */
+  uint16_t                  *hiz_writes;    /**< Depths stored per tile since it was last recomputed */
+  uint32_t                   hiz_width;     /**< Number of tiles per row */
+  uint32_t                   hiz_height;    /**< Number of tile rows */
+  uint32_t                   samples;       /**< Samples per pixel, 1 (or 0) without multisampling */
+  uint32_t                  *sample_colors; /**< Packed color per sample, laid out like depth_buffer */
+  uint8_t                   *sample_split;  /**< Per pixel, 0 when sample 0 holds the color of all samples */
 } Framebuffer;
 
 /**
@@ -35,9 +48,54 @@ bool
 fb_init (Framebuffer* fb,
          const char* path);
 
+/**
+ * @brief Initializes an offscreen framebuffer that lives only in memory.
+ *
+ * Uses a 32-bit XRGB layout and allocates back, depth and Hi-Z buffers but
+ * opens no device, so fb_present only resolves multisampling. Useful for tests, benchmarks
+ * and headless rendering. Release it with fb_shutdown.
+ *
+ * @param fb     Pointer to a Framebuffer structure.
+ * @param width  Width in pixels.
+ * @param height Height in pixels.
+ * @return true if initialization is successful, false otherwise.
+ */
+bool
+fb_init_memory (Framebuffer* fb,
+                uint32_t width,
+                uint32_t height);
+
 void
 fb_shutdown(Framebuffer* fb);
 
+/**
+ * @brief Sets the number of samples per pixel for multisample anti-aliasing.
+ *
+ * Coverage and depth are kept per sample while color is shaded once per
+ * pixel. A pixel whose samples all hold the same color stores it once and
+ * is already final in the back buffer; only pixels along edges keep a color
+ * per sample, which fb_resolve averages. Reallocates the depth buffer and
+ * clears the framebuffer.
+ *
+ * @param fb      Pointer to an initialized Framebuffer structure.
+ * @param samples 1 to turn multisampling off, 2 or 4.
+ * @return true on success, false for an unsupported count or on allocation failure.
+ */
+bool
+fb_set_samples (Framebuffer* fb,
+                uint32_t samples);
+
+/**
+ * @brief Averages the samples of every pixel along an edge into the back buffer.
+ *
+ * Does nothing without multisampling. fb_present calls it, offscreen
+ * framebuffers call it before reading the back buffer.
+ *
+ * @param fb Pointer to a Framebuffer structure.
+ */
+void
+fb_resolve (Framebuffer* fb);
+
 /**
  * @brief Clears the framebuffer by resetting it to black.
  *
@@ -47,7 +105,7 @@ void
 fb_clear (Framebuffer* fb);
 
 /**
- * @brief Presents the back buffer to the framebuffer device.
+ * @brief Resolves multisampling and presents the back buffer to the framebuffer device.
  *
  * @param fb Pointer to a Framebuffer structure.
  */
@@ -12,4 +12,17 @@ extract_bits_32 (uint32_t value, int offset, int length)
   return (value >> offset) & mask;
 }
 
+static inline int
+popcount_32 (uint32_t value)
+{
+#if defined(__GNUC__)
+  return __builtin_popcount (value);
+#else
+  int count = 0;
+  for (; value; value &= value - 1u)
+    count++;
+  return count;
+#endif
+}
+
 #endif /* BIT_H */
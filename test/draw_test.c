@@ -0,0 +1,2843 @@
+#include "draw_test.h"
+#include "graphics/draw.h"
+#include "graphics/vertex.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FAIL_MSG(name) printf ("%s failed\n", (name))
+
+#define FB_WIDTH 64
+#define FB_HEIGHT 64
+
+/* number of pixels with any non-zero byte */
+static int
+count_pixels (const Framebuffer *fb)
+{
+  int count = 0;
+  const uint32_t *px = (const uint32_t *)fb->back_buffer;
+  for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i)
+    {
+      if (px[i] != 0)
+        count++;
+    }
+  return count;
+}
+
+/*
+ * two framebuffers a test draws the same scene into two ways, which must
+ * come out the same
+ */
+typedef struct
+{
+  Framebuffer expected;
+  Framebuffer actual;
+} FbPair;
+
+static bool
+fb_pair_init (FbPair *pair)
+{
+  if (!fb_init_memory (&pair->expected, FB_WIDTH, FB_HEIGHT))
+    return false;
+  if (fb_init_memory (&pair->actual, FB_WIDTH, FB_HEIGHT))
+    return true;
+  fb_shutdown (&pair->expected);
+  return false;
+}
+
+static void
+fb_pair_shutdown (FbPair *pair)
+{
+  fb_shutdown (&pair->expected);
+  fb_shutdown (&pair->actual);
+}
+
+static void
+fb_pair_clear (FbPair *pair)
+{
+  fb_clear (&pair->expected);
+  fb_clear (&pair->actual);
+}
+
+/* true if both hold the same colors and depths, multisampled ones resolved */
+static bool
+fb_pair_same (const FbPair *pair)
+{
+  const Framebuffer *e = &pair->expected;
+  const Framebuffer *a = &pair->actual;
+  size_t samples = a->samples > 1 ? a->samples : 1;
+  return memcmp (e->back_buffer, a->back_buffer, a->size) == 0
+         && memcmp (e->depth_buffer, a->depth_buffer,
+                    FB_WIDTH * FB_HEIGHT * samples * sizeof (float))
+                == 0;
+}
+
+static Pixel_t
+make_vertex (int x, int y)
+{
+  return (Pixel_t){
+    .pos = { x, y }, .color = { 255, 255, 255, 255 }, .depth = 0.5f
+  };
+}
+
+bool
+test_draw_triangle_fill_quad_coverage (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /* an 8x8 quad split along its diagonal covers exactly 64 pixel centers */
+  Pixel_t a = make_vertex (4, 4);
+  Pixel_t b = make_vertex (12, 4);
+  Pixel_t c = make_vertex (12, 12);
+  Pixel_t d = make_vertex (4, 12);
+
+  draw_triangle_fill (&fb, a, b, c);
+  draw_triangle_fill (&fb, a, c, d);
+
+  int count = count_pixels (&fb);
+  fb_shutdown (&fb);
+
+  if (count != 64)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* twice the edge function of a -> b at the center of pixel (x, y) */
+static long
+edge_at_center (Pixel_t a, Pixel_t b, int x, int y)
+{
+  return (long)(b.pos.x - a.pos.x) * (2 * y + 1 - 2 * a.pos.y)
+         - (long)(b.pos.y - a.pos.y) * (2 * x + 1 - 2 * a.pos.x);
+}
+
+bool
+test_draw_triangle_fill_traversal (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * triangles over several 32 pixel tiles and many 8 pixel blocks, so the
+   * traversal rejects, fills and tests blocks alike: large, long and thin,
+   * and reaching past the framebuffer, in both windings
+   */
+  const int corners[][6] = {
+    { 1, 2, 62, 9, 20, 61 },   { 0, 0, 63, 50, 60, 53 },
+    { 3, 60, 61, 3, 62, 7 },   { -20, 10, 80, 30, 30, 90 },
+    { 33, -40, 70, 70, -9, 40 }, { 8, 8, 40, 8, 8, 40 },
+  };
+  int n = sizeof (corners) / sizeof (corners[0]);
+
+  bool ok = true;
+  for (int i = 0; i < 2 * n; ++i)
+    {
+      const int *c = corners[i % n];
+      Pixel_t v[3] = { make_vertex (c[0], c[1]), make_vertex (c[2], c[3]),
+                       make_vertex (c[4], c[5]) };
+      if (i >= n)
+        {
+          Pixel_t tmp = v[1];
+          v[1] = v[2];
+          v[2] = tmp;
+        }
+
+      fb_clear (&fb);
+      draw_triangle_fill (&fb, v[0], v[1], v[2]);
+
+      /*
+       * every pixel drawn exactly when its center is inside, computed
+       * directly; centers on an edge are left to the fill rule tests
+       */
+      const uint32_t *px = (const uint32_t *)fb.back_buffer;
+      int covered = 0;
+      for (int y = 0; y < FB_HEIGHT; ++y)
+        for (int x = 0; x < FB_WIDTH; ++x)
+          {
+            long e0 = edge_at_center (v[0], v[1], x, y);
+            long e1 = edge_at_center (v[1], v[2], x, y);
+            long e2 = edge_at_center (v[2], v[0], x, y);
+            if (e0 == 0 || e1 == 0 || e2 == 0)
+              continue;
+
+            bool inside = (e0 > 0 && e1 > 0 && e2 > 0)
+                          || (e0 < 0 && e1 < 0 && e2 < 0);
+            if (inside != (px[y * FB_WIDTH + x] != 0))
+              ok = false;
+            covered += inside;
+          }
+      if (covered == 0)
+        ok = false;
+    }
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_triangle_fill_shared_edge (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /* a fan around a center vertex, every edge is shared by two triangles */
+  Pixel_t center = make_vertex (32, 32);
+  Pixel_t ring[] = {
+    make_vertex (10, 10), make_vertex (32, 4),  make_vertex (54, 10),
+    make_vertex (60, 32), make_vertex (54, 54), make_vertex (32, 60),
+    make_vertex (10, 54), make_vertex (4, 32),
+  };
+  int n = sizeof (ring) / sizeof (ring[0]);
+
+  int separate = 0;
+  for (int i = 0; i < n; ++i)
+    {
+      fb_clear (&fb);
+      draw_triangle_fill (&fb, center, ring[i], ring[(i + 1) % n]);
+      separate += count_pixels (&fb);
+    }
+
+  fb_clear (&fb);
+  for (int i = 0; i < n; ++i)
+    draw_triangle_fill (&fb, center, ring[i], ring[(i + 1) % n]);
+  int together = count_pixels (&fb);
+
+  fb_shutdown (&fb);
+
+  /* no pixel may be claimed by two triangles */
+  if (separate != together)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_triangle_fill_subpixel (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * a 4x4 quad moved by 7/16 of a pixel still covers 16 pixel centers, only
+   * shifted when the offset crosses a pixel center.
+   */
+  Pixel_t a = make_vertex (4, 4);
+  Pixel_t b = make_vertex (8, 4);
+  Pixel_t c = make_vertex (8, 8);
+  Pixel_t d = make_vertex (4, 8);
+  Pixel_t *quad[] = { &a, &b, &c, &d };
+  for (int i = 0; i < 4; ++i)
+    quad[i]->sub = (Vec2i_t){ 7, 7 };
+
+  draw_triangle_fill (&fb, a, b, c);
+  draw_triangle_fill (&fb, a, c, d);
+
+  int count = count_pixels (&fb);
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  bool first = px[4 * FB_WIDTH + 4] != 0 && px[7 * FB_WIDTH + 7] != 0;
+
+  fb_clear (&fb);
+  for (int i = 0; i < 4; ++i)
+    quad[i]->sub = (Vec2i_t){ 9, 9 };
+
+  draw_triangle_fill (&fb, a, b, c);
+  draw_triangle_fill (&fb, a, c, d);
+
+  count += count_pixels (&fb);
+  bool second = px[4 * FB_WIDTH + 4] == 0 && px[8 * FB_WIDTH + 8] != 0;
+
+  fb_shutdown (&fb);
+
+  if (count != 32 || !first || !second)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_triangle_fill_perspective (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /* black near edge at w = 1, red far edge at w = 4 */
+  Pixel_t a = make_vertex (0, 0);
+  Pixel_t b = make_vertex (32, 0);
+  Pixel_t c = make_vertex (32, 8);
+  Pixel_t d = make_vertex (0, 8);
+  a.color = d.color = (Color8_t){ 0, 0, 0, 255 };
+  b.color = c.color = (Color8_t){ 255, 0, 0, 255 };
+  a.inv_w = d.inv_w = 1.0f;
+  b.inv_w = c.inv_w = 0.25f;
+
+  draw_triangle_fill (&fb, a, b, c);
+  draw_triangle_fill (&fb, a, c, d);
+
+  /*
+   * center of pixel 16 is at s = 16.5 / 32 on screen, which is
+   * t = s / 4 / ((1 - s) + s / 4) ~ 0.21 of the way in clip space.
+   * affine interpolation would give ~0.52.
+   */
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  int red = (px[4 * FB_WIDTH + 16] >> 16) & 0xFF;
+
+  fb_shutdown (&fb);
+
+  if (red < 48 || red > 60)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+typedef struct
+{
+  float pos[3];
+  float col[4];
+} TestVertex;
+
+bool
+test_draw_depth_prepass (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  /* far red triangle, then a near green one crossing it, then a far blue */
+  const TestVertex vertices[] = {
+    { { -0.9f, -0.9f, 0.5f }, { 1, 0, 0, 1 } },
+    { { 0.9f, -0.9f, 0.5f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 0.9f, 0.5f }, { 1, 0, 0, 1 } },
+    { { -0.5f, 0.8f, -0.5f }, { 0, 1, 0, 1 } },
+    { { 0.5f, 0.8f, 0.8f }, { 0, 1, 0, 1 } },
+    { { 0.0f, -0.8f, 0.0f }, { 0, 1, 0, 1 } },
+    { { -0.8f, 0.0f, 0.9f }, { 0, 0, 1, 1 } },
+    { { 0.8f, 0.2f, 0.9f }, { 0, 0, 1, 1 } },
+    { { 0.0f, 0.6f, 0.9f }, { 0, 0, 1, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 9);
+
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, NULL);
+
+  DrawState depth_only = draw_state_default ();
+  depth_only.color_write = false;
+
+  DrawState shade_equal = draw_state_default ();
+  shade_equal.depth_func = DEPTH_EQUAL;
+  shade_equal.depth_write = false;
+
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, &depth_only);
+  int after_depth = count_pixels (&pair.actual);
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, &shade_equal);
+
+  bool same = fb_pair_same (&pair) && count_pixels (&pair.expected) > 0;
+
+  vertex_buffer_destroy (&vb);
+  fb_pair_shutdown (&pair);
+
+  if (after_depth != 0 || !same)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_span_path_coverage (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  /* a fan of thin, wide and off-screen triangles in both windings */
+  TestVertex vertices[3 * 12];
+  for (int i = 0; i < 12; ++i)
+    {
+      float a = (float)i * 0.52f;
+      float s = (i % 3 == 0) ? 1.7f : 0.95f;
+      TestVertex *v = &vertices[i * 3];
+      v[0] = (TestVertex){ { 0.03f * i - 0.2f, -0.1f, 0.0f }, { 1, 1, 1, 1 } };
+      v[1] = (TestVertex){ { s * cosf (a), s * sinf (a), 0.0f }, { 1, 0, 0, 1 } };
+      v[2] = (TestVertex){ { s * cosf (a + 0.05f * i), s * sinf (a + 0.05f * i),
+                             0.0f },
+                           { 0, 0, 1, 1 } };
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 3 * 12);
+
+  DrawState state = draw_state_default ();
+  state.raster_path = RASTER_PATH_BLOCKS;
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, &state);
+  state.raster_path = RASTER_PATH_SPANS;
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, &state);
+
+  bool same = fb_pair_same (&pair) && count_pixels (&pair.expected) > 0;
+
+  vertex_buffer_destroy (&vb);
+  fb_pair_shutdown (&pair);
+
+  if (!same)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_msaa_resolve (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT)
+      || !fb_set_samples (&fb, 4))
+    return false;
+
+  /* a square split along its diagonal, plus a lone triangle */
+  draw_triangle_fill (&fb, make_vertex (4, 4), make_vertex (28, 4),
+                      make_vertex (4, 28));
+  draw_triangle_fill (&fb, make_vertex (28, 4), make_vertex (28, 28),
+                      make_vertex (4, 28));
+  draw_triangle_fill (&fb, make_vertex (34, 34), make_vertex (60, 40),
+                      make_vertex (40, 60));
+  fb_resolve (&fb);
+
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  bool ok = true;
+
+  /* the shared diagonal has every sample covered by one of the halves */
+  for (int i = 6; i < 26; ++i)
+    {
+      size_t idx = (size_t)(32 - i) * FB_WIDTH + i;
+      if ((px[idx] & 0xFFFFFF) != 0xFFFFFF || fb.sample_split[idx])
+        ok = false;
+    }
+
+  /* the lone triangle's edges blend with the background */
+  int partial = 0;
+  for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i)
+    {
+      uint32_t r = (px[i] >> 16) & 0xFF;
+      if (r > 0 && r < 255)
+        partial++;
+    }
+  if (partial == 0)
+    ok = false;
+
+  /* interior pixels stay at one color */
+  size_t inside = (size_t)44 * FB_WIDTH + 44;
+  if ((px[inside] & 0xFFFFFF) != 0xFFFFFF || fb.sample_split[inside])
+    ok = false;
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_line_clipping (void)
+{
+  const int offset = 128;
+  const int big = FB_WIDTH + 2 * offset;
+
+  Framebuffer small;
+  Framebuffer large;
+  if (!fb_init_memory (&small, FB_WIDTH, FB_HEIGHT))
+    return false;
+  if (!fb_init_memory (&large, big, big))
+    {
+      fb_shutdown (&small);
+      return false;
+    }
+
+  /*
+   * lines crossing the edges of the small framebuffer, drawn again fully
+   * inside the large one shifted by offset. clipping must not move pixels,
+   * so the small framebuffer matches the matching window of the large one.
+   */
+  srand (7);
+  for (int i = 0; i < 400; ++i)
+    {
+      Pixel_t p0 = make_vertex (rand () % 264 - 100, rand () % 264 - 100);
+      Pixel_t p1 = make_vertex (rand () % 264 - 100, rand () % 264 - 100);
+      if (i % 8 == 0)
+        p1.pos.y = p0.pos.y;
+      if (i % 8 == 1)
+        p1.pos.x = p0.pos.x;
+      p0.color = (Color8_t){ (uint8_t)(i * 7), 40, 255, 255 };
+      p1.color = (Color8_t){ 255, (uint8_t)(i * 3), 0, 255 };
+      p0.depth = 0.25f + 0.001f * (i % 300);
+      p1.depth = 0.75f - 0.001f * (i % 200);
+
+      draw_line (&small, p0, p1);
+
+      p0.pos.x += offset;
+      p0.pos.y += offset;
+      p1.pos.x += offset;
+      p1.pos.y += offset;
+      draw_line (&large, p0, p1);
+    }
+
+  bool ok = count_pixels (&small) > 0;
+  for (int y = 0; y < FB_HEIGHT && ok; ++y)
+    {
+      const uint8_t *a = small.back_buffer + (size_t)y * small.finfo.line_length;
+      const uint8_t *b = large.back_buffer
+                         + (size_t)(y + offset) * large.finfo.line_length
+                         + (size_t)offset * 4;
+      if (memcmp (a, b, FB_WIDTH * 4) != 0)
+        ok = false;
+    }
+
+  fb_shutdown (&small);
+  fb_shutdown (&large);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* draw one line between framebuffer positions with the given state */
+static void
+draw_line_at (Framebuffer *fb, float x0, float y0, float x1, float y1,
+              const DrawState *state)
+{
+  TestVertex vertices[2] = {
+    { { x0 / 32.0f - 1.0f, 1.0f - y0 / 32.0f, 0.0f }, { 1, 1, 1, 1 } },
+    { { x1 / 32.0f - 1.0f, 1.0f - y1 / 32.0f, 0.0f }, { 1, 1, 1, 1 } },
+  };
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 2);
+  draw_vertex_buffer (fb, &vb, PRIM_LINES, state);
+  vertex_buffer_destroy (&vb);
+}
+
+bool
+test_draw_line_smooth_and_wide (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * a smooth line along a pixel boundary splits over two rows, its total
+   * intensity still matches its length
+   */
+  DrawState state = draw_state_default ();
+  state.line_smooth = true;
+  draw_line_at (&fb, 8.0f, 32.0f, 56.0f, 32.0f, &state);
+
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  int total = 0;
+  int partial = 0;
+  for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i)
+    {
+      int r = (px[i] >> 16) & 0xFF;
+      total += r;
+      if (r > 0 && r < 255)
+        partial++;
+    }
+  bool ok = partial > 0 && abs (total - 48 * 255) < 48 * 255 / 20;
+
+  /* a 5 pixel wide aliased line through pixel centers covers 5 rows */
+  fb_clear (&fb);
+  state = draw_state_default ();
+  state.line_width = 5.0f;
+  draw_line_at (&fb, 8.0f, 32.5f, 56.0f, 32.5f, &state);
+
+  if (count_pixels (&fb) != 5 * 48)
+    ok = false;
+  for (int y = 30; y <= 34; ++y)
+    {
+      if (px[y * FB_WIDTH + 8] == 0 || px[y * FB_WIDTH + 55] == 0)
+        ok = false;
+    }
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+typedef struct
+{
+  float pos[3];
+  float col[4];
+  float size;
+} TestPoint;
+
+static TestPoint
+make_point (float x, float y, float size, float r, float g)
+{
+  return (TestPoint){
+    { x / 32.0f - 1.0f, 1.0f - y / 32.0f, 0.0f }, { r, g, 0, 1 }, size
+  };
+}
+
+/* number of pixels with any non-zero byte inside [x0, x1] x [y0, y1] */
+static int
+count_pixels_in (const Framebuffer *fb, int x0, int y0, int x1, int y1)
+{
+  int count = 0;
+  const uint32_t *px = (const uint32_t *)fb->back_buffer;
+  for (int y = y0; y <= y1; ++y)
+    for (int x = x0; x <= x1; ++x)
+      if (px[y * FB_WIDTH + x] != 0)
+        count++;
+  return count;
+}
+
+bool
+test_draw_point_sprites (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  TestPoint points[] = {
+    make_point (10.5f, 10.5f, 3.0f, 1, 1),
+    make_point (50.5f, 10.5f, 5.0f, 1, 1),
+    make_point (5.2f, 60.7f, 1.0f, 1, 1),
+    make_point (32.5f, 32.5f, 6.0f, 1, 1),
+  };
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestPoint, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestPoint, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_POINT_SIZE, offsetof (TestPoint, size), sizeof (float), 1,
+      ATTR_FORMAT_FLOAT32 },
+  };
+
+  /* squares sized per vertex, and a disc */
+  VertexLayout layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+  VertexBuffer vb = vertex_buffer_create (points, layout, 3);
+  draw_vertex_buffer (&fb, &vb, PRIM_POINTS, NULL);
+  vertex_buffer_destroy (&vb);
+
+  DrawState state = draw_state_default ();
+  state.point_round = true;
+  layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+  vb = vertex_buffer_create (&points[3], layout, 1);
+  draw_vertex_buffer (&fb, &vb, PRIM_POINTS, &state);
+  vertex_buffer_destroy (&vb);
+
+  bool ok = count_pixels_in (&fb, 0, 0, 20, 20) == 9
+            && count_pixels_in (&fb, 40, 0, 63, 20) == 25
+            && count_pixels_in (&fb, 0, 50, 10, 63) == 1
+            && count_pixels_in (&fb, 20, 20, 45, 45) == 29
+            && count_pixels (&fb) == 9 + 25 + 1 + 29;
+
+  /*
+   * two overlapping points at the same depth straddling a tile edge, the
+   * first one drawn keeps the overlap like it would without binning
+   */
+  fb_clear (&fb);
+
+  TestPoint pair[] = {
+    make_point (28.5f, 30.5f, 12.0f, 1, 0),
+    make_point (36.5f, 34.5f, 12.0f, 0, 1),
+  };
+  layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+  vb = vertex_buffer_create (pair, layout, 2);
+  draw_vertex_buffer (&fb, &vb, PRIM_POINTS, NULL);
+  vertex_buffer_destroy (&vb);
+
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  if (px[32 * FB_WIDTH + 32] != 0xFF0000 || px[38 * FB_WIDTH + 40] != 0x00FF00)
+    ok = false;
+
+  /*
+   * a square and a disc of a size whose bounds overflow an int cover the
+   * whole framebuffer, a point off screen and smaller than its distance
+   * covers none of it
+   */
+  TestPoint huge[] = {
+    make_point (32.5f, 32.5f, 1e30f, 1, 1),
+    make_point (-40.5f, 32.5f, 60.0f, 1, 1),
+  };
+  for (int round = 0; round <= 1; ++round)
+    {
+      fb_clear (&fb);
+      state.point_round = round;
+      layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+      vb = vertex_buffer_create (huge, layout, 2);
+      draw_vertex_buffer (&fb, &vb, PRIM_POINTS, &state);
+      vertex_buffer_destroy (&vb);
+      if (count_pixels (&fb) != FB_WIDTH * FB_HEIGHT)
+        ok = false;
+
+      fb_clear (&fb);
+      layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+      vb = vertex_buffer_create (&huge[1], layout, 1);
+      draw_vertex_buffer (&fb, &vb, PRIM_POINTS, &state);
+      vertex_buffer_destroy (&vb);
+      if (count_pixels (&fb) != 0)
+        ok = false;
+    }
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/*
+ * clear fb and its depth buffer, then draw the triangle with pixel space
+ * corners a, b, c at depths 0.2 to 0.6
+ */
+static void
+draw_triangle_at (Framebuffer *fb, const float *a, const float *b,
+                  const float *c, const DrawState *state)
+{
+  fb_clear (fb);
+
+  const float *corners[] = { a, b, c };
+  TestVertex vertices[3];
+  for (int i = 0; i < 3; ++i)
+    {
+      vertices[i] = (TestVertex){
+        { corners[i][0] / 32.0f - 1.0f, 1.0f - corners[i][1] / 32.0f,
+          0.4f * i - 0.6f },
+        { 1, 1, 1, 1 }
+      };
+    }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 3);
+  draw_vertex_buffer (fb, &vb, PRIM_TRIANGLES, state);
+  vertex_buffer_destroy (&vb);
+}
+
+bool
+test_draw_conservative (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * right triangle with its legs on pixel edges: overestimation covers every
+   * pixel touching it, underestimation only those entirely inside
+   */
+  const float a[] = { 8, 8 }, b[] = { 40, 8 }, c[] = { 8, 40 };
+  int over = 0, under = 0;
+  for (int y = 0; y < FB_HEIGHT; ++y)
+    for (int x = 0; x < FB_WIDTH; ++x)
+      {
+        if (x >= 7 && y >= 7 && x <= 40 && y <= 40 && x + y <= 48)
+          over++;
+        if (x >= 8 && y >= 8 && x + y + 2 <= 48)
+          under++;
+      }
+
+  bool ok = true;
+  const RasterPath paths[] = { RASTER_PATH_AUTO, RASTER_PATH_BLOCKS,
+                               RASTER_PATH_SPANS };
+  DrawState state = draw_state_default ();
+  for (int i = 0; i < 3; ++i)
+    {
+      state.raster_path = paths[i];
+
+      state.conservative = CONSERVATIVE_OVER;
+      draw_triangle_at (&fb, a, b, c, &state);
+      if (count_pixels (&fb) != over
+          || count_pixels_in (&fb, 7, 7, 40, 40) != over)
+        ok = false;
+
+      /* depths written outside the triangle stay within its vertex depths */
+      for (int j = 0; j < FB_WIDTH * FB_HEIGHT; ++j)
+        {
+          float d = fb.depth_buffer[j];
+          if (d != 1.0f && (d < 0.2f - 1e-6f || d > 0.6f + 1e-6f))
+            ok = false;
+        }
+
+      state.conservative = CONSERVATIVE_UNDER;
+      draw_triangle_at (&fb, a, b, c, &state);
+      if (count_pixels (&fb) != under
+          || count_pixels_in (&fb, 8, 8, 38, 38) != under)
+        ok = false;
+    }
+
+  /* a triangle inside one pixel misses its center but still touches it */
+  const float ta[] = { 20.2f, 20.2f }, tb[] = { 20.6f, 20.2f },
+              tc[] = { 20.2f, 20.6f };
+  state = draw_state_default ();
+  const int expected[] = { 0, 1, 0 };
+  for (int mode = CONSERVATIVE_OFF; mode <= CONSERVATIVE_UNDER; ++mode)
+    {
+      state.conservative = (ConservativeMode)mode;
+      draw_triangle_at (&fb, ta, tb, tc, &state);
+      if (count_pixels (&fb) != expected[mode]
+          || count_pixels_in (&fb, 20, 20, 20, 20) != expected[mode])
+        ok = false;
+    }
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_solid_wireframe (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  /* a quad from two triangles sharing the diagonal */
+  const TestVertex vertices[] = {
+    { { -0.75f, -0.75f, 0.0f }, { 1, 0, 0, 1 } },
+    { { 0.75f, -0.75f, 0.0f }, { 1, 0, 0, 1 } },
+    { { 0.75f, 0.75f, 0.0f }, { 1, 0, 0, 1 } },
+    { { -0.75f, -0.75f, 0.0f }, { 1, 0, 0, 1 } },
+    { { 0.75f, 0.75f, 0.0f }, { 1, 0, 0, 1 } },
+    { { -0.75f, 0.75f, 0.0f }, { 1, 0, 0, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 6);
+
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, NULL);
+
+  DrawState state = draw_state_default ();
+  state.fill_mode = FILL_SOLID_WIREFRAME;
+  state.wire_color = (Color8_t){ 0, 255, 0, 255 };
+  state.wire_width = 2.0f;
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  /*
+   * the quad spans pixels 8..55. the outline covers the outermost pixel
+   * row and column, the diagonal the pixels it passes through, and the
+   * same pixels as the plain fill are drawn with the same depths.
+   */
+  const uint32_t *px = (const uint32_t *)pair.actual.back_buffer;
+  bool ok = count_pixels (&pair.actual) == count_pixels (&pair.expected)
+            && memcmp (pair.expected.depth_buffer, pair.actual.depth_buffer,
+                       FB_WIDTH * FB_HEIGHT * sizeof (float))
+                   == 0
+            && px[8 * FB_WIDTH + 30] == 0x00FF00
+            && px[55 * FB_WIDTH + 30] == 0x00FF00
+            && px[30 * FB_WIDTH + 8] == 0x00FF00
+            && px[30 * FB_WIDTH + 55] == 0x00FF00
+            && px[31 * FB_WIDTH + 32] == 0x00FF00
+            && px[12 * FB_WIDTH + 30] == 0xFF0000
+            && px[40 * FB_WIDTH + 20] == 0xFF0000;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+typedef struct
+{
+  float pos[4];
+  float col[4];
+} TestClipVertex;
+
+bool
+test_draw_clip_near_plane (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * the top vertex is behind the camera. clipped at z = -w the triangle
+   * becomes a trapezoid over rows 43 to 47, where dividing by the negative
+   * w would have thrown the vertex to the bottom of the screen.
+   */
+  const TestClipVertex vertices[] = {
+    { { -0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 1.0f, -3.0f, -1.0f }, { 0, 0, 1, 1 } },
+    { { -0.5f, -0.5f, -3.0f, -1.0f }, { 1, 0, 0, 1 } },
+    { { 0.5f, -0.5f, -3.0f, -1.0f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 1.0f, -3.0f, -1.0f }, { 0, 0, 1, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 6);
+  draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  int count = count_pixels (&fb);
+  bool ok = count > 0 && count_pixels_in (&fb, 10, 43, 53, 47) == count;
+
+  /* the same through the clipper directly */
+  ClipVertex in[3];
+  memset (in, 0, sizeof (in));
+  for (int i = 0; i < 3; ++i)
+    {
+      memcpy (in[i].pos, vertices[i].pos, sizeof (in[i].pos));
+      memcpy (in[i].color, vertices[i].col, sizeof (in[i].color));
+    }
+
+  ClipVertex out[CLIP_MAX_VERTICES];
+  uint32_t n = clip_triangle (in, CLIP_ALL, 1.0f, out);
+  if (n != 4)
+    ok = false;
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      if (out[i].pos[2] + out[i].pos[3] < -1e-6f)
+        ok = false;
+    }
+  /* new vertices are a fifth of the way to the clipped one */
+  if (n == 4
+      && (fabsf (out[0].pos[3] - 0.6f) > 1e-6f
+          || fabsf (out[0].color[2] - 0.2f) > 1e-6f
+          || fabsf (out[3].pos[1] + 0.2f) > 1e-6f))
+    ok = false;
+
+  /* inside triangles pass through as they are, outside ones vanish */
+  in[2].pos[2] = 0.5f;
+  in[2].pos[3] = 1.0f;
+  if (clip_triangle (in, CLIP_ALL, 1.0f, out) != 3
+      || memcmp (in, out, 3 * sizeof (ClipVertex)) != 0)
+    ok = false;
+  memcpy (in[0].pos, vertices[3].pos, sizeof (in[0].pos));
+  memcpy (in[1].pos, vertices[4].pos, sizeof (in[1].pos));
+  memcpy (in[2].pos, vertices[5].pos, sizeof (in[2].pos));
+  if (clip_triangle (in, CLIP_ALL, 1.0f, out) != 0)
+    ok = false;
+
+  /* a line through the near plane keeps its front part */
+  ClipVertex a = in[0];
+  ClipVertex b = { { 0.0f, 0.0f, 0.0f, 1.0f }, { 0, 1, 0, 1 }, { 0 } };
+  a.pos[2] = -2.0f;
+  a.pos[3] = 0.0f;
+  if (!clip_line (&a, &b, CLIP_NEAR_FAR, 1.0f)
+      || fabsf (a.pos[2] + a.pos[3]) > 1e-6f || b.pos[3] != 1.0f)
+    ok = false;
+  a.pos[2] = -2.0f;
+  b = a;
+  if (clip_line (&a, &b, CLIP_NEAR_FAR, 1.0f))
+    ok = false;
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_clip_w_zero (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /*
+   * the top vertex has a w of 0, a point at infinity along +y. the side
+   * planes cut the triangle into a strip from its base up to the top
+   * edge; without them nothing cuts the vertex, and the triangle is
+   * dropped instead of being drawn as though the vertex were in NDC.
+   */
+  const TestClipVertex vertices[] = {
+    { { -0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 1.0f, 0.0f, 0.0f }, { 0, 0, 1, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 3);
+
+  draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, NULL);
+  int count = count_pixels (&fb);
+  bool ok = count > 0 && count_pixels_in (&fb, 15, 0, 48, 48) == count
+            && count_pixels_in (&fb, 30, 0, 33, 2) > 0;
+
+  fb_clear (&fb);
+  DrawState state = draw_state_default ();
+  state.clip_planes = CLIP_NEAR_FAR;
+  draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, &state);
+  if (count_pixels (&fb) != 0)
+    ok = false;
+
+  vertex_buffer_destroy (&vb);
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_guard_band (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  const TestClipVertex vertices[] = {
+    /* inside the view */
+    { { -0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    /* off the right edge, within the guard band */
+    { { 0.0f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 3.0f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 0.0f, 0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    /* left of the view */
+    { { -3.0f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { -1.5f, -0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { -3.0f, 0.5f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    /* past the guard band, covering the whole view */
+    { { -1.0f, -1.0f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { 1e6f, -1.0f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+    { { -1.0f, 1e6f, 0.0f, 1.0f }, { 1, 0, 0, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+
+  DrawStats stats = { 0 };
+  DrawState state = draw_state_default ();
+  state.stats = &stats;
+
+  /* the first three together, so the culled one must not add pixels */
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 9);
+  draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  /* the second one reaches the right edge, up to its hypotenuse */
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  bool ok = count_pixels_in (&fb, 0, 0, 15, 63) == 0
+            && count_pixels_in (&fb, 0, 48, 63, 63) == 0
+            && px[47 * FB_WIDTH + 63] != 0 && px[17 * FB_WIDTH + 63] == 0
+            && stats.triangles_inside == 1 && stats.triangles_guard_band == 1
+            && stats.triangles_culled == 1 && stats.triangles_clipped == 0;
+
+  fb_clear (&fb);
+  layout = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  vb = vertex_buffer_create (&vertices[9], layout, 3);
+  draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  if (count_pixels (&fb) != FB_WIDTH * FB_HEIGHT
+      || stats.triangles_clipped != 1)
+    ok = false;
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_cull_mode (void)
+{
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  /* left triangle counter-clockwise with y up, right one clockwise */
+  const TestVertex vertices[] = {
+    { { -0.9f, -0.5f, 0.0f }, { 1, 0, 0, 1 } },
+    { { -0.1f, -0.5f, 0.0f }, { 1, 0, 0, 1 } },
+    { { -0.5f, 0.5f, 0.0f }, { 1, 0, 0, 1 } },
+    { { 0.1f, -0.5f, 0.0f }, { 0, 1, 0, 1 } },
+    { { 0.5f, 0.5f, 0.0f }, { 0, 1, 0, 1 } },
+    { { 0.9f, -0.5f, 0.0f }, { 0, 1, 0, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 6);
+
+  unsigned int indices[] = { 0, 1, 2, 3, 4, 5 };
+  IndexBuffer ib = index_buffer_create (indices, 6);
+
+  const CullMode modes[] = { CULL_NONE, CULL_BACK, CULL_FRONT, CULL_BACK };
+  const FrontFace faces[] = { FRONT_FACE_CCW, FRONT_FACE_CCW, FRONT_FACE_CCW,
+                              FRONT_FACE_CW };
+  /* whether the left and the right triangle are expected */
+  const bool left[] = { true, true, false, false };
+  const bool right[] = { true, false, true, true };
+
+  bool ok = true;
+  DrawState state = draw_state_default ();
+  for (int i = 0; i < 4; ++i)
+    {
+      state.cull_mode = modes[i];
+      state.front_face = faces[i];
+
+      for (int indexed = 0; indexed < 2; ++indexed)
+        {
+          fb_clear (&fb);
+          if (indexed)
+            draw_index_buffer (&fb, &ib, &vb, PRIM_TRIANGLES, &state);
+          else
+            draw_vertex_buffer (&fb, &vb, PRIM_TRIANGLES, &state);
+
+          if ((count_pixels_in (&fb, 0, 0, 31, 63) > 0) != left[i]
+              || (count_pixels_in (&fb, 32, 0, 63, 63) > 0) != right[i])
+            ok = false;
+        }
+    }
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&vb);
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_vertex_cache (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  /* a 4 x 4 cell grid in clip space, two triangles per cell */
+  enum { CELLS = 4, SIDE = CELLS + 1 };
+  TestClipVertex vertices[SIDE * SIDE];
+  for (int y = 0; y < SIDE; ++y)
+    for (int x = 0; x < SIDE; ++x)
+      {
+        float w = 1.0f + 0.25f * y;
+        vertices[y * SIDE + x] = (TestClipVertex){
+          { (0.4f * x - 0.8f) * w, (0.4f * y - 0.8f) * w, 0.0f, w },
+          { 0.25f * x, 0.25f * y, 1, 1 }
+        };
+      }
+
+  unsigned int indices[CELLS * CELLS * 6];
+  TestClipVertex flat[CELLS * CELLS * 6];
+  int n = 0;
+  for (int y = 0; y < CELLS; ++y)
+    for (int x = 0; x < CELLS; ++x)
+      {
+        unsigned int i0 = y * SIDE + x;
+        unsigned int quad[6] = { i0, i0 + 1, i0 + SIDE + 1,
+                                 i0, i0 + SIDE + 1, i0 + SIDE };
+        for (int k = 0; k < 6; ++k, ++n)
+          {
+            indices[n] = quad[k];
+            flat[n] = vertices[quad[k]];
+          }
+      }
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+
+  DrawStats stats = { 0 };
+  DrawState state = draw_state_default ();
+  state.stats = &stats;
+
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, SIDE * SIDE);
+  IndexBuffer ib = index_buffer_create (indices, n);
+  draw_index_buffer (&pair.actual, &ib, &vb, PRIM_TRIANGLES, &state);
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&vb);
+
+  /* every vertex transformed once, every other reference a hit */
+  bool ok = stats.vertices_transformed == SIDE * SIDE
+            && stats.vertex_cache_hits == (uint64_t)(n - SIDE * SIDE);
+
+  layout = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  vb = vertex_buffer_create (flat, layout, n);
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair))
+    ok = false;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_vertex_stage (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  /* seven vertices, a full SIMD batch and a scalar tail */
+  enum { COUNT = 7 };
+  static const float corners[COUNT][3] = {
+    { -1.0f, -0.8f, 0.2f }, { 0.9f, -0.6f, 0.0f }, { 0.1f, 1.0f, -0.3f },
+    { -0.7f, 0.2f, 0.5f },  { 0.3f, -1.0f, 0.4f }, { 0.8f, 0.7f, -0.5f },
+    { 0.0f, 0.0f, 1.0f },
+  };
+  TestClipVertex object[COUNT];
+  for (int i = 0; i < COUNT; ++i)
+    object[i] = (TestClipVertex){
+      { corners[i][0], corners[i][1], corners[i][2], 1.0f },
+      { 0.1f * i, 1, 0.5f, 1 }
+    };
+
+  Mat4x4f_t model = mat4x4f_identity ();
+  model = mat4x4f_rotation (&model, (Vec3f_t){ 0.3f, 0.5f, 0.7f });
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 3 }, (Vec3f_t){ 0, 0, 0 },
+                                   (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t projection = mat4x4f_perspective (1.0f, 1.0f, 0.1f, 10.0f);
+  Mat4x4f_t mvp = mat4x4f_mul (&view, &model);
+  mvp = mat4x4f_mul (&projection, &mvp);
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  VertexBuffer vb = vertex_buffer_create (object, layout, COUNT);
+
+  bool ok = true;
+  Vec4f_t out[COUNT];
+  TestClipVertex clip[COUNT];
+  if (!vertex_transform_positions (&mvp, &vb, out))
+    ok = false;
+
+  for (int i = 0; i < COUNT && ok; ++i)
+    {
+      Vec4f_t v = { object[i].pos[0], object[i].pos[1], object[i].pos[2], 1 };
+      Vec4f_t e = mat4x4f_mul_vec4f (&mvp, &v);
+      if (fabsf (out[i].x - e.x) > 1e-5f || fabsf (out[i].y - e.y) > 1e-5f
+          || fabsf (out[i].z - e.z) > 1e-5f || fabsf (out[i].w - e.w) > 1e-5f)
+        ok = false;
+
+      clip[i] = object[i];
+      memcpy (clip[i].pos, &e, sizeof (clip[i].pos));
+    }
+
+  DrawState state = draw_state_default ();
+  state.mvp = &mvp;
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, &state);
+
+  /* the draw leaves the object-space positions alone */
+  if (memcmp (vb.data, object, sizeof (object)) != 0)
+    ok = false;
+  vertex_buffer_destroy (&vb);
+
+  layout = vertex_layout_create (attributes, 2, sizeof (TestClipVertex));
+  vb = vertex_buffer_create (clip, layout, COUNT);
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair))
+    ok = false;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_vertex_layout (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  typedef struct
+  {
+    float normal[3];
+    float col[4];
+    float pos[3];
+  } TestLayoutVertex;
+
+  TestLayoutVertex vertices[] = {
+    { { 0, 0, 1 }, { 1, 0, 0, 1 }, { -0.8f, -0.7f, 0.0f } },
+    { { 0, 0, 1 }, { 0, 1, 0, 1 }, { 0.9f, -0.5f, 0.0f } },
+    { { 0, 0, 1 }, { 0, 0, 1, 1 }, { 0.1f, 0.8f, 0.0f } },
+  };
+
+  /* the first of two position attributes wins, the normal is ignored */
+  VertexAttribute attributes[] = {
+    { ATTR_NORMAL, offsetof (TestLayoutVertex, normal), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_POSITION, offsetof (TestLayoutVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestLayoutVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_POSITION, offsetof (TestLayoutVertex, normal), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout
+      = vertex_layout_create (attributes, 4, sizeof (TestLayoutVertex));
+
+  bool ok = layout.format == VERTEX_FORMAT_P3F_C4F
+            && layout.offsets[ATTR_POSITION] == offsetof (TestLayoutVertex, pos)
+            && layout.offsets[ATTR_COLOR] == offsetof (TestLayoutVertex, col)
+            && layout.components[ATTR_NORMAL] == 3
+            && layout.components[ATTR_TEXCOORD] == 0;
+
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, 3);
+  TestLayoutVertex *stored = vb.data;
+  if (get_attribute_pointer (&vb, 2, ATTR_COLOR) != stored[2].col
+      || get_attribute_pointer (&vb, 0, ATTR_TEXCOORD) != NULL
+      || get_attribute_pointer (&vb, 3, ATTR_COLOR) != NULL)
+    ok = false;
+  draw_vertex_buffer (&pair.expected, &vb, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  /* 2-component positions take the pair.actual fetch, z is 0 like above */
+  attributes[1].component_count = 2;
+  layout = vertex_layout_create (attributes, 3, sizeof (TestLayoutVertex));
+  if (layout.format != VERTEX_FORMAT_GENERIC)
+    ok = false;
+  vb = vertex_buffer_create (vertices, layout, 3);
+  draw_vertex_buffer (&pair.actual, &vb, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  if (count_pixels (&pair.expected) == 0 || !fb_pair_same (&pair))
+    ok = false;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* draw vb with the given primitive and state into a cleared fb */
+static void
+draw_prim (Framebuffer *fb, const VertexBuffer *vb, const IndexBuffer *ib,
+           PrimitiveType prim, const DrawState *state)
+{
+  fb_clear (fb);
+  if (ib)
+    draw_index_buffer (fb, ib, vb, prim, state);
+  else
+    draw_vertex_buffer (fb, vb, prim, state);
+}
+
+bool
+test_draw_vertex_soa (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  enum { COUNT = 7 };
+  static const float corners[COUNT][2] = {
+    { -0.9f, -0.8f }, { 0.8f, -0.6f }, { 0.1f, 0.9f }, { -0.6f, 0.3f },
+    { 0.4f, -0.9f },  { 0.7f, 0.6f },  { 0.0f, 0.1f },
+  };
+  TestPoint vertices[COUNT * 2];
+  for (int i = 0; i < COUNT * 2; ++i)
+    vertices[i] = (TestPoint){
+      { corners[i % COUNT][0], corners[i % COUNT][1], 0.1f * (i % COUNT) },
+      { 0.1f * i, 1, 0.5f, 1 },
+      1.0f + i
+    };
+
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestPoint, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestPoint, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_POINT_SIZE, offsetof (TestPoint, size), sizeof (float), 1,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexLayout layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+  VertexBuffer aos = vertex_buffer_create (vertices, layout, COUNT);
+  layout = vertex_layout_create (attributes, 3, sizeof (TestPoint));
+  layout.storage = VERTEX_STORAGE_SOA;
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, COUNT);
+
+  bool ok = true;
+  const float *y = vertex_buffer_stream (&vb, ATTR_POSITION, 1);
+  const float *size = vertex_buffer_stream (&vb, ATTR_POINT_SIZE, 0);
+  if (!y || !size || (uintptr_t)y % VERTEX_STREAM_ALIGN != 0
+      || y[4] != vertices[4].pos[1] || size[6] != vertices[6].size
+      || vertex_buffer_stream (&vb, ATTR_POSITION, 3) != NULL
+      || vertex_buffer_stream (&aos, ATTR_POSITION, 0) != NULL
+      || *(float *)get_attribute_pointer (&vb, 5, ATTR_COLOR) != 0.5f)
+    ok = false;
+
+  /* direct SoA loads give the same bits as the pair.expected gather */
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 2 }, (Vec3f_t){ 0, 0, 0 },
+                                   (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t mvp = mat4x4f_perspective (1.0f, 1.0f, 0.1f, 10.0f);
+  mvp = mat4x4f_mul (&mvp, &view);
+  Vec4f_t from_aos[COUNT];
+  Vec4f_t from_soa[COUNT];
+  if (!vertex_transform_positions (&mvp, &aos, from_aos)
+      || !vertex_transform_positions (&mvp, &vb, from_soa)
+      || memcmp (from_aos, from_soa, sizeof (from_aos)) != 0)
+    ok = false;
+
+  unsigned int indices[] = { 0, 1, 1, 2, 2, 3, 3, 6, 6, 5 };
+  IndexBuffer ib = index_buffer_create (indices, 10);
+  DrawState state = draw_state_default ();
+  state.mvp = &mvp;
+
+  struct
+  {
+    PrimitiveType prim;
+    const IndexBuffer *ib;
+    const DrawState *state;
+  } draws[] = {
+    { PRIM_TRIANGLES, NULL, NULL },
+    { PRIM_TRIANGLES, NULL, &state },
+    { PRIM_LINES, &ib, NULL },
+    { PRIM_POINTS, NULL, NULL },
+  };
+  for (size_t d = 0; d < sizeof (draws) / sizeof (draws[0]); ++d)
+    {
+      draw_prim (&pair.expected, &aos, draws[d].ib, draws[d].prim,
+                 draws[d].state);
+      draw_prim (&pair.actual, &vb, draws[d].ib, draws[d].prim, draws[d].state);
+      if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair))
+        ok = false;
+    }
+
+  /* growing past the arrays moves them, still aligned */
+  vertex_buffer_update (&vb, vertices, sizeof (vertices));
+  y = vertex_buffer_stream (&vb, ATTR_POSITION, 1);
+  size = vertex_buffer_stream (&vb, ATTR_POINT_SIZE, 0);
+  if (vb.vertex_count != COUNT * 2 || !y
+      || (uintptr_t)size % VERTEX_STREAM_ALIGN != 0
+      || y[COUNT + 2] != vertices[COUNT + 2].pos[1]
+      || size[COUNT * 2 - 1] != vertices[COUNT * 2 - 1].size)
+    ok = false;
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&aos);
+  vertex_buffer_destroy (&vb);
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_vertex_formats (void)
+{
+  bool ok = true;
+
+  /* encode and decode round trips */
+  float decoded[4];
+  uint16_t half = float_to_half (0.1f);
+  int16_t snorm[2] = { float_to_snorm16 (-2.0f), float_to_snorm16 (0.5f) };
+  uint8_t unorm[2] = { float_to_unorm8 (0.2f), float_to_unorm8 (1.5f) };
+  uint32_t packed
+      = float4_to_unorm10_10_10_2 ((const float[4]){ 0.0f, 0.5f, 1.0f, 1.0f });
+
+  if (fabsf (half_to_float (half) - 0.1f) > 1e-4f
+      || half_to_float (float_to_half (-3.25f)) != -3.25f
+      || half_to_float (float_to_half (1e6f)) != INFINITY)
+    ok = false;
+
+  attribute_decode (ATTR_FORMAT_SNORM16, (const uint8_t *)snorm,
+                    sizeof (int16_t), 2, decoded);
+  if (decoded[0] != -1.0f || fabsf (decoded[1] - 0.5f) > 1.0f / 32767.0f)
+    ok = false;
+
+  attribute_decode (ATTR_FORMAT_UNORM8, unorm, 1, 2, decoded);
+  if (unorm[0] != 51 || fabsf (decoded[0] - 0.2f) > 1e-6f || decoded[1] != 1.0f)
+    ok = false;
+
+  attribute_decode (ATTR_FORMAT_UNORM10_10_10_2, (const uint8_t *)&packed, 0,
+                    4, decoded);
+  if (decoded[0] != 0.0f || fabsf (decoded[1] - 0.5f) > 1.0f / 1023.0f
+      || decoded[2] != 1.0f || decoded[3] != 1.0f)
+    ok = false;
+
+  /* one-component positions take y = z = 0 and w = 1, batched or not */
+  int16_t xs[6] = { -32767, -16384, 0, 8192, 16384, 32767 };
+  VertexAttribute x_only[] = { { ATTR_POSITION, 0, sizeof (int16_t), 1,
+                                 ATTR_FORMAT_SNORM16 } };
+  VertexBuffer line_vb = vertex_buffer_create (
+      xs, vertex_layout_create (x_only, 1, sizeof (int16_t)), 6);
+  Mat4x4f_t identity = mat4x4f_identity ();
+  Vec4f_t out[6];
+  if (!vertex_transform_positions (&identity, &line_vb, out))
+    ok = false;
+  for (int i = 0; i < 6; ++i)
+    {
+      float x = xs[i] * (1.0f / 32767.0f);
+      if (out[i].x != x || out[i].y != 0.0f || out[i].z != 0.0f
+          || out[i].w != 1.0f)
+        ok = false;
+    }
+  vertex_buffer_destroy (&line_vb);
+
+  /*
+   * the same triangles as floats and quantized. positions on a 1/16 grid
+   * and colors on a 1/255 grid survive half and unorm8 exactly.
+   */
+  typedef struct
+  {
+    uint16_t pos[3];
+    uint8_t  col[4];
+    uint32_t packed_col;
+  } TestQuantizedVertex;
+
+  enum { COUNT = 6 };
+  static const float corners[COUNT][2] = {
+    { -0.875f, -0.75f }, { 0.8125f, -0.5f }, { 0.0625f, 0.875f },
+    { -0.5f, 0.25f },    { 0.375f, -0.875f }, { 0.75f, 0.625f },
+  };
+  TestVertex floats[COUNT];
+  TestQuantizedVertex quantized[COUNT];
+  for (int i = 0; i < COUNT; ++i)
+    {
+      float r = i % 2 ? 1.0f : 0.0f;
+      floats[i] = (TestVertex){
+        { corners[i][0], corners[i][1], 0.0f }, { r, 51.0f / 255.0f, 1, 1 }
+      };
+      for (int c = 0; c < 3; ++c)
+        quantized[i].pos[c] = float_to_half (floats[i].pos[c]);
+      for (int c = 0; c < 4; ++c)
+        quantized[i].col[c] = float_to_unorm8 (floats[i].col[c]);
+      quantized[i].packed_col = float4_to_unorm10_10_10_2 (
+          (const float[4]){ r, 1.0f, 0.0f, 1.0f });
+    }
+
+  VertexAttribute float_attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexAttribute quantized_attributes[] = {
+    { ATTR_POSITION, offsetof (TestQuantizedVertex, pos), sizeof (uint16_t),
+      3, ATTR_FORMAT_FLOAT16 },
+    { ATTR_COLOR, offsetof (TestQuantizedVertex, col), sizeof (uint8_t), 4,
+      ATTR_FORMAT_UNORM8 },
+  };
+
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  VertexLayout layout = vertex_layout_create (float_attributes, 2,
+                                              sizeof (TestVertex));
+  VertexBuffer vb = vertex_buffer_create (floats, layout, COUNT);
+  draw_prim (&pair.expected, &vb, NULL, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  for (int storage = 0; storage < 2; ++storage)
+    {
+      layout = vertex_layout_create (quantized_attributes, 2,
+                                     sizeof (TestQuantizedVertex));
+      layout.storage = storage ? VERTEX_STORAGE_SOA
+                               : VERTEX_STORAGE_INTERLEAVED;
+      vb = vertex_buffer_create (quantized, layout, COUNT);
+      draw_prim (&pair.actual, &vb, NULL, PRIM_TRIANGLES, NULL);
+      vertex_buffer_destroy (&vb);
+
+      if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair))
+        ok = false;
+    }
+
+  /* packed colors, against floats of the values they hold */
+  for (int i = 0; i < COUNT; ++i)
+    {
+      floats[i].col[1] = 1.0f;
+      floats[i].col[2] = 0.0f;
+    }
+  layout = vertex_layout_create (float_attributes, 2, sizeof (TestVertex));
+  vb = vertex_buffer_create (floats, layout, COUNT);
+  draw_prim (&pair.expected, &vb, NULL, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  quantized_attributes[1] = (VertexAttribute){
+    ATTR_COLOR, offsetof (TestQuantizedVertex, packed_col), sizeof (uint32_t),
+    4, ATTR_FORMAT_UNORM10_10_10_2
+  };
+  layout = vertex_layout_create (quantized_attributes, 2,
+                                 sizeof (TestQuantizedVertex));
+  layout.storage = VERTEX_STORAGE_SOA;
+  vb = vertex_buffer_create (quantized, layout, COUNT);
+  draw_prim (&pair.actual, &vb, NULL, PRIM_TRIANGLES, NULL);
+  vertex_buffer_destroy (&vb);
+
+  if (!fb_pair_same (&pair))
+    ok = false;
+
+  /* snorm16 positions through the vertex stage, against their decoded floats */
+  int16_t snorm_pos[COUNT][4];
+  for (int i = 0; i < COUNT; ++i)
+    {
+      for (int c = 0; c < 3; ++c)
+        snorm_pos[i][c] = float_to_snorm16 (c < 2 ? corners[i][c] : 0.3f);
+      attribute_decode (ATTR_FORMAT_SNORM16, (const uint8_t *)snorm_pos[i],
+                        sizeof (int16_t), 3, floats[i].pos);
+    }
+
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 2 }, (Vec3f_t){ 0, 0, 0 },
+                                   (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t mvp = mat4x4f_perspective (1.0f, 1.0f, 0.1f, 10.0f);
+  mvp = mat4x4f_mul (&mvp, &view);
+  DrawState state = draw_state_default ();
+  state.mvp = &mvp;
+
+  layout = vertex_layout_create (float_attributes, 2, sizeof (TestVertex));
+  vb = vertex_buffer_create (floats, layout, COUNT);
+  draw_prim (&pair.expected, &vb, NULL, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  /* positions in their own buffer, the float colors beside them */
+  typedef struct
+  {
+    int16_t pos[4];
+    float   col[4];
+  } TestSnormVertex;
+  TestSnormVertex snorm_vertices[COUNT];
+  for (int i = 0; i < COUNT; ++i)
+    {
+      memcpy (snorm_vertices[i].pos, snorm_pos[i], sizeof (snorm_pos[i]));
+      memcpy (snorm_vertices[i].col, floats[i].col, sizeof (floats[i].col));
+    }
+  VertexAttribute snorm_attributes[] = {
+    { ATTR_POSITION, offsetof (TestSnormVertex, pos), sizeof (int16_t), 3,
+      ATTR_FORMAT_SNORM16 },
+    { ATTR_COLOR, offsetof (TestSnormVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  layout = vertex_layout_create (snorm_attributes, 2, sizeof (TestSnormVertex));
+  vb = vertex_buffer_create (snorm_vertices, layout, COUNT);
+  draw_prim (&pair.actual, &vb, NULL, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair))
+    ok = false;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+typedef struct
+{
+  float pos[3];
+  float col[4];
+  float normal[3];
+  float uv[2];
+} TestVaryingVertex;
+
+static const VertexAttribute varying_attributes[] = {
+  { ATTR_POSITION, offsetof (TestVaryingVertex, pos), sizeof (float), 3,
+    ATTR_FORMAT_FLOAT32 },
+  { ATTR_COLOR, offsetof (TestVaryingVertex, col), sizeof (float), 4,
+    ATTR_FORMAT_FLOAT32 },
+  { ATTR_NORMAL, offsetof (TestVaryingVertex, normal), sizeof (float), 3,
+    ATTR_FORMAT_FLOAT32 },
+  { ATTR_TEXCOORD, offsetof (TestVaryingVertex, uv), sizeof (float), 2,
+    ATTR_FORMAT_FLOAT32 },
+};
+static const AttributeSemantic varying_semantics[] = { ATTR_NORMAL,
+                                                       ATTR_TEXCOORD };
+
+/* colors red by the texcoord u after a normal, discarding u < 1/4 */
+static bool
+fragment_texcoord (const Fragment *frag, void *user, Color8_t *out)
+{
+  int *calls = user;
+  (*calls)++;
+
+  if (frag->components != 5)
+    return true;
+
+  float u = frag->varyings[3];
+  if (u < 0.25f)
+    return false;
+
+  out->r = (uint8_t)(u * 255.0f + 0.5f);
+  out->g = (uint8_t)(frag->varyings[2] * 255.0f + 0.5f);
+  return true;
+}
+
+/* red channel of pixel (x, y) */
+static int
+pixel_red (const Framebuffer *fb, int x, int y)
+{
+  const uint32_t *px = (const uint32_t *)fb->back_buffer;
+  return (px[y * FB_WIDTH + x] >> 16) & 0xFF;
+}
+
+bool
+test_draw_varyings (void)
+{
+  /* a quad over the whole framebuffer, u running left to right */
+  static const TestVaryingVertex quad[6] = {
+    { { -1, -1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 0, 0 } },
+    { { 1, -1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 1, 0 } },
+    { { 1, 1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 1, 1 } },
+    { { -1, -1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 0, 0 } },
+    { { 1, 1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 1, 1 } },
+    { { -1, 1, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 0, 1 } },
+  };
+  static const TestVaryingVertex line[2] = {
+    { { -0.875f, 0, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 0, 0 } },
+    { { 0.875f, 0, 0 }, { 0, 0, 1, 1 }, { 0, 0, 1 }, { 1, 0 } },
+  };
+
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, FB_WIDTH, FB_HEIGHT))
+    return false;
+
+  int calls = 0;
+  DrawState state = draw_state_default ();
+  state.varyings = varying_semantics;
+  state.varying_count = 2;
+  state.fragment_func = fragment_texcoord;
+  state.fragment_data = &calls;
+
+  VertexLayout layout = vertex_layout_create (varying_attributes, 4,
+                                              sizeof (TestVaryingVertex));
+  VertexBuffer vb = vertex_buffer_create (quad, layout, 6);
+  draw_prim (&fb, &vb, NULL, PRIM_TRIANGLES, &state);
+  vertex_buffer_destroy (&vb);
+
+  /* every pixel is shaded once; discarded ones keep color and depth */
+  const uint32_t *px = (const uint32_t *)fb.back_buffer;
+  bool ok = calls == FB_WIDTH * FB_HEIGHT
+            && count_pixels (&fb) == FB_WIDTH * FB_HEIGHT * 3 / 4;
+  if (px[32 * FB_WIDTH + 8] != 0 || fb.depth_buffer[32 * FB_WIDTH + 8] != 1.0f)
+    ok = false;
+
+  /* u is 40.5 / 64 at the center of column 40, the normal z is 1 */
+  int red = pixel_red (&fb, 40, 32);
+  if (abs (red - 161) > 1 || ((px[32 * FB_WIDTH + 40] >> 8) & 0xFF) != 255
+      || fb.depth_buffer[32 * FB_WIDTH + 40] != 0.5f)
+    ok = false;
+
+  /* along a line from column 4 to 60, thin and then wide */
+  layout = vertex_layout_create (varying_attributes, 4,
+                                 sizeof (TestVaryingVertex));
+  vb = vertex_buffer_create (line, layout, 2);
+  for (int width = 1; width <= 3; width += 2)
+    {
+      state.line_width = (float)width;
+      draw_prim (&fb, &vb, NULL, PRIM_LINES, &state);
+
+      if (pixel_red (&fb, 4, 32) != 0 || pixel_red (&fb, 10, 32) != 0
+          || abs (pixel_red (&fb, 32, 32) - 128) > 2
+          || abs (pixel_red (&fb, 58, 32) - 247) > 2)
+        ok = false;
+    }
+  vertex_buffer_destroy (&vb);
+
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* calls of fragment_batch_texcoord and the pixels they got */
+typedef struct
+{
+  int  calls;
+  int  pixels;
+  bool bad_batch;
+} TestBatchStats;
+
+/* fragment_texcoord for a batch */
+static void
+fragment_batch_texcoord (FragmentBatch *batch, void *user)
+{
+  TestBatchStats *stats = user;
+  stats->calls++;
+  if (batch->count == 0 || batch->count > FRAGMENT_BATCH
+      || batch->mask >> batch->count || batch->components != 5)
+    {
+      stats->bad_batch = true;
+      return;
+    }
+
+  for (int k = 0; k < FRAGMENT_BATCH; ++k)
+    {
+      float u = batch->varyings[3][k];
+      if (u < 0.25f)
+        batch->mask &= ~(1u << k);
+      batch->color[k].r = (uint8_t)(u * 255.0f + 0.5f);
+      batch->color[k].g = (uint8_t)(batch->varyings[2][k] * 255.0f + 0.5f);
+    }
+
+  for (uint32_t k = 0; k < batch->count; ++k)
+    stats->pixels += (batch->mask >> k) & 1u;
+}
+
+static TestVaryingVertex
+varying_vertex (float x, float y, float z)
+{
+  float u = (x + 1.0f) * 0.5f;
+  float v = (y + 1.0f) * 0.5f;
+  return (TestVaryingVertex){
+    { x, y, z }, { u, 0.0f, 1.0f - u, 1.0f }, { 0.0f, 0.0f, 1.0f }, { u, v }
+  };
+}
+
+bool
+test_draw_fragment_batch (void)
+{
+  /*
+   * a quad behind small triangles of both windings and a sliver, for the
+   * block, small triangle and span paths, then a quad behind them all that
+   * fails the depth test everywhere
+   */
+  enum { SMALL = 16, COUNT = 6 + 3 * SMALL + 3 + 6 };
+  TestVaryingVertex vertices[COUNT];
+  int n = 0;
+  const float quad[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 },
+                             { -1, -1 }, { 1, 1 },  { -1, 1 } };
+  for (int i = 0; i < 6; ++i)
+    vertices[n++] = varying_vertex (quad[i][0], quad[i][1], 0.2f);
+  for (int i = 0; i < SMALL; ++i)
+    {
+      float x = -0.9f + 0.11f * i;
+      float y = (i % 4) * 0.4f - 0.7f;
+      float d = i % 2 ? 0.1f : -0.1f;
+      vertices[n++] = varying_vertex (x, y, -0.3f);
+      vertices[n++] = varying_vertex (x + 0.1f, y, -0.3f);
+      vertices[n++] = varying_vertex (x, y + d, -0.3f);
+    }
+  vertices[n++] = varying_vertex (-0.95f, -0.9f, -0.5f);
+  vertices[n++] = varying_vertex (0.9f, 0.95f, -0.5f);
+  vertices[n++] = varying_vertex (0.85f, 0.95f, -0.5f);
+  for (int i = 0; i < 6; ++i)
+    vertices[n++] = varying_vertex (quad[i][0], quad[i][1], 0.6f);
+
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  VertexLayout layout = vertex_layout_create (varying_attributes, 4,
+                                              sizeof (TestVaryingVertex));
+  VertexBuffer vb = vertex_buffer_create (vertices, layout, COUNT);
+
+  int calls = 0;
+  TestBatchStats stats = { 0, 0, false };
+  DrawState state = draw_state_default ();
+  state.varyings = varying_semantics;
+  state.varying_count = 2;
+  bool ok = true;
+
+  const RasterPath paths[] = { RASTER_PATH_AUTO, RASTER_PATH_BLOCKS,
+                               RASTER_PATH_SPANS };
+  for (int p = 0; p < 3; ++p)
+    {
+      fb_pair_clear (&pair);
+      state.raster_path = paths[p];
+
+      state.fragment_func = fragment_texcoord;
+      state.fragment_batch = NULL;
+      state.fragment_data = &calls;
+      draw_prim (&pair.expected, &vb, NULL, PRIM_TRIANGLES, &state);
+
+      /* the same pixels, colors and depths a batch at a time */
+      stats = (TestBatchStats){ 0, 0, false };
+      state.fragment_func = NULL;
+      state.fragment_batch = fragment_batch_texcoord;
+      state.fragment_data = &stats;
+      draw_prim (&pair.actual, &vb, NULL, PRIM_TRIANGLES, &state);
+
+      if (stats.bad_batch || stats.pixels == 0 || stats.calls * 2 > stats.pixels
+          || !fb_pair_same (&pair))
+        ok = false;
+    }
+  vertex_buffer_destroy (&vb);
+
+  /* lines hand over one pixel at a time */
+  vertices[0] = varying_vertex (-0.875f, 0.0f, 0.0f);
+  vertices[1] = varying_vertex (0.875f, 0.3f, 0.0f);
+  layout = vertex_layout_create (varying_attributes, 4,
+                                 sizeof (TestVaryingVertex));
+  vb = vertex_buffer_create (vertices, layout, 2);
+
+  fb_clear (&pair.expected);
+  state.fragment_func = fragment_texcoord;
+  state.fragment_batch = NULL;
+  state.fragment_data = &calls;
+  draw_prim (&pair.expected, &vb, NULL, PRIM_LINES, &state);
+
+  fb_clear (&pair.actual);
+  stats = (TestBatchStats){ 0, 0, false };
+  state.fragment_func = NULL;
+  state.fragment_batch = fragment_batch_texcoord;
+  state.fragment_data = &stats;
+  draw_prim (&pair.actual, &vb, NULL, PRIM_LINES, &state);
+  vertex_buffer_destroy (&vb);
+
+  if (stats.bad_batch || stats.pixels == 0
+      || !fb_pair_same (&pair))
+    ok = false;
+
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* counts the pixels it shades into the int at user */
+static bool
+fragment_tally (const Fragment *frag, void *user, Color8_t *out)
+{
+  (void)frag;
+  (void)out;
+  ++*(int *)user;
+  return true;
+}
+
+/* fragment_tally for a batch */
+static void
+fragment_batch_tally (FragmentBatch *batch, void *user)
+{
+  for (uint32_t k = 0; k < batch->count; ++k)
+    *(int *)user += (batch->mask >> k) & 1u;
+}
+
+bool
+test_draw_fragment_batch_prepass (void)
+{
+  /*
+   * a depth pre-pass, then a DEPTH_EQUAL pass shading a pixel at a time
+   * and a batch at a time. the framebuffer is large enough for edge values
+   * past 2^24, where barycentrics off by a float rounding from the ones
+   * the pre-pass used give other depths and drop pixels. the second
+   * triangle reaches far into the guard band, for edge values past 2^31.
+   */
+  enum { SIZE = 1024 };
+  Framebuffer fb;
+  if (!fb_init_memory (&fb, SIZE, SIZE))
+    return false;
+
+  const TestVertex vertices[] = {
+    { { -0.95f, -0.9f, 0.1f }, { 1, 0, 0, 1 } },
+    { { 0.97f, -0.8f, 0.7f }, { 0, 1, 0, 1 } },
+    { { -0.3f, 0.93f, 0.4f }, { 0, 0, 1, 1 } },
+    { { -9.4f, -7.9f, 0.1f }, { 1, 0, 0, 1 } },
+    { { 6.4f, -1.7f, -0.5f }, { 0, 1, 0, 1 } },
+    { { 0.7f, 14.0f, -0.2f }, { 0, 0, 1, 1 } },
+  };
+  VertexAttribute attributes[] = {
+    { ATTR_POSITION, offsetof (TestVertex, pos), sizeof (float), 3,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  VertexBuffer vb[2];
+  for (int i = 0; i < 2; ++i)
+    {
+      VertexLayout layout
+          = vertex_layout_create (attributes, 2, sizeof (TestVertex));
+      vb[i] = vertex_buffer_create (&vertices[3 * i], layout, 3);
+    }
+
+  DrawState depth_only = draw_state_default ();
+  depth_only.color_write = false;
+
+  DrawState shade_equal = draw_state_default ();
+  shade_equal.depth_func = DEPTH_EQUAL;
+  shade_equal.depth_write = false;
+
+  bool ok = true;
+  const RasterPath paths[] = { RASTER_PATH_AUTO, RASTER_PATH_BLOCKS,
+                               RASTER_PATH_SPANS };
+  for (int i = 0; i < 2 * 3; ++i)
+    {
+      const VertexBuffer *tri = &vb[i / 3];
+      depth_only.raster_path = paths[i % 3];
+      shade_equal.raster_path = paths[i % 3];
+
+      fb_clear (&fb);
+      draw_vertex_buffer (&fb, tri, PRIM_TRIANGLES, &depth_only);
+      int covered = 0;
+      for (int j = 0; j < SIZE * SIZE; ++j)
+        covered += fb.depth_buffer[j] < 1.0f;
+
+      int single = 0;
+      shade_equal.fragment_func = fragment_tally;
+      shade_equal.fragment_batch = NULL;
+      shade_equal.fragment_data = &single;
+      draw_vertex_buffer (&fb, tri, PRIM_TRIANGLES, &shade_equal);
+
+      int batched = 0;
+      shade_equal.fragment_func = NULL;
+      shade_equal.fragment_batch = fragment_batch_tally;
+      shade_equal.fragment_data = &batched;
+      draw_vertex_buffer (&fb, tri, PRIM_TRIANGLES, &shade_equal);
+
+      if (covered < SIZE * SIZE / 4 || single != covered
+          || batched != covered)
+        ok = false;
+    }
+
+  vertex_buffer_destroy (&vb[0]);
+  vertex_buffer_destroy (&vb[1]);
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* keeps the interpolated color, only to take the generic path */
+static bool
+fragment_keep (const Fragment *frag, void *user, Color8_t *out)
+{
+  (void)frag;
+  (void)user;
+  (void)out;
+  return true;
+}
+
+/* pixel format k of test_draw_pipeline_variants, 32-bit without alpha first */
+static void
+fb_set_format (Framebuffer *fb, int k)
+{
+  static const int formats[3][9] = {
+    /* bpp, red, green, blue, alpha offset and length */
+    { 32, 16, 8, 8, 8, 0, 8, 0, 0 },
+    { 32, 0, 8, 8, 8, 16, 8, 24, 8 },
+    { 16, 11, 5, 5, 6, 0, 5, 0, 0 },
+  };
+  const int *f = formats[k];
+  fb->vinfo.bits_per_pixel = f[0];
+  fb->vinfo.red.offset = f[1];
+  fb->vinfo.red.length = f[2];
+  fb->vinfo.green.offset = f[3];
+  fb->vinfo.green.length = f[4];
+  fb->vinfo.blue.offset = f[5];
+  fb->vinfo.blue.length = f[6];
+  fb->vinfo.transp.offset = f[7];
+  fb->vinfo.transp.length = f[8];
+  fb->finfo.line_length = FB_WIDTH * f[0] / 8;
+}
+
+bool
+test_draw_pipeline_variants (void)
+{
+  /*
+   * a quad over a quad at the same depth, small triangles in front of it
+   * and a sliver, drawn by the variant for the state and, with a fragment
+   * function that keeps the color, by the generic path, with 1, 2 and 4
+   * samples per pixel
+   */
+  enum { SMALL = 16, COUNT = 6 + 3 * SMALL + 3 };
+  TestVaryingVertex vertices[COUNT];
+  int n = 0;
+  const float quad[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 },
+                             { -1, -1 }, { 1, 1 },  { -1, 1 } };
+  for (int i = 0; i < 6; ++i)
+    vertices[n++] = varying_vertex (quad[i][0] * 0.8f, quad[i][1], 0.2f);
+  for (int i = 0; i < SMALL; ++i)
+    {
+      float x = -0.9f + 0.11f * i;
+      float y = (i % 4) * 0.4f - 0.7f;
+      float d = i % 2 ? 0.1f : -0.1f;
+      vertices[n++] = varying_vertex (x, y, -0.3f);
+      vertices[n++] = varying_vertex (x + 0.1f, y, -0.3f);
+      vertices[n++] = varying_vertex (x, y + d, 0.5f);
+    }
+  vertices[n++] = varying_vertex (-0.95f, -0.9f, -0.5f);
+  vertices[n++] = varying_vertex (0.9f, 0.95f, -0.5f);
+  vertices[n++] = varying_vertex (0.85f, 0.95f, -0.5f);
+
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  VertexBuffer background = vertex_buffer_create (
+      vertices,
+      vertex_layout_create (varying_attributes, 2, sizeof (TestVaryingVertex)),
+      6);
+  VertexBuffer vb = vertex_buffer_create (
+      vertices,
+      vertex_layout_create (varying_attributes, 2, sizeof (TestVaryingVertex)),
+      COUNT);
+
+  const RasterPath paths[] = { RASTER_PATH_AUTO, RASTER_PATH_BLOCKS,
+                               RASTER_PATH_SPANS };
+  const DepthFunc funcs[] = { DEPTH_LESS, DEPTH_LESS_EQUAL, DEPTH_EQUAL,
+                              DEPTH_ALWAYS };
+  const uint32_t samples[] = { 1, 2, 4 };
+  bool ok = true;
+
+  for (int m = 0; m < 3; ++m)
+    {
+      if (!fb_set_samples (&pair.expected, samples[m])
+          || !fb_set_samples (&pair.actual, samples[m]))
+        {
+          ok = false;
+          break;
+        }
+      float *depth_buffer = pair.expected.depth_buffer;
+      float *actual_depth = pair.actual.depth_buffer;
+
+      for (int format = 0; format < 3; ++format)
+        for (int depth = 0; depth < 5; ++depth)
+          for (int writes = 0; writes < 4; ++writes)
+            for (int p = 0; p < 3; ++p)
+              {
+                DrawState state = draw_state_default ();
+                state.raster_path = paths[p];
+
+                fb_set_format (&pair.expected, format);
+                fb_set_format (&pair.actual, format);
+                fb_pair_clear (&pair);
+
+                /* the last depth mode draws without a depth buffer */
+                if (depth == 4)
+                  {
+                    pair.expected.depth_buffer = NULL;
+                    pair.actual.depth_buffer = NULL;
+                  }
+
+                Framebuffer *fbs[2] = { &pair.expected, &pair.actual };
+                for (int k = 0; k < 2; ++k)
+                  {
+                    Framebuffer *fb = fbs[k];
+                    state.depth_func = DEPTH_LESS;
+                    state.depth_write = true;
+                    state.color_write = true;
+                    state.fragment_func = NULL;
+                    draw_vertex_buffer (fb, &background, PRIM_TRIANGLES,
+                                        &state);
+
+                    state.depth_func = funcs[depth % 4];
+                    state.depth_write = writes & 1;
+                    state.color_write = writes & 2;
+                    state.fragment_func
+                        = fb == &pair.expected ? fragment_keep : NULL;
+                    draw_vertex_buffer (fb, &vb, PRIM_TRIANGLES, &state);
+                  }
+
+                pair.expected.depth_buffer = depth_buffer;
+                pair.actual.depth_buffer = actual_depth;
+                fb_resolve (&pair.expected);
+                fb_resolve (&pair.actual);
+                if (!fb_pair_same (&pair))
+                  ok = false;
+              }
+    }
+
+  vertex_buffer_destroy (&background);
+  vertex_buffer_destroy (&vb);
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_draw_instanced (void)
+{
+  /*
+   * a quad drawn at four places, offset, rotated and tinted per instance;
+   * the last one is off screen and culled whole
+   */
+  TestVaryingVertex quad[4] = {
+    varying_vertex (-0.2f, -0.2f, 0.0f), varying_vertex (0.2f, -0.2f, 0.0f),
+    varying_vertex (0.2f, 0.2f, 0.1f), varying_vertex (-0.2f, 0.2f, 0.1f)
+  };
+  unsigned int indices[] = { 0, 1, 2, 0, 2, 3 };
+  enum { INSTANCES = 4 };
+  const Vec3f_t offsets[INSTANCES]
+      = { { -0.5f, -0.4f, 0.0f }, { 0.1f, 0.2f, 0.0f }, { 0.3f, -0.3f, 0.0f },
+          { 5.0f, 0.0f, 0.0f } };
+  const Color8_t colors[INSTANCES]
+      = { { 255, 255, 255, 255 }, { 255, 128, 0, 255 }, { 0, 255, 64, 128 },
+          { 255, 255, 255, 255 } };
+  Mat4x4f_t models[INSTANCES];
+  for (int i = 0; i < INSTANCES; ++i)
+    {
+      Mat4x4f_t m = mat4x4f_identity ();
+      m = mat4x4f_translate (&m, offsets[i]);
+      models[i] = mat4x4f_rotation (&m, (Vec3f_t){ 0.0f, 0.0f, 0.4f * i });
+    }
+
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  IndexBuffer ib = index_buffer_create (indices, 6);
+  VertexBuffer vb = vertex_buffer_create (
+      quad,
+      vertex_layout_create (varying_attributes, 2, sizeof (TestVaryingVertex)),
+      4);
+  Mat4x4f_t view = mat4x4f_lookat ((Vec3f_t){ 0, 0, 2 }, (Vec3f_t){ 0, 0, 0 },
+                                   (Vec3f_t){ 0, 1, 0 });
+  Mat4x4f_t view_projection = mat4x4f_perspective (1.0f, 1.0f, 0.1f, 10.0f);
+  view_projection = mat4x4f_mul (&view_projection, &view);
+  bool ok = true;
+
+  /* with and without a view projection, tinted triangles and plain lines */
+  for (int pass = 0; pass < 2; ++pass)
+    {
+      PrimitiveType prim = pass ? PRIM_LINES : PRIM_TRIANGLES;
+      InstanceBuffer instances = { models, pass ? NULL : colors, INSTANCES };
+      DrawStats stats;
+      memset (&stats, 0, sizeof (stats));
+      DrawState state = draw_state_default ();
+      state.mvp = pass ? NULL : &view_projection;
+      state.stats = &stats;
+
+      fb_clear (&pair.actual);
+      draw_index_buffer_instanced (&pair.actual, &ib, &vb, &instances, prim,
+                                   &state);
+
+      /* the same as one draw per instance with its colors pre-multiplied */
+      fb_clear (&pair.expected);
+      for (int i = 0; i < INSTANCES; ++i)
+        {
+          TestVaryingVertex tinted[4];
+          memcpy (tinted, quad, sizeof (quad));
+          for (int v = 0; v < 4 && instances.colors; ++v)
+            {
+              tinted[v].col[0] *= colors[i].r * (1.0f / 255.0f);
+              tinted[v].col[1] *= colors[i].g * (1.0f / 255.0f);
+              tinted[v].col[2] *= colors[i].b * (1.0f / 255.0f);
+              tinted[v].col[3] *= colors[i].a * (1.0f / 255.0f);
+            }
+          VertexBuffer one = vertex_buffer_create (
+              tinted,
+              vertex_layout_create (varying_attributes, 2,
+                                    sizeof (TestVaryingVertex)),
+              4);
+          Mat4x4f_t mvp = state.mvp ? mat4x4f_mul (&view_projection,
+                                                   &models[i])
+                                    : models[i];
+          DrawState single = draw_state_default ();
+          single.mvp = &mvp;
+          draw_index_buffer (&pair.expected, &ib, &one, prim, &single);
+          vertex_buffer_destroy (&one);
+        }
+
+      if (count_pixels (&pair.actual) == 0
+          || !fb_pair_same (&pair)
+          || stats.vertices_transformed != 4 * (INSTANCES - 1)
+          || stats.instances_culled != 1)
+        ok = false;
+    }
+
+  /*
+   * homogeneous positions, with w = 1 as main.c's meshes have and with
+   * every component doubled: the off-screen instance is still culled
+   */
+  VertexAttribute homogeneous[] = {
+    { ATTR_POSITION, offsetof (TestClipVertex, pos), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+    { ATTR_COLOR, offsetof (TestClipVertex, col), sizeof (float), 4,
+      ATTR_FORMAT_FLOAT32 },
+  };
+  for (int w = 1; w <= 2; ++w)
+    {
+      TestClipVertex quad4[4];
+      for (int v = 0; v < 4; ++v)
+        {
+          for (int c = 0; c < 3; ++c)
+            quad4[v].pos[c] = quad[v].pos[c] * w;
+          quad4[v].pos[3] = (float)w;
+          memcpy (quad4[v].col, quad[v].col, sizeof (quad4[v].col));
+        }
+      VertexBuffer vb4 = vertex_buffer_create (
+          quad4,
+          vertex_layout_create (homogeneous, 2, sizeof (TestClipVertex)), 4);
+
+      InstanceBuffer instances = { models, NULL, INSTANCES };
+      DrawStats stats;
+      memset (&stats, 0, sizeof (stats));
+      DrawState state = draw_state_default ();
+      state.mvp = &view_projection;
+      state.stats = &stats;
+
+      fb_clear (&pair.actual);
+      draw_index_buffer_instanced (&pair.actual, &ib, &vb4, &instances,
+                                   PRIM_TRIANGLES, &state);
+
+      fb_clear (&pair.expected);
+      for (int i = 0; i < INSTANCES; ++i)
+        {
+          Mat4x4f_t mvp = mat4x4f_mul (&view_projection, &models[i]);
+          DrawState single = draw_state_default ();
+          single.mvp = &mvp;
+          draw_index_buffer (&pair.expected, &ib, &vb4, PRIM_TRIANGLES,
+                             &single);
+        }
+      vertex_buffer_destroy (&vb4);
+
+      if (count_pixels (&pair.actual) == 0 || !fb_pair_same (&pair)
+          || stats.instances_culled != 1)
+        ok = false;
+    }
+
+  index_buffer_destroy (&ib);
+  vertex_buffer_destroy (&vb);
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+bool
+test_fb_init (void)
+{
+  /* stack garbage, as in a caller's uninitialized Framebuffer */
+  Framebuffer fb;
+  memset (&fb, 0xA5, sizeof (fb));
+
+  /* without a device fb_init fails; keep its perror off the test output */
+  fflush (stderr);
+  int saved = dup (STDERR_FILENO);
+  int null = open ("/dev/null", O_WRONLY);
+  if (null >= 0)
+    dup2 (null, STDERR_FILENO);
+  bool opened = fb_init (&fb, "/dev/fb0");
+  fflush (stderr);
+  if (saved >= 0)
+    dup2 (saved, STDERR_FILENO);
+  if (saved >= 0)
+    close (saved);
+  if (null >= 0)
+    close (null);
+
+  /* buffers fb_init did not allocate are absent, whether it failed or not */
+  bool ok = !fb.sample_colors && !fb.sample_split;
+  if (opened)
+    {
+      fb_clear (&fb);
+      ok = ok && fb.samples == 1 && fb.depth_buffer[0] == 1.0f;
+    }
+  else if (fb.back_buffer || fb.depth_buffer || fb.hiz_buffer
+           || fb.hiz_writes)
+    ok = false;
+
+  /* and shutting down frees only what is there */
+  fb_shutdown (&fb);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* draw vb into pair->actual with Hi-Z and into pair->expected without */
+static void
+draw_hiz_pair (FbPair *pair, const VertexBuffer *vb, const DrawState *state)
+{
+  float *hiz = pair->expected.hiz_buffer;
+  pair->expected.hiz_buffer = NULL;
+  draw_vertex_buffer (&pair->expected, vb, PRIM_TRIANGLES, state);
+  pair->expected.hiz_buffer = hiz;
+  draw_vertex_buffer (&pair->actual, vb, PRIM_TRIANGLES, state);
+}
+
+/* a triangle list of count vertices */
+static VertexBuffer
+hiz_buffer_create (const TestVaryingVertex *vertices, size_t count)
+{
+  return vertex_buffer_create (
+      vertices,
+      vertex_layout_create (varying_attributes, 2, sizeof (TestVaryingVertex)),
+      count);
+}
+
+/* the two triangles of the quad [x0, x1] x [y0, y1] at depth z */
+static void
+hiz_quad (TestVaryingVertex *v, float x0, float y0, float x1, float y1,
+          float z)
+{
+  v[0] = varying_vertex (x0, y0, z);
+  v[1] = varying_vertex (x1, y0, z);
+  v[2] = varying_vertex (x1, y1, z);
+  v[3] = varying_vertex (x0, y0, z);
+  v[4] = varying_vertex (x1, y1, z);
+  v[5] = varying_vertex (x0, y1, z);
+}
+
+bool
+test_draw_hiz (void)
+{
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+
+  size_t tiles = (size_t)pair.actual.hiz_width * pair.actual.hiz_height;
+  uint8_t *before = malloc (pair.actual.size);
+  if (!before)
+    {
+      fb_pair_shutdown (&pair);
+      return false;
+    }
+
+  DrawState state = draw_state_default ();
+  TestVaryingVertex near[6], far[6], half[6];
+  hiz_quad (near, -1, -1, 1, 1, -0.5f);
+  hiz_quad (far, -1, -1, 1, 1, 0.6f);
+  hiz_quad (half, -1, -1, 0, 1, -0.5f);
+  VertexBuffer near_vb = hiz_buffer_create (near, 6);
+  VertexBuffer far_vb = hiz_buffer_create (far, 6);
+  VertexBuffer half_vb = hiz_buffer_create (half, 6);
+
+  /*
+   * a large triangle and small ones crossing the half occluder in depth,
+   * some small ones entirely behind it
+   */
+  TestVaryingVertex cross[3 + 3 * 8];
+  cross[0] = varying_vertex (-0.9f, -0.8f, -0.8f);
+  cross[1] = varying_vertex (0.9f, -0.6f, 0.6f);
+  cross[2] = varying_vertex (-0.2f, 0.9f, -0.2f);
+  for (int i = 0; i < 8; ++i)
+    {
+      float x = -0.95f + 0.24f * i;
+      float y = i % 2 ? 0.5f : -0.3f;
+      float z = i % 3 == 0 ? 0.4f : -0.7f + 0.1f * i;
+      cross[3 + 3 * i] = varying_vertex (x, y, z);
+      cross[4 + 3 * i] = varying_vertex (x + 0.15f, y, z);
+      cross[5 + 3 * i] = varying_vertex (x, y + 0.15f, -z);
+    }
+  VertexBuffer cross_vb = hiz_buffer_create (cross, 3 + 3 * 8);
+
+  /* a triangle behind the near quad */
+  TestVaryingVertex behind[3] = { varying_vertex (-0.8f, -0.8f, 0.2f),
+                                  varying_vertex (0.8f, -0.7f, 0.2f),
+                                  varying_vertex (0.0f, 0.8f, 0.2f) };
+  VertexBuffer behind_vb = hiz_buffer_create (behind, 3);
+
+  /*
+   * a full occluder stores a tile's worth of depths into every tile, whose
+   * bounds are then recomputed to its exact depth
+   */
+  fb_pair_clear (&pair);
+  draw_hiz_pair (&pair, &near_vb, &state);
+  bool refreshed = true;
+  for (size_t i = 0; i < tiles; ++i)
+    refreshed = refreshed && pair.actual.hiz_buffer[i] == 0.25f;
+
+  /* a fully occluded triangle leaves everything as it was */
+  memcpy (before, pair.actual.back_buffer, pair.actual.size);
+  draw_hiz_pair (&pair, &behind_vb, &state);
+  bool ok = refreshed && fb_pair_same (&pair)
+            && memcmp (before, pair.actual.back_buffer, pair.actual.size)
+                   == 0;
+
+  /*
+   * and is rejected by Hi-Z alone: with the depths forgotten but the tile
+   * bounds kept, it still draws nothing
+   */
+  for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i)
+    pair.actual.depth_buffer[i] = 1.0f;
+  draw_vertex_buffer (&pair.actual, &behind_vb, PRIM_TRIANGLES, &state);
+  if (memcmp (before, pair.actual.back_buffer, pair.actual.size) != 0)
+    ok = false;
+
+  /* partly occluded triangles draw what the depth buffer alone would */
+  const DepthFunc funcs[] = { DEPTH_LESS, DEPTH_LESS_EQUAL };
+  for (int f = 0; f < 2; ++f)
+    {
+      fb_pair_clear (&pair);
+      state.depth_func = funcs[f];
+      draw_hiz_pair (&pair, &half_vb, &state);
+      memcpy (before, pair.actual.back_buffer, pair.actual.size);
+      draw_hiz_pair (&pair, &cross_vb, &state);
+      if (!fb_pair_same (&pair)
+          || memcmp (before, pair.actual.back_buffer, pair.actual.size) == 0)
+        ok = false;
+    }
+
+  /*
+   * DEPTH_ALWAYS pushes tiles farther, before and after their refresh, so a
+   * triangle behind the near quad but in front of what replaced it draws
+   */
+  state.depth_func = DEPTH_LESS;
+  fb_pair_clear (&pair);
+  draw_hiz_pair (&pair, &near_vb, &state);
+  state.depth_func = DEPTH_ALWAYS;
+  draw_hiz_pair (&pair, &far_vb, &state);
+  state.depth_func = DEPTH_LESS;
+  memcpy (before, pair.actual.back_buffer, pair.actual.size);
+  draw_hiz_pair (&pair, &behind_vb, &state);
+  if (!fb_pair_same (&pair)
+      || memcmp (before, pair.actual.back_buffer, pair.actual.size) == 0)
+    ok = false;
+
+  fb_pair_clear (&pair);
+  draw_hiz_pair (&pair, &near_vb, &state);
+  state.depth_func = DEPTH_ALWAYS;
+  draw_hiz_pair (&pair, &cross_vb, &state);
+  state.depth_func = DEPTH_LESS;
+  draw_hiz_pair (&pair, &behind_vb, &state);
+  if (!fb_pair_same (&pair))
+    ok = false;
+
+  /*
+   * a DEPTH_EQUAL pass after a depth pre-pass refreshed the tiles shades
+   * every pixel the pre-pass left visible
+   */
+  fb_pair_clear (&pair);
+  DrawState depth_only = draw_state_default ();
+  depth_only.color_write = false;
+  DrawState shade_equal = draw_state_default ();
+  shade_equal.depth_func = DEPTH_EQUAL;
+  shade_equal.depth_write = false;
+  draw_hiz_pair (&pair, &far_vb, &depth_only);
+  draw_hiz_pair (&pair, &cross_vb, &depth_only);
+  draw_hiz_pair (&pair, &far_vb, &shade_equal);
+  draw_hiz_pair (&pair, &cross_vb, &shade_equal);
+  if (!fb_pair_same (&pair)
+      || count_pixels (&pair.actual) != FB_WIDTH * FB_HEIGHT)
+    ok = false;
+
+  vertex_buffer_destroy (&near_vb);
+  vertex_buffer_destroy (&far_vb);
+  vertex_buffer_destroy (&half_vb);
+  vertex_buffer_destroy (&cross_vb);
+  vertex_buffer_destroy (&behind_vb);
+  free (before);
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
+
+/* fragment_func counting the fragments of each pixel, FB_WIDTH a row */
+static bool
+fragment_count (const Fragment *frag, void *user, Color8_t *out)
+{
+  int *hits = user;
+  hits[frag->pos.y * FB_WIDTH + frag->pos.x]++;
+  (void)out;
+  return true;
+}
+
+/* pixel coordinate p in NDC, on either axis */
+static float
+pixel_ndc (float p)
+{
+  return p * (2.0f / FB_WIDTH) - 1.0f;
+}
+
+bool
+test_draw_small_triangles (void)
+{
+  /*
+   * a grid of 5 pixel cells with corners on pixel centers, split along
+   * alternating diagonals, so every edge is shared and runs through pixel
+   * centers; and triangles of both windings around the corners of the
+   * Hi-Z tiles, each storing depths into four tiles
+   */
+  enum { CELLS = 12, GRID = 6 * CELLS * CELLS, CORNERS = 7 * 7 };
+  static TestVaryingVertex grid[GRID];
+  TestVaryingVertex corners[3 * CORNERS];
+
+  int n = 0;
+  for (int j = 0; j < CELLS; ++j)
+    for (int i = 0; i < CELLS; ++i)
+      {
+        TestVaryingVertex c[2][2];
+        for (int dj = 0; dj < 2; ++dj)
+          for (int di = 0; di < 2; ++di)
+            {
+              int gi = i + di, gj = j + dj;
+              float z = (float)((gi * 7 + gj * 13) % 11) / 11.0f - 0.5f;
+              c[dj][di] = varying_vertex (pixel_ndc (2.5f + 5.0f * gi),
+                                          pixel_ndc (2.5f + 5.0f * gj), z);
+            }
+        bool flip = (i + j) % 2;
+        grid[n++] = c[0][0];
+        grid[n++] = c[0][1];
+        grid[n++] = flip ? c[1][0] : c[1][1];
+        grid[n++] = flip ? c[0][1] : c[0][0];
+        grid[n++] = c[1][1];
+        grid[n++] = c[1][0];
+      }
+
+  n = 0;
+  for (int j = 1; j <= 7; ++j)
+    for (int i = 1; i <= 7; ++i)
+      {
+        float x = 8.0f * i, y = 8.0f * j;
+        float z = 0.1f * (float)((i + j) % 5) - 0.2f;
+        TestVaryingVertex a = varying_vertex (pixel_ndc (x - 2.7f),
+                                              pixel_ndc (y - 2.2f), z);
+        TestVaryingVertex b = varying_vertex (pixel_ndc (x + 3.1f),
+                                              pixel_ndc (y - 1.6f), -z);
+        TestVaryingVertex c = varying_vertex (pixel_ndc (x - 0.4f),
+                                              pixel_ndc (y + 3.3f), z);
+        corners[n++] = a;
+        corners[n++] = (i + j) % 2 ? b : c;
+        corners[n++] = (i + j) % 2 ? c : b;
+      }
+
+  FbPair pair;
+  if (!fb_pair_init (&pair))
+    return false;
+  int *hits = calloc (2 * FB_WIDTH * FB_HEIGHT, sizeof (int));
+  if (!hits)
+    {
+      fb_pair_shutdown (&pair);
+      return false;
+    }
+
+  VertexBuffer scenes[2] = {
+    vertex_buffer_create (grid,
+                          vertex_layout_create (varying_attributes, 4,
+                                                sizeof (TestVaryingVertex)),
+                          GRID),
+    vertex_buffer_create (corners,
+                          vertex_layout_create (varying_attributes, 4,
+                                                sizeof (TestVaryingVertex)),
+                          3 * CORNERS),
+  };
+  size_t tiles = (size_t)pair.actual.hiz_width * pair.actual.hiz_height;
+  bool ok = true;
+
+  /*
+   * each scene drawn by blocks and by the small triangle path, through a
+   * pipeline variant, a fragment function and fragment_batch
+   */
+  for (int s = 0; s < 2; ++s)
+    for (int mode = 0; mode < 3; ++mode)
+      {
+        DrawState state = draw_state_default ();
+        state.varyings = varying_semantics;
+        state.varying_count = 2;
+        TestBatchStats stats = { 0, 0, false };
+        if (mode == 1)
+          state.fragment_func = fragment_count;
+        if (mode == 2)
+          {
+            state.fragment_batch = fragment_batch_texcoord;
+            state.fragment_data = &stats;
+          }
+
+        memset (hits, 0, 2 * FB_WIDTH * FB_HEIGHT * sizeof (int));
+        fb_pair_clear (&pair);
+        state.raster_path = RASTER_PATH_BLOCKS;
+        if (mode == 1)
+          state.fragment_data = hits;
+        draw_vertex_buffer (&pair.expected, &scenes[s], PRIM_TRIANGLES,
+                            &state);
+        state.raster_path = RASTER_PATH_AUTO;
+        if (mode == 1)
+          state.fragment_data = hits + FB_WIDTH * FB_HEIGHT;
+        draw_vertex_buffer (&pair.actual, &scenes[s], PRIM_TRIANGLES,
+                            &state);
+
+        /* the same pixels, and the same depth counts and bounds per tile */
+        if (!fb_pair_same (&pair) || count_pixels (&pair.actual) == 0
+            || stats.bad_batch
+            || memcmp (pair.expected.hiz_writes, pair.actual.hiz_writes,
+                       tiles * sizeof (uint16_t))
+                   != 0
+            || memcmp (pair.expected.hiz_buffer, pair.actual.hiz_buffer,
+                       tiles * sizeof (float))
+                   != 0)
+          ok = false;
+
+        if (mode != 1)
+          continue;
+
+        /* no pixel twice; the grid covers its 60 x 60 pixels exactly */
+        int total[2] = { 0, 0 };
+        for (int k = 0; k < 2; ++k)
+          for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i)
+            {
+              int h = hits[k * FB_WIDTH * FB_HEIGHT + i];
+              if (h > 1)
+                ok = false;
+              total[k] += h;
+            }
+        if (s == 0 && (total[0] != 60 * 60 || total[1] != 60 * 60))
+          ok = false;
+
+        /* the corners stay below a refresh, so each tile counts its pixels */
+        for (size_t t = 0; s == 1 && t < tiles; ++t)
+          {
+            int tx = (int)(t % pair.actual.hiz_width) * FB_HIZ_TILE_SIZE;
+            int ty = (int)(t / pair.actual.hiz_width) * FB_HIZ_TILE_SIZE;
+            int in_tile = 0;
+            for (int y = ty; y < ty + FB_HIZ_TILE_SIZE; ++y)
+              for (int x = tx; x < tx + FB_HIZ_TILE_SIZE; ++x)
+                in_tile += hits[FB_WIDTH * FB_HEIGHT + y * FB_WIDTH + x];
+            if (pair.actual.hiz_writes[t] != in_tile)
+              ok = false;
+          }
+      }
+
+  vertex_buffer_destroy (&scenes[0]);
+  vertex_buffer_destroy (&scenes[1]);
+  free (hits);
+  fb_pair_shutdown (&pair);
+
+  if (!ok)
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+  return true;
+}
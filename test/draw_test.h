@@ -0,0 +1,37 @@
+#ifndef DRAW_TEST_H
+#define DRAW_TEST_H
+
+#include <stdbool.h>
+
+bool test_draw_triangle_fill_quad_coverage (void);
+bool test_draw_triangle_fill_traversal (void);
+bool test_draw_triangle_fill_shared_edge (void);
+bool test_draw_triangle_fill_subpixel (void);
+bool test_draw_triangle_fill_perspective (void);
+bool test_draw_depth_prepass (void);
+bool test_draw_span_path_coverage (void);
+bool test_draw_msaa_resolve (void);
+bool test_draw_line_clipping (void);
+bool test_draw_line_smooth_and_wide (void);
+bool test_draw_point_sprites (void);
+bool test_draw_conservative (void);
+bool test_draw_solid_wireframe (void);
+bool test_draw_clip_near_plane (void);
+bool test_draw_clip_w_zero (void);
+bool test_draw_guard_band (void);
+bool test_draw_cull_mode (void);
+bool test_draw_vertex_cache (void);
+bool test_draw_vertex_stage (void);
+bool test_draw_vertex_layout (void);
+bool test_draw_vertex_soa (void);
+bool test_draw_vertex_formats (void);
+bool test_draw_varyings (void);
+bool test_draw_fragment_batch (void);
+bool test_draw_fragment_batch_prepass (void);
+bool test_draw_pipeline_variants (void);
+bool test_draw_instanced (void);
+bool test_fb_init (void);
+bool test_draw_hiz (void);
+bool test_draw_small_triangles (void);
+
+#endif
@@ -1,3 +1,4 @@
+#include "draw_test.h"
 #include "matrix_test.h"
 
 int
@@ -56,5 +57,40 @@ main (void)
   test_mat3x3f_inv ();
   test_mat4x4f_inv ();
 
+  test_mat4x4f_lookat ();
+  test_mat4x4f_perspective ();
+
+  // draw tests
+  test_draw_triangle_fill_quad_coverage ();
+  test_draw_triangle_fill_traversal ();
+  test_draw_triangle_fill_shared_edge ();
+  test_draw_triangle_fill_subpixel ();
+  test_draw_triangle_fill_perspective ();
+  test_draw_depth_prepass ();
+  test_draw_span_path_coverage ();
+  test_draw_msaa_resolve ();
+  test_draw_line_clipping ();
+  test_draw_line_smooth_and_wide ();
+  test_draw_point_sprites ();
+  test_draw_conservative ();
+  test_draw_solid_wireframe ();
+  test_draw_clip_near_plane ();
+  test_draw_clip_w_zero ();
+  test_draw_guard_band ();
+  test_draw_cull_mode ();
+  test_draw_vertex_cache ();
+  test_draw_vertex_stage ();
+  test_draw_vertex_layout ();
+  test_draw_vertex_soa ();
+  test_draw_vertex_formats ();
+  test_draw_varyings ();
+  test_draw_fragment_batch ();
+  test_draw_fragment_batch_prepass ();
+  test_draw_pipeline_variants ();
+  test_draw_instanced ();
+  test_fb_init ();
+  test_draw_hiz ();
+  test_draw_small_triangles ();
+
   return 0;
 }
@@ -1434,3 +1434,110 @@ test_mat4x4f_inv (void)
   }
   return true;
 }
+
+bool
+test_mat4x4f_lookat (void)
+{
+  const float eps = 1e-5f;
+  int size = 16;
+
+  // looking down -z from (1, 2, 5), translated by -eye
+  {
+    Vec3f_t eye = { 1, 2, 5 };
+    Vec3f_t target = { 1, 2, 0 };
+    Vec3f_t up = { 0, 1, 0 };
+
+    // clang-format off
+    Mat4x4f_t expected = { .m = {
+      1, 0, 0, -1,
+      0, 1, 0, -2,
+      0, 0, 1, -5,
+      0, 0, 0,  1
+    }};
+    // clang-format on
+
+    Mat4x4f_t result = mat4x4f_lookat (eye, target, up);
+    if (!mat_eq (expected.m, result.m, size, eps))
+      {
+        FAIL_MSG (__func__);
+        return false;
+      }
+  }
+
+  // from +x towards the origin: the eye goes to the origin, the target
+  // in front of it on -z
+  {
+    Vec3f_t eye = { 3, 0, 0 };
+    Vec3f_t target = { 0, 0, 0 };
+    Vec3f_t up = { 0, 1, 0 };
+
+    // clang-format off
+    Mat4x4f_t expected = { .m = {
+      0, 0, -1,  0,
+      0, 1,  0,  0,
+      1, 0,  0, -3,
+      0, 0,  0,  1
+    }};
+    // clang-format on
+
+    Mat4x4f_t result = mat4x4f_lookat (eye, target, up);
+    Vec4f_t at_eye = { 3, 0, 0, 1 };
+    Vec4f_t at_target = { 0, 0, 0, 1 };
+    Vec4f_t origin = { 0, 0, 0, 1 };
+    Vec4f_t ahead = { 0, 0, -3, 1 };
+    at_eye = mat4x4f_mul_vec4f (&result, &at_eye);
+    at_target = mat4x4f_mul_vec4f (&result, &at_target);
+
+    if (!mat_eq (expected.m, result.m, size, eps)
+        || !vec4f_eq (&origin, &at_eye, eps, __func__)
+        || !vec4f_eq (&ahead, &at_target, eps, __func__))
+      {
+        FAIL_MSG (__func__);
+        return false;
+      }
+  }
+
+  return true;
+}
+
+bool
+test_mat4x4f_perspective (void)
+{
+  const float eps = 1e-5f;
+  int size = 16;
+
+  // 90 degrees vertically, twice as wide, near 1 and far 3, laid out for
+  // column vectors as mat4x4f_mul_vec4f takes them
+  Mat4x4f_t result = mat4x4f_perspective ((float)M_PI * 0.5f, 2.0f, 1.0f,
+                                          3.0f);
+
+  // clang-format off
+  Mat4x4f_t expected = { .m = {
+    0.5f, 0,  0,  0,
+    0,    1,  0,  0,
+    0,    0, -2, -3,
+    0,    0, -1,  0
+  }};
+  // clang-format on
+
+  if (!mat_eq (expected.m, result.m, size, eps))
+    {
+      FAIL_MSG (__func__);
+      return false;
+    }
+
+  // points on the near and far planes end at NDC depth -1 and 1, with w
+  // their positive distance in front of the eye
+  Vec4f_t near = { 1, 1, -1, 1 };
+  Vec4f_t far = { 0, -3, -3, 1 };
+  Vec4f_t near_clip = { 0.5f, 1, -1, 1 };
+  Vec4f_t far_clip = { 0, -3, 3, 3 };
+  near = mat4x4f_mul_vec4f (&result, &near);
+  far = mat4x4f_mul_vec4f (&result, &far);
+
+  if (!vec4f_eq (&near_clip, &near, eps, __func__)
+      || !vec4f_eq (&far_clip, &far, eps, __func__))
+    return false;
+
+  return true;
+}
@@ -56,4 +56,7 @@ bool test_mat2x2f_inv (void);
 bool test_mat3x3f_inv (void);
 bool test_mat4x4f_inv (void);
 
+bool test_mat4x4f_lookat (void);
+bool test_mat4x4f_perspective (void);
+
 #endif